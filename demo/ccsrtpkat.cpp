@@ -0,0 +1,233 @@
+// known answer tests of the SRTP ciphers
+// Copyright (C) 2026 the GNU ccRTP contributors.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ccrtp/CryptoContext.h>
+#include <ccrtp/crypto/SrtpSymCrypto.h>
+
+#ifdef  CCXX_NAMESPACES
+using namespace ost;
+#endif
+
+// RFC 3711, B.2: AES-CM key stream
+static uint8 cmKey[] = {
+    0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+    0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c };
+
+static const uint8 cmIv[] = {
+    0xf0, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7,
+    0xf8, 0xf9, 0xfa, 0xfb, 0xfc, 0xfd, 0x00, 0x00 };
+
+static const uint8 aesCmStream[] = {
+    0xe0, 0x3e, 0xad, 0x09, 0x35, 0xc9, 0x5e, 0x80,
+    0xe1, 0x66, 0xb1, 0x6d, 0xd9, 0x2b, 0x4e, 0xb4,
+    0xd2, 0x35, 0x13, 0x16, 0x2b, 0x02, 0xd0, 0xf7,
+    0x2a, 0x43, 0xa2, 0xfe, 0x4a, 0x5f, 0x97, 0xab,
+    0x41, 0xe9, 0x5b, 0x3b, 0xb0, 0xa2, 0xe8, 0xdd,
+    0x47, 0x79, 0x01, 0xe4, 0xfc, 0xa8, 0x94, 0xc0,
+    0x31, 0xd4, 0xc2, 0x55, 0xba, 0x42, 0x11, 0xee,
+    0xbc, 0x3f, 0xe4, 0x22, 0x54, 0x78, 0xcb, 0xfd,
+    0xee, 0xb1, 0x38, 0x11, 0x5f, 0x30, 0x45, 0x27,
+    0xd4, 0xbf, 0xd9, 0x61, 0x90, 0x45, 0xb2, 0xda };
+
+// Twofish, ECB known answer for the all zero key and block
+static uint8 twoZeroKey[16];
+
+static const uint8 twoZeroBlock[] = {
+    0x9f, 0x58, 0x9f, 0x5c, 0xf6, 0x12, 0x2c, 0x32,
+    0xb6, 0xbf, 0xec, 0x2f, 0x2a, 0xe8, 0xc3, 0x5a };
+
+// Twofish counter mode with the key and IV of RFC 3711, B.2, as
+// computed by libgcrypt
+static const uint8 twoCmStream[] = {
+    0xfa, 0x7e, 0x94, 0x8f, 0xd1, 0x04, 0xc6, 0xb5,
+    0x77, 0xd2, 0xb9, 0x63, 0x53, 0x0e, 0x37, 0x8f,
+    0xd5, 0x90, 0x7f, 0x4d, 0x98, 0x37, 0xe0, 0x42,
+    0x47, 0xda, 0x4c, 0x5d, 0x86, 0x76, 0x26, 0xca,
+    0x87, 0x05, 0x30, 0x97, 0xea, 0x29, 0xdc, 0x24,
+    0x67, 0x12, 0x1a, 0x7d, 0xb5, 0x7a, 0x06, 0xb6,
+    0x30, 0x26, 0x38, 0x29, 0xf9, 0xb9, 0x27, 0xef,
+    0xe0, 0xb0, 0x7e, 0x07, 0x66, 0x85, 0xdb, 0x4c,
+    0x21, 0x7e, 0x1f, 0x7e, 0xca, 0xe0, 0x78, 0x4d,
+    0xd7, 0xe3, 0x28, 0x78, 0x71, 0xb4, 0xcb, 0x47 };
+
+// RFC 7714, 16.1.1: AEAD_AES_128_GCM protection of an RTP packet
+static uint8 gcmKey[] = {
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+    0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f };
+
+static const uint8 gcmIv[] = {
+    0x51, 0x75, 0x3c, 0x65, 0x80, 0xc2, 0x72, 0x6f,
+    0x20, 0x71, 0x84, 0x14 };
+
+static const uint8 gcmPacket[] = {
+    0x80, 0x40, 0xf1, 0x7b, 0x80, 0x41, 0xf8, 0xd3,
+    0x55, 0x01, 0xa0, 0xb2, 0x47, 0x61, 0x6c, 0x6c,
+    0x69, 0x61, 0x20, 0x65, 0x73, 0x74, 0x20, 0x6f,
+    0x6d, 0x6e, 0x69, 0x73, 0x20, 0x64, 0x69, 0x76,
+    0x69, 0x73, 0x61, 0x20, 0x69, 0x6e, 0x20, 0x70,
+    0x61, 0x72, 0x74, 0x65, 0x73, 0x20, 0x74, 0x72,
+    0x65, 0x73 };
+
+static const uint8 gcmProtected[] = {
+    0x80, 0x40, 0xf1, 0x7b, 0x80, 0x41, 0xf8, 0xd3,
+    0x55, 0x01, 0xa0, 0xb2, 0xf2, 0x4d, 0xe3, 0xa3,
+    0xfb, 0x34, 0xde, 0x6c, 0xac, 0xba, 0x86, 0x1c,
+    0x9d, 0x7e, 0x4b, 0xca, 0xbe, 0x63, 0x3b, 0xd5,
+    0x0d, 0x29, 0x4e, 0x6f, 0x42, 0xa5, 0xf4, 0x7a,
+    0x51, 0xc7, 0xd1, 0x9b, 0x36, 0xde, 0x3a, 0xdf,
+    0x88, 0x33, 0x89, 0x9d, 0x7f, 0x27, 0xbe, 0xb1,
+    0x6a, 0x91, 0x52, 0xcf, 0x76, 0x5e, 0xe4, 0x39,
+    0x0c, 0xce };
+
+static const size_t gcmHeaderLen = 12;
+static const size_t gcmTagLen = 16;
+
+static void hexdump(const char* title, const uint8* s, size_t l)
+{
+    fprintf(stderr, "%s", title);
+    for ( size_t n = 0; n < l; n++ ) {
+        if ( (n % 16) == 0 )
+            fprintf(stderr, "\n%04x", (unsigned int)n);
+        fprintf(stderr, " %02x", s[n]);
+    }
+    fprintf(stderr, "\n");
+}
+
+static int check(const char* name, const uint8* result,
+                 const uint8* expected, size_t len)
+{
+    if ( memcmp(result, expected, len) == 0 ) {
+        printf("%s: passed\n", name);
+        return 0;
+    }
+    printf("%s: FAILED\n", name);
+    hexdump("computed", result, len);
+    hexdump("expected", expected, len);
+    return 1;
+}
+
+// Counter mode through all the paths of SrtpSymCrypto: the key
+// stream alone, in place and out of place. The lengths are not a
+// multiple of the block size and cover several blocks, so that the
+// tail and the multi-block stream are both exercised.
+static int testCtr(const char* name, int algo, const uint8* stream,
+                   size_t len)
+{
+    int failed = 0;
+    SrtpSymCrypto cipher(cmKey, sizeof(cmKey), algo);
+    uint8 iv[16];
+    uint8 in[80];
+    uint8 out[80];
+
+    memset(out, 0, sizeof(out));
+    memcpy(iv, cmIv, sizeof(iv));
+    cipher.get_ctr_cipher_stream(out, len, iv);
+    failed += check(name, out, stream, len);
+
+    memset(out, 0, sizeof(out));
+    memcpy(iv, cmIv, sizeof(iv));
+    cipher.ctr_encrypt(out, len, iv);
+    failed += check(name, out, stream, len);
+
+    for ( size_t i = 0; i < len; i++ )
+        in[i] = (uint8)i;
+    memcpy(iv, cmIv, sizeof(iv));
+    cipher.ctr_encrypt(in, len, out, iv);
+    for ( size_t i = 0; i < len; i++ )
+        out[i] ^= (uint8)i;
+    failed += check(name, out, stream, len);
+    return failed;
+}
+
+static int testTwofishBlock()
+{
+    SrtpSymCrypto cipher(twoZeroKey, sizeof(twoZeroKey), SrtpEncryptionTWOCM);
+    uint8 in[16];
+    uint8 out[16];
+
+    memset(in, 0, sizeof(in));
+    cipher.encrypt(in, out);
+    return check("Twofish block", out, twoZeroBlock, sizeof(out));
+}
+
+static int testGcm()
+{
+    int failed = 0;
+    SrtpSymCrypto cipher(gcmKey, sizeof(gcmKey), SrtpEncryptionAESGCM);
+    size_t payloadLen = sizeof(gcmPacket) - gcmHeaderLen;
+    uint8 packet[sizeof(gcmProtected)];
+
+    memcpy(packet, gcmPacket, sizeof(gcmPacket));
+    if ( !cipher.gcm_encrypt(packet + gcmHeaderLen, payloadLen,
+                             packet, gcmHeaderLen, gcmIv,
+                             packet + sizeof(gcmPacket), gcmTagLen) ) {
+        printf("AES GCM encryption: FAILED\n");
+        return 1;
+    }
+    failed += check("AES GCM encryption", packet, gcmProtected,
+                    sizeof(gcmProtected));
+
+    memcpy(packet, gcmProtected, sizeof(gcmProtected));
+    if ( !cipher.gcm_decrypt(packet + gcmHeaderLen, payloadLen,
+                             packet, gcmHeaderLen, gcmIv,
+                             packet + sizeof(gcmPacket), gcmTagLen) ) {
+        printf("AES GCM decryption: FAILED, tag rejected\n");
+        failed++;
+    } else {
+        failed += check("AES GCM decryption", packet, gcmPacket,
+                        sizeof(gcmPacket));
+    }
+
+    // a packet with a modified header must be rejected
+    memcpy(packet, gcmProtected, sizeof(gcmProtected));
+    packet[1] ^= 0x01;
+    if ( cipher.gcm_decrypt(packet + gcmHeaderLen, payloadLen,
+                            packet, gcmHeaderLen, gcmIv,
+                            packet + sizeof(gcmPacket), gcmTagLen) ) {
+        printf("AES GCM authentication: FAILED\n");
+        failed++;
+    } else {
+        printf("AES GCM authentication: passed\n");
+    }
+    return failed;
+}
+
+int main(int argc, char *argv[])
+{
+    int failed = 0;
+
+    failed += testCtr("AES CM", SrtpEncryptionAESCM, aesCmStream, 77);
+    failed += testCtr("AES CM", SrtpEncryptionAESCM, aesCmStream, 16);
+    failed += testTwofishBlock();
+    failed += testCtr("Twofish CM", SrtpEncryptionTWOCM, twoCmStream, 77);
+    failed += testCtr("Twofish CM", SrtpEncryptionTWOCM, twoCmStream, 23);
+    failed += testGcm();
+
+    if ( failed )
+        printf("%d tests failed\n", failed);
+    exit(failed ? 1 : 0);
+}
+
+/** EMACS **
+ * Local variables:
+ * mode: c++
+ * c-basic-offset: 4
+ * End:
+ */
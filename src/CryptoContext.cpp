@@ -44,14 +44,15 @@ CryptoContext::CryptoContext( uint32 ssrc ):
 ssrcCtx(ssrc),
 using_mki(false),mkiLength(0),mki(NULL),
 roc(0),guessed_roc(0),s_l(0),key_deriv_rate(0),
-replay_window(0),
 master_key(NULL), master_key_length(0),
 master_key_srtp_use_nb(0), master_key_srtcp_use_nb(0),
 master_salt(NULL), master_salt_length(0),
 n_e(0),k_e(NULL),n_a(0),k_a(NULL),n_s(0),k_s(NULL),
 ealg(SrtpEncryptionNull), aalg(SrtpAuthenticationNull),
 ekeyl(0), akeyl(0), skeyl(0),
-seqNumSet(false), cipher(NULL), f8Cipher(NULL)
+seqNumSet(false), cachedKeys(NULL), sessionKeysSet(false),
+ksStream(NULL), ksIndex(NULL), ksPackets(0), ksLength(0), macCtx(NULL),
+cipher(NULL), f8Cipher(NULL)
 {}
 
 #ifdef SRTP_SUPPORT
@@ -71,8 +72,9 @@ CryptoContext::CryptoContext(   uint32 ssrc,
 
 ssrcCtx(ssrc),using_mki(false),mkiLength(0),mki(NULL),
 roc(roc),guessed_roc(0),s_l(0),key_deriv_rate(key_deriv_rate),
-replay_window(0),
 master_key_srtp_use_nb(0), master_key_srtcp_use_nb(0), seqNumSet(false),
+cachedKeys(NULL), sessionKeysSet(false),
+ksStream(NULL), ksIndex(NULL), ksPackets(0), ksLength(0), macCtx(NULL),
 cipher(NULL), f8Cipher(NULL)
 {
     this->ealg = ealg;
@@ -118,13 +120,22 @@ cipher(NULL), f8Cipher(NULL)
         k_s = new uint8[n_s];
         cipher = new SrtpSymCrypto(SrtpEncryptionAESCM);
         break;
+
+        case SrtpEncryptionAESGCM:
+        n_e = ekeyl;
+        k_e = new uint8[n_e];
+        n_s = skeyl;
+        k_s = new uint8[n_s];
+        cipher = new SrtpSymCrypto(SrtpEncryptionAESGCM);
+        break;
     }
 
     switch( aalg ) {
         case SrtpAuthenticationNull:
         n_a = 0;
         k_a = NULL;
-        this->tagLength = 0;
+        // AES GCM computes its own tag
+        this->tagLength = (ealg == SrtpEncryptionAESGCM) ? tagLength : 0;
         break;
 
         case SrtpAuthenticationSha1Hmac:
@@ -164,6 +175,17 @@ CryptoContext::~CryptoContext(){
         n_s = 0;
         delete [] k_s;
     }
+    if (cachedKeys != NULL) {
+        memset(cachedKeys, 0, n_e + n_a + n_s);
+        delete [] cachedKeys;
+        cachedKeys = NULL;
+    }
+    if (ksPackets > 0) {
+        memset(ksStream, 0, ksPackets * ksLength);
+        delete [] ksStream;
+        delete [] ksIndex;
+        ksPackets = 0;
+    }
     if (n_a > 0) {
         memset(k_a, 0, n_a);
         n_a = 0;
@@ -194,6 +216,32 @@ CryptoContext::~CryptoContext(){
     aalg = SrtpAuthenticationNull;
 }
 
+#ifdef SRTP_SUPPORT
+/* used by the counter mode methods */
+static void computeCmIv(unsigned char* iv, uint64 index, uint32 ssrc,
+                        const unsigned char* k_s)
+{
+    /* Compute the CM IV (refer to chapter 4.1.1 in RFC 3711):
+     *
+     * k_s   XX XX XX XX XX XX XX XX XX XX XX XX XX XX
+     * SSRC              XX XX XX XX
+     * index                         XX XX XX XX XX XX
+     * ------------------------------------------------------XOR
+     * IV    XX XX XX XX XX XX XX XX XX XX XX XX XX XX 00 00
+     */
+    memcpy( iv, k_s, 4 );
+
+    int i;
+    for(i = 4; i < 8; i++ ){
+        iv[i] = ( 0xFF & ( ssrc >> ((7-i)*8) ) ) ^ k_s[i];
+    }
+    for(i = 8; i < 14; i++ ){
+        iv[i] = ( 0xFF & (unsigned char)( index >> ((13-i)*8) ) ) ^ k_s[i];
+    }
+    iv[14] = iv[15] = 0;
+}
+#endif
+
 void CryptoContext::srtpEncrypt(RTPPacket* rtp, uint64 index, uint32 ssrc)
 {
     if (ealg == SrtpEncryptionNull) {
@@ -201,31 +249,27 @@ void CryptoContext::srtpEncrypt(RTPPacket* rtp, uint64 index, uint32 ssrc)
     }
 #ifdef SRTP_SUPPORT
     if (ealg == SrtpEncryptionAESCM || ealg == SrtpEncryptionTWOCM) {
-
-        /* Compute the CM IV (refer to chapter 4.1.1 in RFC 3711):
-         *
-         * k_s   XX XX XX XX XX XX XX XX XX XX XX XX XX XX
-         * SSRC              XX XX XX XX
-         * index                         XX XX XX XX XX XX
-         * ------------------------------------------------------XOR
-         * IV    XX XX XX XX XX XX XX XX XX XX XX XX XX XX 00 00
-         */
+        int32 pad = rtp->isPadded() ? rtp->getPaddingSize() : 0;
+        uint8* payload = const_cast<uint8*>(rtp->getPayload());
+        uint32 length = rtp->getPayloadSize()+pad;
 
         unsigned char iv[16];
-        memcpy( iv, k_s, 4 );
 
-        int i;
-        for(i = 4; i < 8; i++ ){
-            iv[i] = ( 0xFF & ( ssrc >> ((7-i)*8) ) ) ^ k_s[i];
-        }
-        for(i = 8; i < 14; i++ ){
-            iv[i] = ( 0xFF & (unsigned char)( index >> ((13-i)*8) ) ) ^ k_s[i];
+        // the lock also keeps precomputeKeystream and deriveSrtpKeys
+        // off the cipher
+        MutexLock lock(keystreamMutex);
+        uint32 slot = ksPackets > 0 ? (uint32)(index % ksPackets) : 0;
+        if (ksPackets > 0 && ksIndex[slot] == index && ssrc == ssrcCtx &&
+            length <= ksLength) {
+            // a key stream slot is used only once
+            uint8* stream = ksStream + slot * ksLength;
+            SrtpSymCrypto::xorStream(payload, payload, stream, length);
+            memset(stream, 0, length);
+            ksIndex[slot] = ~(uint64)0;
+            return;
         }
-        iv[14] = iv[15] = 0;
-
-        int32 pad = rtp->isPadded() ? rtp->getPaddingSize() : 0;
-        cipher->ctr_encrypt(const_cast<uint8*>(rtp->getPayload()),
-                            rtp->getPayloadSize()+pad, iv);
+        computeCmIv(iv, index, ssrc, k_s);
+        cipher->ctr_encrypt(payload, length, iv);
     }
 
     if (ealg == SrtpEncryptionAESF8 || ealg == SrtpEncryptionTWOF8) {
@@ -244,8 +288,9 @@ void CryptoContext::srtpEncrypt(RTPPacket* rtp, uint64 index, uint32 ssrc)
         memcpy(iv, rtp->getRawPacket(), 12);
         iv[0] = 0;
 
-        // set ROC in network order into IV
-        ui32p[3] = htonl(roc);
+        // set ROC in network order into IV, taken from the index as
+        // the context may already have been updated for later packets
+        ui32p[3] = htonl((uint32)(index >> 16));
 
         int32 pad = rtp->isPadded() ? rtp->getPaddingSize() : 0;
         cipher->f8_encrypt(rtp->getPayload(), rtp->getPayloadSize()+pad, iv, f8Cipher);
@@ -253,6 +298,67 @@ void CryptoContext::srtpEncrypt(RTPPacket* rtp, uint64 index, uint32 ssrc)
 #endif
 }
 
+#ifdef SRTP_SUPPORT
+/* used by the AEAD methods */
+static void computeGcmIv(unsigned char* iv, uint64 index, uint32 ssrc,
+                         const unsigned char* k_s)
+{
+    /* Compute the GCM IV (refer to chapter 8.1 in RFC 7714):
+     *
+     * k_s   XX XX XX XX XX XX XX XX XX XX XX XX
+     * SSRC        XX XX XX XX
+     * index                   XX XX XX XX XX XX
+     * ------------------------------------------XOR
+     * IV    XX XX XX XX XX XX XX XX XX XX XX XX
+     */
+    iv[0] = k_s[0];
+    iv[1] = k_s[1];
+
+    int i;
+    for(i = 2; i < 6; i++ ){
+        iv[i] = ( 0xFF & ( ssrc >> ((5-i)*8) ) ) ^ k_s[i];
+    }
+    for(i = 6; i < 12; i++ ){
+        iv[i] = ( 0xFF & (unsigned char)( index >> ((11-i)*8) ) ) ^ k_s[i];
+    }
+}
+#endif
+
+void CryptoContext::srtpAeadEncrypt(RTPPacket* rtp, uint64 index, uint32 ssrc, uint8* tag)
+{
+#ifdef SRTP_SUPPORT
+    unsigned char iv[12];
+    computeGcmIv(iv, index, ssrc, k_s);
+
+    // the RTP header, including CSRC list and extension, is the AAD
+    const uint8* aad = rtp->getRawPacket();
+    uint32 aadLength = rtp->getPayload() - aad;
+
+    int32 pad = rtp->isPadded() ? rtp->getPaddingSize() : 0;
+    cipher->gcm_encrypt(const_cast<uint8*>(rtp->getPayload()),
+                        rtp->getPayloadSize()+pad, aad, aadLength,
+                        iv, tag, tagLength);
+#endif
+}
+
+bool CryptoContext::srtpAeadDecrypt(RTPPacket* rtp, uint64 index, uint32 ssrc, const uint8* tag)
+{
+#ifdef SRTP_SUPPORT
+    unsigned char iv[12];
+    computeGcmIv(iv, index, ssrc, k_s);
+
+    const uint8* aad = rtp->getRawPacket();
+    uint32 aadLength = rtp->getPayload() - aad;
+
+    int32 pad = rtp->isPadded() ? rtp->getPaddingSize() : 0;
+    return cipher->gcm_decrypt(const_cast<uint8*>(rtp->getPayload()),
+                               rtp->getPayloadSize()+pad, aad, aadLength,
+                               iv, tag, tagLength);
+#else
+    return false;
+#endif
+}
+
 /* Warning: tag must have been initialized */
 void CryptoContext::srtpAuthenticate(RTPPacket* rtp, uint32 roc, uint8* tag )
 {
@@ -262,7 +368,7 @@ void CryptoContext::srtpAuthenticate(RTPPacket* rtp, uint32 roc, uint8* tag )
 #ifdef SRTP_SUPPORT
     int32_t macL;
 
-    unsigned char temp[20];
+    unsigned char temp[SHA1_DIGEST_LENGTH];
     const unsigned char* chunks[3];
     unsigned int chunkLength[3];
     uint32_t beRoc = htonl(roc);
@@ -284,17 +390,44 @@ void CryptoContext::srtpAuthenticate(RTPPacket* rtp, uint32 roc, uint8* tag )
         memcpy(tag, temp, getTagLength());
         break;
     case SrtpAuthenticationSkeinHmac:
+        /* the MAC context produces tagLength bytes */
         macSkeinCtx(macCtx,
                     chunks,           // data chunks to hash
                     chunkLength,      // length of the data to hash
-                    temp);
-        /* truncate the result */
-        memcpy(tag, temp, getTagLength());
+                    tag);
         break;
     }
 #endif
 }
 
+#ifdef SRTP_SUPPORT
+/* compare without an early exit, the time taken does not depend on the data */
+static bool equalTags(const uint8* a, const uint8* b, int32 length)
+{
+    uint8 diff = 0;
+    for (int32 i = 0; i < length; i++)
+        diff |= a[i] ^ b[i];
+    return diff == 0;
+}
+#endif
+
+bool CryptoContext::srtpCheckTag(RTPPacket* rtp, uint32 roc, const uint8* tag)
+{
+    if (aalg == SrtpAuthenticationNull) {
+        return true;
+    }
+#ifdef SRTP_SUPPORT
+    uint8 mac[SRTP_MAX_TAG_LENGTH];
+
+    if (tagLength > SRTP_MAX_TAG_LENGTH)
+        return false;
+    srtpAuthenticate(rtp, roc, mac);
+    return equalTags(mac, tag, tagLength);
+#else
+    return true;
+#endif
+}
+
 #ifdef SRTP_SUPPORT
 /* used by the key derivation method */
 static void computeIv(unsigned char* iv, uint64 label, uint64 index,
@@ -333,25 +466,59 @@ static void computeIv(unsigned char* iv, uint64 label, uint64 index,
 }
 #endif
 
-/* Derives the srtp session keys from the master key */
-void CryptoContext::deriveSrtpKeys(uint64 index)
-{
 #ifdef SRTP_SUPPORT
+void CryptoContext::computeSessionKeys(uint64 index, uint8* ke, uint8* ka, uint8* ks)
+{
     uint8 iv[16];
+    uint8 salt[14];
 
     // prepare AES cipher to compute derived keys.
     cipher->setNewKey(master_key, master_key_length);
-    memset(master_key, 0, master_key_length);
+
+    // the 12 byte master salt of AES GCM is padded with zeros (RFC 7714)
+    memset(salt, 0, sizeof(salt));
+    memcpy(salt, master_salt, master_salt_length < sizeof(salt) ? master_salt_length : sizeof(salt));
 
     // compute the session encryption key
     uint64 label = 0;
-    computeIv(iv, label, index, key_deriv_rate, master_salt);
-    cipher->get_ctr_cipher_stream(k_e, n_e, iv);
+    computeIv(iv, label, index, key_deriv_rate, salt);
+    cipher->get_ctr_cipher_stream(ke, n_e, iv);
 
     // compute the session authentication key
     label = 0x01;
-    computeIv(iv, label, index, key_deriv_rate, master_salt);
-    cipher->get_ctr_cipher_stream(k_a, n_a, iv);
+    computeIv(iv, label, index, key_deriv_rate, salt);
+    cipher->get_ctr_cipher_stream(ka, n_a, iv);
+
+    // compute the session salt
+    label = 0x02;
+    computeIv(iv, label, index, key_deriv_rate, salt);
+    cipher->get_ctr_cipher_stream(ks, n_s, iv);
+    memset(salt, 0, sizeof(salt));
+}
+#endif
+
+void CryptoContext::setSessionKeys(const uint8* keys)
+{
+    memcpy(k_e, keys, n_e);
+    memcpy(k_a, keys + n_e, n_a);
+    memcpy(k_s, keys + n_e + n_a, n_s);
+    sessionKeysSet = true;
+}
+
+/* Derives the srtp session keys from the master key */
+void CryptoContext::deriveSrtpKeys(uint64 index)
+{
+#ifdef SRTP_SUPPORT
+    // the cipher is re-keyed and k_s overwritten: keep
+    // precomputeKeystream and srtpEncrypt off until done.
+    MutexLock lock(keystreamMutex);
+
+    // keys set by newCryptoContextForSSRC are those of index 0
+    if (!sessionKeysSet || index != 0)
+        computeSessionKeys(index, k_e, k_a, k_s);
+    sessionKeysSet = false;
+    memset(master_key, 0, master_key_length);
+    memset(master_salt, 0, master_salt_length);
 
     // Initialize MAC context with the derived key
     switch (aalg) {
@@ -365,13 +532,10 @@ void CryptoContext::deriveSrtpKeys(uint64 index)
     }
     memset(k_a, 0, n_a);
 
-    // compute the session salt
-    label = 0x02;
-    computeIv(iv, label, index, key_deriv_rate, master_salt);
-    cipher->get_ctr_cipher_stream(k_s, n_s, iv);
-    memset(master_salt, 0, master_salt_length);
-
-    // as last step prepare ciphers with derived key.
+    // as last step prepare ciphers with derived key, the key stream
+    // precomputed with the previous key is useless now.
+    for (uint32 i = 0; i < ksPackets; i++)
+        ksIndex[i] = ~(uint64)0;
     cipher->setNewKey(k_e, n_e);
     if (f8Cipher != NULL)
         cipher->f8_deriveForIV(f8Cipher, k_e, n_e, k_s, n_s);
@@ -412,71 +576,85 @@ uint64_t CryptoContext::guessIndex(uint16 new_seq_nb )
 }
 
 bool CryptoContext::checkReplay( uint16 new_seq_nb )
+{
+    return checkReplayIndex(guessIndex(new_seq_nb));
+}
+
+bool CryptoContext::checkReplayIndex(uint64 guessed_index)
 {
 #ifdef SRTP_SUPPORT
     if ( aalg == SrtpAuthenticationNull && ealg == SrtpEncryptionNull ) {
         /* No security policy, don't use the replay protection */
         return true;
     }
-
-    /*
-     * Initialize the sequences number on first call that uses the
-     * sequence number. Either guessIndex() or checkReplay().
-     */
-    if (!seqNumSet) {
-        seqNumSet = true;
-        s_l = new_seq_nb;
-    }
-    uint64 guessed_index = guessIndex( new_seq_nb );
-    uint64 local_index = (((uint64_t)roc) << 16) | s_l;
-
-    int64 delta = guessed_index - local_index;
-    if (delta > 0) {
-        /* Packet not yet received*/
-        return true;
-    }
-    else {
-        if( -delta > REPLAY_WINDOW_SIZE ) {
-            /* Packet too old */
-            return false;
-        }
-        else {
-            if((replay_window >> (-delta)) & 0x1) {
-                /* Packet already received ! */
-                return false;
-        }
-        else {
-            /* Packet not yet received */
-            return true;
-        }
-    }
-}
+    return replayWindow.check(guessed_index);
 #else
     return true;
 #endif
 }
 
 void CryptoContext::update(uint16 new_seq_nb)
+{
+    updateIndex(guessIndex(new_seq_nb));
+}
+
+void CryptoContext::updateIndex(uint64 guessed_index)
 {
 #ifdef SRTP_SUPPORT
-    int64 delta = guessIndex(new_seq_nb) - (((uint64)roc) << 16 | s_l );
+    /* update the replay bitmap */
+    replayWindow.update(guessed_index);
 
-    /* update the replay bitmask */
-    if( delta > 0 ){
-        replay_window = replay_window << delta;
-        replay_window |= 1;
-    }
-    else {
-        replay_window |= ( 1 << delta );
+    /* update the locally stored ROC and highest sequence number */
+    if( guessed_index > (((uint64)roc) << 16 | s_l) ) {
+        roc = (uint32)(guessed_index >> 16);
+        s_l = (uint16)(guessed_index & 0xffff);
     }
+#endif
+}
 
-    /* update the locally stored ROC and highest sequence number */
-    if( new_seq_nb > s_l ) {
-        s_l = new_seq_nb;
+void CryptoContext::setKeystreamPrecompute(uint32 packets, uint32 length)
+{
+#ifdef SRTP_SUPPORT
+    if (ealg != SrtpEncryptionAESCM && ealg != SrtpEncryptionTWOCM)
+        packets = 0;
+    if (length == 0)
+        packets = 0;
+
+    MutexLock lock(keystreamMutex);
+    if (ksPackets > 0) {
+        memset(ksStream, 0, ksPackets * ksLength);
+        delete [] ksStream;
+        delete [] ksIndex;
+        ksStream = NULL;
+        ksIndex = NULL;
     }
-    if( guessed_roc > roc ) {
-        roc = guessed_roc;
-        s_l = new_seq_nb;
+    ksPackets = packets;
+    ksLength = packets > 0 ? length : 0;
+    if (ksPackets > 0) {
+        ksStream = new uint8[ksPackets * ksLength];
+        ksIndex = new uint64[ksPackets];
+        for (uint32 i = 0; i < ksPackets; i++)
+            ksIndex[i] = ~(uint64)0;
+    }
+#endif
+}
+
+void CryptoContext::precomputeKeystream(uint64 index)
+{
+#ifdef SRTP_SUPPORT
+    for (uint32 i = 0; ; i++) {
+        // lock per packet so that a packet to send never waits long
+        MutexLock lock(keystreamMutex);
+        if (i >= ksPackets)
+            return;
+        uint64 next = index + i;
+        uint32 slot = (uint32)(next % ksPackets);
+        if (ksIndex[slot] == next)
+            continue;
+        unsigned char iv[16];
+        computeCmIv(iv, next, ssrcCtx, k_s);
+        cipher->get_ctr_cipher_stream(ksStream + slot * ksLength, ksLength, iv);
+        ksIndex[slot] = next;
     }
 #endif
 }
@@ -499,6 +677,20 @@ CryptoContext* CryptoContext::newCryptoContextForSSRC(uint32 ssrc, int roc, int6
             this->skeyl,                             // session salt len
             this->tagLength);                        // authentication tag len
 
+    pcc->setReplayWindowSize(getReplayWindowSize());
+    pcc->setKeystreamPrecompute(ksPackets, ksLength);
+
+    // Without key derivation rate the session keys depend neither on
+    // the SSRC nor on the index: derive them once and copy them to
+    // every new context.
+    if (key_deriv_rate == 0 && keyDerivRate == 0) {
+        if (cachedKeys == NULL) {
+            cachedKeys = new uint8[n_e + n_a + n_s];
+            computeSessionKeys(0, cachedKeys, cachedKeys + n_e,
+                               cachedKeys + n_e + n_a);
+        }
+        pcc->setSessionKeys(cachedKeys);
+    }
     return pcc;
 #else
     return NULL;
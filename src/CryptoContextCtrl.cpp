@@ -43,8 +43,7 @@ NAMESPACE_COMMONCPP
 
 CryptoContextCtrl::CryptoContextCtrl(uint32 ssrc ):
 ssrcCtx(ssrc),
-using_mki(false),mkiLength(0),mki(NULL), s_l(0),
-replay_window(0),
+using_mki(false),mkiLength(0),mki(NULL),
 master_key(NULL), master_key_length(0),
 master_salt(NULL), master_salt_length(0),
 n_e(0),k_e(NULL),n_a(0),k_a(NULL),n_s(0),k_s(NULL),
@@ -67,7 +66,7 @@ CryptoContextCtrl::CryptoContextCtrl(uint32 ssrc,
                                 int32 tagLength):
 
 ssrcCtx(ssrc),using_mki(false),mkiLength(0),mki(NULL),
-replay_window(0), cipher(NULL), f8Cipher(NULL)
+cipher(NULL), f8Cipher(NULL)
 {
     this->ealg = ealg;
     this->aalg = aalg;
@@ -114,13 +113,22 @@ replay_window(0), cipher(NULL), f8Cipher(NULL)
             k_s = new uint8[n_s];
             cipher = new SrtpSymCrypto(SrtpEncryptionAESCM);
             break;
+
+        case SrtpEncryptionAESGCM:
+            n_e = ekeyl;
+            k_e = new uint8[n_e];
+            n_s = skeyl;
+            k_s = new uint8[n_s];
+            cipher = new SrtpSymCrypto(SrtpEncryptionAESGCM);
+            break;
     }
 
     switch( aalg ) {
         case SrtpAuthenticationNull:
             n_a = 0;
             k_a = NULL;
-            this->tagLength = 0;
+            // AES GCM computes its own tag
+            this->tagLength = (ealg == SrtpEncryptionAESGCM) ? tagLength : 0;
             break;
 
         case SrtpAuthenticationSha1Hmac:
@@ -261,6 +269,84 @@ void CryptoContextCtrl::srtcpEncrypt( uint8* rtp, size_t len, uint64 index, uint
 #endif
 }
 
+#ifdef SRTP_SUPPORT
+/* used by the AEAD methods */
+static void computeGcmIv(unsigned char* iv, uint32 index, uint32 ssrc,
+                         const unsigned char* k_s)
+{
+    /* Compute the GCM IV (refer to chapter 9.1 in RFC 7714), the
+     * index is the 31 bit SRTCP index without the E flag:
+     *
+     * k_s   XX XX XX XX XX XX XX XX XX XX XX XX
+     * SSRC        XX XX XX XX
+     * index                         XX XX XX XX
+     * ------------------------------------------XOR
+     * IV    XX XX XX XX XX XX XX XX XX XX XX XX
+     *        0  1  2  3  4  5  6  7  8  9 10 11
+     */
+    index &= ~0x80000000;
+
+    iv[0] = k_s[0];
+    iv[1] = k_s[1];
+
+    iv[2] = ((ssrc >> 24) & 0xff) ^ k_s[2];
+    iv[3] = ((ssrc >> 16) & 0xff) ^ k_s[3];
+    iv[4] = ((ssrc >> 8) & 0xff) ^ k_s[4];
+    iv[5] = (ssrc & 0xff) ^ k_s[5];
+
+    iv[6] = k_s[6];
+    iv[7] = k_s[7];
+
+    iv[8] = ((index >> 24) & 0xff) ^ k_s[8];
+    iv[9] = ((index >> 16) & 0xff) ^ k_s[9];
+    iv[10] = ((index >> 8) & 0xff) ^ k_s[10];
+    iv[11] = (index & 0xff) ^ k_s[11];
+}
+
+/* AAD of an encrypted packet: the first 8 octets and the E flag and index */
+static void computeGcmAad(unsigned char* aad, const uint8* rtp, uint32 index)
+{
+    memcpy(aad, rtp, 8);
+    aad[8] = index >> 24;
+    aad[9] = index >> 16;
+    aad[10] = index >> 8;
+    aad[11] = index;
+}
+#endif
+
+void CryptoContextCtrl::srtcpAeadEncrypt(uint8* rtp, size_t len, uint32 index, uint32 ssrc, uint8* tag)
+{
+#ifdef SRTP_SUPPORT
+    unsigned char iv[12];
+    unsigned char aad[12];
+
+    computeGcmIv(iv, index, ssrc, k_s);
+    computeGcmAad(aad, rtp, index);
+
+    cipher->gcm_encrypt(rtp + 8, len - 8, aad, sizeof(aad), iv, tag, tagLength);
+#endif
+}
+
+bool CryptoContextCtrl::srtcpAeadDecrypt(uint8* rtp, size_t len, uint32 index, uint32 ssrc, const uint8* tag)
+{
+#ifdef SRTP_SUPPORT
+    unsigned char iv[12];
+    unsigned char aad[12];
+
+    // an unencrypted packet would be authenticated as a whole, which
+    // this implementation never sends
+    if (!(index & 0x80000000))
+        return false;
+
+    computeGcmIv(iv, index, ssrc, k_s);
+    computeGcmAad(aad, rtp, index);
+
+    return cipher->gcm_decrypt(rtp + 8, len - 8, aad, sizeof(aad), iv, tag, tagLength);
+#else
+    return false;
+#endif
+}
+
 /* Warning: tag must have been initialized */
 void CryptoContextCtrl::srtcpAuthenticate(uint8* rtp, size_t len, uint32 index, uint8* tag )
 {
@@ -270,7 +356,7 @@ void CryptoContextCtrl::srtcpAuthenticate(uint8* rtp, size_t len, uint32 index,
 #ifdef SRTP_SUPPORT
     int32_t macL;
 
-    unsigned char temp[20];
+    unsigned char temp[SHA1_DIGEST_LENGTH];
     const unsigned char* chunks[3];
     unsigned int chunkLength[3];
     uint32_t beIndex = htonl(index);
@@ -292,20 +378,47 @@ void CryptoContextCtrl::srtcpAuthenticate(uint8* rtp, size_t len, uint32 index,
         memcpy(tag, temp, getTagLength());
         break;
     case SrtpAuthenticationSkeinHmac:
+        /* the MAC context produces tagLength bytes */
         macSkeinCtx(macCtx,
                     chunks,           // data chunks to hash
                     chunkLength,      // length of the data to hash
-                    temp);
-        /* truncate the result */
-        memcpy(tag, temp, getTagLength());
+                    tag);
         break;
     }
 #endif
 }
 
+#ifdef SRTP_SUPPORT
+/* compare without an early exit, the time taken does not depend on the data */
+static bool equalTags(const uint8* a, const uint8* b, int32 length)
+{
+    uint8 diff = 0;
+    for (int32 i = 0; i < length; i++)
+        diff |= a[i] ^ b[i];
+    return diff == 0;
+}
+#endif
+
+bool CryptoContextCtrl::srtcpCheckTag(uint8* rtp, size_t len, uint32 index, const uint8* tag)
+{
+    if (aalg == SrtpAuthenticationNull) {
+        return true;
+    }
+#ifdef SRTP_SUPPORT
+    uint8 mac[SRTP_MAX_TAG_LENGTH];
+
+    if (tagLength > SRTP_MAX_TAG_LENGTH)
+        return false;
+    srtcpAuthenticate(rtp, len, index, mac);
+    return equalTags(mac, tag, tagLength);
+#else
+    return true;
+#endif
+}
+
 #ifdef SRTP_SUPPORT
 /* used by the key derivation method */
-static void computeIv(unsigned char* iv, uint8 label, uint8* master_salt)
+static void computeIv(unsigned char* iv, uint8 label, uint8* master_salt, uint32 master_salt_length)
 {
     //printf( "Key_ID: %llx\n", key_id );
 
@@ -316,7 +429,9 @@ static void computeIv(unsigned char* iv, uint8 label, uint8* master_salt)
        IV:          XX XX XX XX XX XX XX XX XX XX XX XX XX XX 00 00
     */
 
-    memcpy(iv, master_salt, 14);
+    // the 12 byte master salt of AES GCM is padded with zeros (RFC 7714)
+    memset(iv, 0, 14);
+    memcpy(iv, master_salt, master_salt_length < 14 ? master_salt_length : 14);
     iv[7] ^= label;
 
     iv[14] = iv[15] = 0;
@@ -335,12 +450,12 @@ void CryptoContextCtrl::deriveSrtcpKeys()
 
     // compute the session encryption key
     uint8 label = 3;
-    computeIv(iv, label, master_salt);
+    computeIv(iv, label, master_salt, master_salt_length);
     cipher->get_ctr_cipher_stream(k_e, n_e, iv);
 
     // compute the session authentication key
     label = 4;
-    computeIv(iv, label, master_salt);
+    computeIv(iv, label, master_salt, master_salt_length);
     cipher->get_ctr_cipher_stream(k_a, n_a, iv);
 
     // Initialize MAC context with the derived key
@@ -357,7 +472,7 @@ void CryptoContextCtrl::deriveSrtcpKeys()
 
     // compute the session salt
     label = 5;
-    computeIv(iv, label, master_salt);
+    computeIv(iv, label, master_salt, master_salt_length);
     cipher->get_ctr_cipher_stream(k_s, n_s, iv);
     memset(master_salt, 0, master_salt_length);
 
@@ -376,28 +491,7 @@ bool CryptoContextCtrl::checkReplay( uint32 index )
         /* No security policy, don't use the replay protection */
         return true;
     }
-
-    int64 delta = s_l - index;
-    if (delta > 0) {
-        /* Packet not yet received*/
-        return true;
-    }
-    else {
-        if( -delta > REPLAY_WINDOW_SIZE ) {
-            /* Packet too old */
-            return false;
-        }
-        else {
-            if((replay_window >> (-delta)) & 0x1) {
-                /* Packet already received ! */
-                return false;
-        }
-        else {
-            /* Packet not yet received */
-            return true;
-        }
-    }
-}
+    return replayWindow.check(index);
 #else
     return true;
 #endif
@@ -406,18 +500,7 @@ bool CryptoContextCtrl::checkReplay( uint32 index )
 void CryptoContextCtrl::update(uint32 index)
 {
 #ifdef SRTP_SUPPORT
-    int64 delta = index - s_l;
-
-    /* update the replay bitmask */
-    if( delta > 0 ){
-        replay_window = replay_window << delta;
-        replay_window |= 1;
-    }
-    else {
-        replay_window |= ( 1 << delta );
-    }
-    s_l = index;
-
+    replayWindow.update(index);
 #endif
 }
 
@@ -437,6 +520,7 @@ CryptoContextCtrl* CryptoContextCtrl::newCryptoContextForSSRC(uint32 ssrc)
             this->skeyl,                             // session salt len
             this->tagLength);                        // authentication tag len
 
+    pcc->setReplayWindowSize(getReplayWindowSize());
     return pcc;
 #else
     return NULL;
@@ -24,9 +24,10 @@
 #include <commoncpp/config.h>
 
 #include <ccrtp/rtppkt.h>
+#include <ccrtp/SrtpReplayWindow.h>
 
 
-#define REPLAY_WINDOW_SIZE 64
+#define SRTP_MAX_TAG_LENGTH 64
 
 const int SrtpAuthenticationNull     =  0;
 const int SrtpAuthenticationSha1Hmac =  1;
@@ -37,6 +38,7 @@ const int SrtpEncryptionAESCM = 1;
 const int SrtpEncryptionAESF8 = 2;
 const int SrtpEncryptionTWOCM = 3;
 const int SrtpEncryptionTWOF8 = 4;
+const int SrtpEncryptionAESGCM = 5;
 
 #ifndef CRYPTOCONTEXTCTRL_H
 
@@ -114,9 +116,11 @@ NAMESPACE_COMMONCPP
      *
      * @param ealg
      *    The encryption algorithm to use. Possible values are <code>
-     *    SrtpEncryptionNull, SrtpEncryptionAESCM, SrtpEncryptionAESF8
-     *    </code>. See chapter 4.1.1 for AESCM (Counter mode) and 4.1.2
-     *    for AES F8 mode.
+     *    SrtpEncryptionNull, SrtpEncryptionAESCM, SrtpEncryptionAESF8,
+     *    SrtpEncryptionAESGCM</code>. See chapter 4.1.1 for AESCM
+     *    (Counter mode) and 4.1.2 for AES F8 mode. AESGCM is the AEAD
+     *    mode of RFC 7714, it authenticates the packets itself and
+     *    requires <code>SrtpAuthenticationNull</code> as aalg.
      *
      * @param aalg
      *    The authentication algorithm to use. Possible values are <code>
@@ -165,7 +169,9 @@ NAMESPACE_COMMONCPP
      *
      * @param tagLength
      *    The length is bytes of the authentication tag that SRTP appends
-     *    to the RTP packet. Refer to chapter 4.2. in the RFC 3711.
+     *    to the RTP packet. Refer to chapter 4.2. in the RFC 3711. The
+     *    AES GCM tag is 16 bytes long (RFC 7714), the 8 and 12 byte
+     *    lengths of the GCM specification are supported as well.
      */
         CryptoContext( uint32 ssrc, int32 roc,
                int64  keyDerivRate,
@@ -247,6 +253,82 @@ NAMESPACE_COMMONCPP
      */
         void srtpAuthenticate(RTPPacket* rtp, uint32 roc, uint8* tag );
 
+    /**
+     * Check the authentication tag of a received packet.
+     *
+     * Computes the tag into a buffer on the stack and compares it to the
+     * received tag in constant time.
+     *
+     * @param rtp
+     *    The RTP packet that contains the data to authenticate.
+     *
+     * @param roc
+     *    The 32 bit SRTP roll-over-counter.
+     *
+     * @param tag
+     *    Points to the received authentication tag.
+     *
+     * @return <code>true</code> if the tag is valid.
+     */
+        bool srtpCheckTag(RTPPacket* rtp, uint32 roc, const uint8* tag);
+
+    /**
+     * Perform SRTP AEAD encryption.
+     *
+     * With AES GCM (RFC 7714) this method encrypts the payload in place
+     * and computes the authentication tag over the RTP header and the
+     * encrypted payload in one pass, replacing <code>srtpEncrypt</code>
+     * and <code>srtpAuthenticate</code>.
+     *
+     * @param rtp
+     *    The RTP packet that contains the data to encrypt.
+     *
+     * @param index
+     *    The 48 bit SRTP packet index.
+     *
+     * @param ssrc
+     *    The RTP SSRC data in <em>host</em> order.
+     *
+     * @param tag
+     *    Points to a buffer that holds the computed tag. This buffer must
+     *    be able to hold <code>tagLength</code> bytes.
+     */
+        void srtpAeadEncrypt(RTPPacket* rtp, uint64 index, uint32 ssrc, uint8* tag);
+
+    /**
+     * Perform SRTP AEAD decryption.
+     *
+     * Checks the authentication tag of a packet protected with AES GCM
+     * and decrypts its payload in place, in one pass.
+     *
+     * @param rtp
+     *    The RTP packet that contains the data to decrypt.
+     *
+     * @param index
+     *    The 48 bit SRTP packet index. See the <code>guessIndex</code>
+     *    method.
+     *
+     * @param ssrc
+     *    The RTP SSRC data in <em>host</em> order.
+     *
+     * @param tag
+     *    Points to the received authentication tag.
+     *
+     * @return <code>true</code> if the tag is valid. Otherwise the
+     *    content of the payload is undefined.
+     */
+        bool srtpAeadDecrypt(RTPPacket* rtp, uint64 index, uint32 ssrc, const uint8* tag);
+
+    /**
+     * Check whether this context uses an AEAD algorithm, which encrypts
+     * and authenticates in one pass (see <code>srtpAeadEncrypt</code>).
+     *
+     * @return <code>true</code> for AES GCM.
+     */
+        inline bool
+        isAead() const
+        {return ealg == SrtpEncryptionAESGCM;}
+
     /**
      * Perform key derivation according to SRTP specification
      *
@@ -291,6 +373,20 @@ NAMESPACE_COMMONCPP
      */
         bool checkReplay(uint16 newSeqNumber);
 
+    /**
+     * Check for packet replay with an index already guessed.
+     *
+     * Same as <code>checkReplay</code> without guessing the index
+     * again.
+     *
+     * @param guessedIndex
+     *    The 48 bit SRTP packet index returned by <code>guessIndex</code>.
+     *
+     * @return <code>true</code> if no replay, <code>false</code> if packet
+     *    is too old ar was already received.
+     */
+        bool checkReplayIndex(uint64 guessedIndex);
+
     /**
      * Update the SRTP packet index.
      *
@@ -302,6 +398,93 @@ NAMESPACE_COMMONCPP
      */
         void update( uint16 newSeqNumber );
 
+    /**
+     * Update the SRTP packet index with an index already guessed.
+     *
+     * @param guessedIndex
+     *    The 48 bit SRTP packet index returned by <code>guessIndex</code>.
+     */
+        void updateIndex(uint64 guessedIndex);
+
+    /**
+     * Set the size of the replay window.
+     *
+     * Packets older than the window are rejected as too old. A larger
+     * window accepts packets delayed by multipath delivery or FEC
+     * recovery on high rate streams. The size is rounded up to a
+     * multiple of 64 and kept between REPLAY_WINDOW_MIN_SIZE and
+     * REPLAY_WINDOW_MAX_SIZE. Contexts created with
+     * <code>newCryptoContextForSSRC</code> inherit the size.
+     *
+     * @param packets
+     *    The size of the window in packets, REPLAY_WINDOW_SIZE by default.
+     */
+        inline void
+        setReplayWindowSize(uint32 packets)
+        {replayWindow.setSize(packets);}
+
+    /**
+     * Get the size of the replay window.
+     *
+     * @return the size of the window in packets.
+     */
+        inline uint32
+        getReplayWindowSize() const
+        {return replayWindow.getSize();}
+
+    /**
+     * Get the replay protection statistics of this context.
+     *
+     * @return the highest index received, the window size and the
+     *    number of packets accepted, late and rejected.
+     */
+        inline const SrtpReplayStats&
+        getReplayStats() const
+        {return replayWindow.getStats();}
+
+    /**
+     * Enable the precomputation of the key stream for the next packets.
+     *
+     * With counter mode encryption the key stream of a packet depends
+     * only on the SSRC and the packet index, thus it can be computed
+     * before the packet is sent. <code>precomputeKeystream</code> then
+     * fills the slots ahead of time and encrypting a packet whose key
+     * stream is ready takes a single XOR pass. Only AES-CM and
+     * Twofish-CM use it. Contexts created with
+     * <code>newCryptoContextForSSRC</code> inherit the setting.
+     *
+     * @param packets
+     *    Number of packets to precompute the key stream for, 0 to
+     *    disable precomputation.
+     *
+     * @param length
+     *    Length of the key stream per packet in bytes. Packets with a
+     *    longer payload are encrypted as usual.
+     */
+        void setKeystreamPrecompute(uint32 packets, uint32 length);
+
+    /**
+     * Get the number of packets the key stream is precomputed for.
+     *
+     * @return the number of packets, 0 if precomputation is disabled.
+     */
+        inline uint32
+        getKeystreamPrecompute() const
+        {return ksPackets;}
+
+    /**
+     * Precompute the key stream of the packets following a packet index.
+     *
+     * Fills the key stream slots of the packet indexes from
+     * <code>index</code> on that are not ready yet, for the SSRC of
+     * this context. The send queue calls this when it has nothing
+     * left to send.
+     *
+     * @param index
+     *    The 48 bit SRTP packet index of the next packet to send.
+     */
+        void precomputeKeystream(uint64 index);
+
     /**
      * Get the length of the SRTP authentication tag in bytes.
      *
@@ -355,6 +538,22 @@ NAMESPACE_COMMONCPP
 
     private:
 
+    /**
+     * Compute the session keys from the master key and salt, keeping
+     * them.
+     */
+        void computeSessionKeys(uint64 index, uint8* ke, uint8* ka, uint8* ks);
+
+    /**
+     * Set the session keys already derived, for <code>deriveSrtpKeys</code>
+     * to use instead of deriving them again.
+     *
+     * @param keys
+     *    The session encryption key, authentication key and salt, one
+     *    after the other.
+     */
+        void setSessionKeys(const uint8* keys);
+
         uint32 ssrcCtx;
         bool   using_mki;
         uint32 mkiLength;
@@ -365,8 +564,8 @@ NAMESPACE_COMMONCPP
         uint16 s_l;
         int64  key_deriv_rate;
 
-        /* bitmask for replay check */
-        uint64 replay_window;
+        /* received packets for replay check */
+        SrtpReplayWindow replayWindow;
 
         uint8* master_key;
         uint32 master_key_length;
@@ -391,6 +590,21 @@ NAMESPACE_COMMONCPP
         int32 tagLength;
         bool  seqNumSet;
 
+        /* session keys k_e, k_a, k_s derived at index 0, shared by the
+           contexts created with newCryptoContextForSSRC */
+        uint8* cachedKeys;
+        /* k_e, k_a and k_s hold session keys deriveSrtpKeys must use */
+        bool  sessionKeysSet;
+
+        /* precomputed key stream, ksLength bytes for each of ksPackets
+           packets, the slot of a packet index is index % ksPackets */
+        uint8*  ksStream;
+        /* packet index of each slot, ~0 if the slot is empty */
+        uint64* ksIndex;
+        uint32  ksPackets;
+        uint32  ksLength;
+        Mutex   keystreamMutex;
+
         void*   macCtx;
 
 #ifdef SRTP_SUPPORT
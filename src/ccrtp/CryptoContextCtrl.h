@@ -23,8 +23,9 @@
 #define CRYPTOCONTEXTCTRL_H
 
 #include <commoncpp/config.h>
+#include <ccrtp/SrtpReplayWindow.h>
 
-#define REPLAY_WINDOW_SIZE 64
+#define SRTP_MAX_TAG_LENGTH 64
 
 #ifdef SRTP_SUPPORT
 #include <ccrtp/crypto/SrtpSymCrypto.h>
@@ -84,9 +85,11 @@ NAMESPACE_COMMONCPP
      *
      * @param ealg
      *    The encryption algorithm to use. Possible values are <code>
-     *    SrtpEncryptionNull, SrtpEncryptionAESCM, SrtpEncryptionAESF8
-     *    </code>. See chapter 4.1.1 for AESCM (Counter mode) and 4.1.2
-     *    for AES F8 mode.
+     *    SrtpEncryptionNull, SrtpEncryptionAESCM, SrtpEncryptionAESF8,
+     *    SrtpEncryptionAESGCM</code>. See chapter 4.1.1 for AESCM
+     *    (Counter mode) and 4.1.2 for AES F8 mode. AESGCM is the AEAD
+     *    mode of RFC 7714, it authenticates the packets itself and
+     *    requires <code>SrtpAuthenticationNull</code> as aalg.
      *
      * @param aalg
      *    The authentication algorithm to use. Possible values are <code>
@@ -135,7 +138,8 @@ NAMESPACE_COMMONCPP
      *
      * @param tagLength
      *    The length is bytes of the authentication tag that SRTP appends
-     *    to the RTP packet. Refer to chapter 4.2. in the RFC 3711.
+     *    to the RTP packet. Refer to chapter 4.2. in the RFC 3711. The
+     *    AES GCM tag is 16 bytes long (RFC 7714).
      */
     CryptoContextCtrl( uint32 ssrc,
                const  int32 ealg,
@@ -191,6 +195,89 @@ NAMESPACE_COMMONCPP
      */
     void srtcpAuthenticate(uint8* rtp, size_t len, uint32 roc, uint8* tag );
 
+    /**
+     * Check the authentication tag of a received packet.
+     *
+     * Computes the tag into a buffer on the stack and compares it to the
+     * received tag in constant time.
+     *
+     * @param rtp
+     *    The RTCP packet that contains the data to authenticate.
+     *
+     * @param len
+     *    Length of the data to authenticate.
+     *
+     * @param index
+     *    The SRTCP index with the E flag, as received.
+     *
+     * @param tag
+     *    Points to the received authentication tag.
+     *
+     * @return <code>true</code> if the tag is valid.
+     */
+    bool srtcpCheckTag(uint8* rtp, size_t len, uint32 index, const uint8* tag);
+
+    /**
+     * Perform SRTCP AEAD encryption.
+     *
+     * With AES GCM (RFC 7714) this method encrypts the compound packet,
+     * except its first 8 octets, in place and computes the
+     * authentication tag over the whole packet and the SRTCP index in
+     * one pass.
+     *
+     * @param rtp
+     *    The RTCP compound packet to encrypt.
+     *
+     * @param len
+     *    The length of the RTCP compound packet.
+     *
+     * @param index
+     *    The SRTCP index field, including the E flag.
+     *
+     * @param ssrc
+     *    The SSRC of the sender in <em>host</em> order.
+     *
+     * @param tag
+     *    Points to a buffer that holds the computed tag. This buffer must
+     *    be able to hold <code>tagLength</code> bytes.
+     */
+    void srtcpAeadEncrypt(uint8* rtp, size_t len, uint32 index, uint32 ssrc, uint8* tag);
+
+    /**
+     * Perform SRTCP AEAD decryption.
+     *
+     * Checks the authentication tag of a compound packet protected with
+     * AES GCM and decrypts it in place, in one pass.
+     *
+     * @param rtp
+     *    The RTCP compound packet to decrypt, without SRTCP trailer.
+     *
+     * @param len
+     *    The length of the RTCP compound packet.
+     *
+     * @param index
+     *    The SRTCP index field, including the E flag.
+     *
+     * @param ssrc
+     *    The SSRC of the sender in <em>host</em> order.
+     *
+     * @param tag
+     *    Points to the received authentication tag.
+     *
+     * @return <code>true</code> if the tag is valid.
+     */
+    bool srtcpAeadDecrypt(uint8* rtp, size_t len, uint32 index, uint32 ssrc, const uint8* tag);
+
+    /**
+     * Check whether this context uses an AEAD algorithm, which encrypts
+     * and authenticates in one pass (see <code>srtcpAeadEncrypt</code>).
+     *
+     * @return <code>true</code> for AES GCM.
+     */
+    inline bool
+    isAead() const
+        {return ealg == SrtpEncryptionAESGCM;}
+
     /**
      * Perform key derivation according to SRTP specification
      *
@@ -232,6 +319,42 @@ NAMESPACE_COMMONCPP
      */
     void update( uint32 newSeqNumber );
 
+    /**
+     * Set the size of the replay window.
+     *
+     * Packets older than the window are rejected as too old. A larger
+     * window accepts packets delayed by multipath delivery or FEC
+     * recovery on high rate streams. The size is rounded up to a
+     * multiple of 64 and kept between REPLAY_WINDOW_MIN_SIZE and
+     * REPLAY_WINDOW_MAX_SIZE. Contexts created with
+     * <code>newCryptoContextForSSRC</code> inherit the size.
+     *
+     * @param packets
+     *    The size of the window in packets, REPLAY_WINDOW_SIZE by default.
+     */
+    inline void
+    setReplayWindowSize(uint32 packets)
+        {replayWindow.setSize(packets);}
+
+    /**
+     * Get the size of the replay window.
+     *
+     * @return the size of the window in packets.
+     */
+    inline uint32
+    getReplayWindowSize() const
+        {return replayWindow.getSize();}
+
+    /**
+     * Get the replay protection statistics of this context.
+     *
+     * @return the highest index received, the window size and the
+     *    number of packets accepted, late and rejected.
+     */
+    inline const SrtpReplayStats&
+    getReplayStats() const
+        {return replayWindow.getStats();}
+
     /**
      * Get the length of the SRTP authentication tag in bytes.
      *
@@ -290,10 +413,8 @@ NAMESPACE_COMMONCPP
         uint32 mkiLength;
         uint8* mki;
 
-        uint32 s_l;
-
-        /* bitmask for replay check */
-        uint64 replay_window;
+        /* received packets for replay check */
+        SrtpReplayWindow replayWindow;
 
         uint8* master_key;
         uint32 master_key_length;
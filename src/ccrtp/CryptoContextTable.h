@@ -0,0 +1,387 @@
+// Copyright (C) 2026 the GNU ccRTP contributors.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+//
+// As a special exception, you may use this file as part of a free software
+// library without restriction.  Specifically, if other files instantiate
+// templates or use macros or inline functions from this file, or you compile
+// this file and link it with other files to produce an executable, this
+// file does not by itself cause the resulting executable to be covered by
+// the GNU General Public License.  This exception does not however
+// invalidate any other reasons why the executable file might be covered by
+// the GNU General Public License.
+//
+// This exception applies only to the code released under the name GNU
+// ccRTP.  If you copy code from other releases into a copy of GNU
+// ccRTP, as the General Public License permits, the exception does
+// not apply to the code that you add in this way.  To avoid misleading
+// anyone as to the status of such modified files, you must delete
+// this exception notice from them.
+//
+// If you write modifications of your own for GNU ccRTP, it is your choice
+// whether to permit this exception to apply to your modifications.
+// If you do not wish that, delete this exception notice.
+//
+
+/**
+ * @file CryptoContextTable.h
+ * @short Lookup of SRTP/SRTCP cryptographic contexts by SSRC.
+ **/
+
+#ifndef CCXX_RTP_CRYPTOCONTEXTTABLE_H_
+#define CCXX_RTP_CRYPTOCONTEXTTABLE_H_
+
+#include <ccrtp/base.h>
+#include <commoncpp/thread.h>
+#include <list>
+
+NAMESPACE_COMMONCPP
+
+/**
+ * @class CryptoContextTable
+ * @short Table of cryptographic contexts indexed by SSRC.
+ *
+ * Contexts (CryptoContext or CryptoContextCtrl objects) are kept in
+ * an open addressing hash table with linear probing. find() does not
+ * take any lock: modifications are bracketed by a sequence counter
+ * that is odd while the table is being changed, and a lookup is
+ * repeated whenever the counter changes under it. The slot of the
+ * last context found is remembered, so that the common case of
+ * consecutive packets from the same source does not even hash.
+ *
+ * Modifications must be serialized by the caller. The table owns the
+ * contexts inserted. Contexts replaced or removed and the arrays
+ * replaced when the table grows are deleted only after the lookups
+ * that might still be reading them have finished, see reclaim(), so
+ * that find() never reads freed memory.
+ *
+ * The table does not know when the caller is done with a context
+ * returned by find(). Callers must not remove or replace a context
+ * while it may still be in use, for instance protecting or
+ * unprotecting a packet in another thread.
+ **/
+template <class T>
+class CryptoContextTable
+{
+public:
+    CryptoContextTable() :
+        entries(NULL), mask(0), sequence(0), cached(0),
+        used(0), deleted(0), epoch(0),
+        retiredEntries(), retiredContexts()
+    {
+        readers[0] = readers[1] = 0;
+        entries = newEntries(minSlots);
+        mask = minSlots - 1;
+    }
+
+    ~CryptoContextTable()
+    {
+        clear();
+        delete [] entries;
+    }
+
+    /**
+     * Find the context of a source.
+     *
+     * @param ssrc SSRC identifier of the source.
+     * @return context of the source, NULL if there is none.
+     **/
+    T*
+    find(uint32 ssrc) const
+    {
+        // announce the lookup, see reclaim().
+        volatile uint32& count = readers[epoch & 1];
+        rtpAtomicAdd(count,1);
+        T* result = search(ssrc);
+        rtpAtomicAdd(count,-1);
+        return result;
+    }
+
+    /**
+     * Insert a context, replacing (and retiring) the context with
+     * the same SSRC, if any.
+     **/
+    void
+    insert(T* cc)
+    {
+        insertContext(cc);
+        reclaim();
+    }
+
+    /**
+     * Remove (and retire) the context of a source.
+     *
+     * @return whether there was a context for ssrc.
+     **/
+    bool
+    remove(uint32 ssrc)
+    {
+        size_t slot;
+        if ( !lookup(ssrc,slot) )
+            return false;
+        T* old = entries[slot].context;
+        beginUpdate();
+        entries[slot].context = NULL;
+        entries[slot].state = slotDeleted;
+        endUpdate();
+        retiredContexts.push_back(old);
+        used--;
+        deleted++;
+        reclaim();
+        return true;
+    }
+
+    /**
+     * Remove (and retire) all the contexts.
+     **/
+    void
+    clear()
+    {
+        size_t slots = mask + 1;
+        beginUpdate();
+        for ( size_t i = 0; i < slots; i++ ) {
+            if ( entries[i].context )
+                retiredContexts.push_back(entries[i].context);
+            entries[i].context = NULL;
+            entries[i].state = slotEmpty;
+        }
+        endUpdate();
+        used = deleted = 0;
+        reclaim();
+    }
+
+    inline size_t
+    getCount() const
+    { return used; }
+
+private:
+    typedef enum {
+        slotEmpty,
+        slotUsed,
+        slotDeleted
+    } SlotState;
+
+    struct Entry
+    {
+        T* context;
+        uint32 ssrc;
+        SlotState state;
+    };
+
+    T*
+    search(uint32 ssrc) const
+    {
+        for (;;) {
+            uint32 seq = sequence;
+            if ( seq & 1 )
+                continue;   // a modification is in progress
+            rtpMemoryBarrier();
+            const Entry* e = entries;
+            size_t m = mask;
+            size_t slot = cached;
+            T* result = NULL;
+            if ( slot <= m && e[slot].context &&
+                 e[slot].ssrc == ssrc ) {
+                result = e[slot].context;
+            } else {
+                slot = hash(ssrc) & m;
+                for ( size_t n = 0; n <= m; n++ ) {
+                    if ( slotEmpty == e[slot].state )
+                        break;
+                    if ( e[slot].context && e[slot].ssrc == ssrc ) {
+                        result = e[slot].context;
+                        break;
+                    }
+                    slot = (slot + 1) & m;
+                }
+            }
+            rtpMemoryBarrier();
+            if ( seq == sequence ) {
+                if ( result )
+                    cached = slot;
+                return result;
+            }
+        }
+    }
+
+    static const size_t minSlots = 16;
+
+    void
+    insertContext(T* cc)
+    {
+        uint32 ssrc = cc->getSsrc();
+        size_t slot;
+        if ( lookup(ssrc,slot) ) {
+            T* old = entries[slot].context;
+            beginUpdate();
+            entries[slot].context = cc;
+            endUpdate();
+            if ( old != cc )
+                retiredContexts.push_back(old);
+            return;
+        }
+        if ( (used + deleted + 1) * 4 > (mask + 1) * 3 ) {
+            // grow only if most slots hold contexts, otherwise
+            // just get rid of deleted slots.
+            rehash((used + 1) * 2 > mask + 1 ? (mask + 1) * 2 : mask + 1);
+            lookup(ssrc,slot);
+        }
+        if ( slotDeleted == entries[slot].state )
+            deleted--;
+        beginUpdate();
+        entries[slot].ssrc = ssrc;
+        entries[slot].context = cc;
+        entries[slot].state = slotUsed;
+        endUpdate();
+        used++;
+    }
+
+    static inline size_t
+    hash(uint32 ssrc)
+    {
+        // SSRC identifiers are random, but local applications
+        // may choose them consecutively.
+        uint32 h = ssrc * 0x9e3779b1;
+        return h ^ (h >> 16);
+    }
+
+    static Entry*
+    newEntries(size_t slots)
+    {
+        Entry* e = new Entry[slots];
+        for ( size_t i = 0; i < slots; i++ ) {
+            e[i].context = NULL;
+            e[i].state = slotEmpty;
+        }
+        return e;
+    }
+
+    /**
+     * Look for the slot of a source, for modifications.
+     *
+     * @param ssrc SSRC identifier of the source.
+     * @param slot slot of the source if found, otherwise the slot
+     * it would be inserted at.
+     * @return whether the source was found.
+     **/
+    bool
+    lookup(uint32 ssrc, size_t& slot) const
+    {
+        size_t s = hash(ssrc) & mask;
+        bool reuse = false;
+        for ( size_t n = 0; n <= mask; n++ ) {
+            if ( slotEmpty == entries[s].state ) {
+                if ( !reuse )
+                    slot = s;
+                return false;
+            }
+            if ( slotUsed == entries[s].state &&
+                 entries[s].ssrc == ssrc ) {
+                slot = s;
+                return true;
+            }
+            if ( !reuse && slotDeleted == entries[s].state ) {
+                // first deleted slot, reused for insertion
+                slot = s;
+                reuse = true;
+            }
+            s = (s + 1) & mask;
+        }
+        return false;
+    }
+
+    void
+    rehash(size_t slots)
+    {
+        Entry* e = newEntries(slots);
+        size_t m = slots - 1;
+        for ( size_t i = 0; i <= mask; i++ ) {
+            if ( slotUsed != entries[i].state )
+                continue;
+            size_t s = hash(entries[i].ssrc) & m;
+            while ( slotEmpty != e[s].state )
+                s = (s + 1) & m;
+            e[s] = entries[i];
+        }
+        beginUpdate();
+        // lookups may still be reading the array being replaced.
+        retiredEntries.push_back(static_cast<Entry*>(entries));
+        entries = e;
+        mask = m;
+        endUpdate();
+        deleted = 0;
+    }
+
+    /**
+     * Delete the contexts and arrays taken out of the table. New
+     * lookups are counted apart from the ones in progress, which
+     * may still be reading them and are waited for. The lookups
+     * that start afterwards cannot reach them.
+     **/
+    void
+    reclaim()
+    {
+        if ( retiredContexts.empty() && retiredEntries.empty() )
+            return;
+        uint32 old = epoch & 1;
+        epoch++;
+        rtpMemoryBarrier();
+        while ( readers[old] )
+            Thread::yield();
+        while ( !retiredContexts.empty() ) {
+            delete retiredContexts.front();
+            retiredContexts.pop_front();
+        }
+        while ( !retiredEntries.empty() ) {
+            delete [] retiredEntries.front();
+            retiredEntries.pop_front();
+        }
+    }
+
+    inline void
+    beginUpdate()
+    { sequence++; rtpMemoryBarrier(); }
+
+    inline void
+    endUpdate()
+    { rtpMemoryBarrier(); sequence++; }
+
+    Entry* volatile entries;
+    volatile size_t mask;
+    // odd while the table is being modified.
+    volatile uint32 sequence;
+    // slot of the last context found.
+    mutable volatile size_t cached;
+    size_t used;
+    size_t deleted;
+    // lookups in progress, counted apart for even and odd
+    // epochs, see reclaim().
+    mutable volatile uint32 readers[2];
+    volatile uint32 epoch;
+    // taken out of the table and not yet deleted.
+    std::list<Entry*> retiredEntries;
+    std::list<T*> retiredContexts;
+};
+
+END_NAMESPACE
+
+#endif  //CCXX_RTP_CRYPTOCONTEXTTABLE_H_
+
+/** EMACS **
+ * Local variables:
+ * mode: c++
+ * c-basic-offset: 8
+ * End:
+ */
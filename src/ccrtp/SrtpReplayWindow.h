@@ -0,0 +1,192 @@
+/*
+  Copyright (C) 2004-2006 the Minisip Team
+  Copyright (C) 2011 Werner Dittmann for the SRTCP support
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+*/
+
+#ifndef SRTPREPLAYWINDOW_H
+#define SRTPREPLAYWINDOW_H
+
+#include <commoncpp/config.h>
+
+/* default size of the replay window, in packets */
+#define REPLAY_WINDOW_SIZE 64
+/* bounds of the configurable replay window size */
+#define REPLAY_WINDOW_MIN_SIZE 64
+#define REPLAY_WINDOW_MAX_SIZE 4096
+
+NAMESPACE_COMMONCPP
+
+    /**
+     * Replay protection statistics of a SRTP or SRTCP cryptographic
+     * context.
+     */
+    struct SrtpReplayStats {
+        /* highest packet index received */
+        uint64 highestIndex;
+        /* size of the replay window, in packets */
+        uint32 windowSize;
+        /* packets recorded as received */
+        uint32 accepted;
+        /* packets received out of order but within the window */
+        uint32 late;
+        /* packets rejected because they were already received */
+        uint32 replayed;
+        /* packets rejected because they are older than the window */
+        uint32 tooOld;
+    };
+
+    /**
+     * Replay window of a SRTP or SRTCP cryptographic context.
+     *
+     * Received packet indexes are recorded in a bitmap kept as a ring
+     * of 64 bit words, one bit per index. The ring holds one word more
+     * than the window size, so moving the window forward only clears
+     * the words it enters and never shifts the bitmap.
+     *
+     * See RFC 3711, chapter 3.3.2.
+     */
+    class SrtpReplayWindow {
+    public:
+        SrtpReplayWindow() :
+            bits(NULL), words(0), started(false)
+        {
+            stats.highestIndex = 0;
+            stats.accepted = stats.late = stats.replayed = stats.tooOld = 0;
+            setSize(REPLAY_WINDOW_SIZE);
+        }
+
+        ~SrtpReplayWindow()
+        { delete [] bits; }
+
+        /**
+         * Set the size of the replay window.
+         *
+         * If packets were already received, all indexes of the new
+         * window are taken as received, so that changing the size never
+         * lets a replayed packet through.
+         *
+         * @param size
+         *    Size in packets, rounded up to a multiple of 64 and kept
+         *    between REPLAY_WINDOW_MIN_SIZE and REPLAY_WINDOW_MAX_SIZE.
+         */
+        void setSize(uint32 size)
+        {
+            if (size < REPLAY_WINDOW_MIN_SIZE)
+                size = REPLAY_WINDOW_MIN_SIZE;
+            if (size > REPLAY_WINDOW_MAX_SIZE)
+                size = REPLAY_WINDOW_MAX_SIZE;
+            size = (size + 63) & ~63;
+
+            delete [] bits;
+            words = size / 64 + 1;
+            bits = new uint64[words];
+            for (uint32 i = 0; i < words; i++)
+                bits[i] = started ? ~(uint64)0 : 0;
+            if (started)
+                bits[wordOf(stats.highestIndex)] =
+                    ~(uint64)0 >> (63 - (stats.highestIndex & 63));
+            stats.windowSize = size;
+        }
+
+        inline uint32
+        getSize() const
+        { return stats.windowSize; }
+
+        /**
+         * Check whether a packet index may be accepted.
+         *
+         * @return <code>false</code> if the index was already received
+         *    or is older than the window.
+         */
+        bool check(uint64 index)
+        {
+            if (!started || index > stats.highestIndex)
+                return true;
+            if (stats.highestIndex - index >= stats.windowSize) {
+                stats.tooOld++;
+                return false;
+            }
+            if ((bits[wordOf(index)] >> (index & 63)) & 1) {
+                stats.replayed++;
+                return false;
+            }
+            return true;
+        }
+
+        /**
+         * Record a packet index as received, moving the window forward
+         * if it is the highest index so far.
+         */
+        void update(uint64 index)
+        {
+            if (!started) {
+                started = true;
+                stats.highestIndex = index;
+            }
+            else if (index > stats.highestIndex) {
+                /* clear the words the window enters */
+                uint64 from = (stats.highestIndex >> 6) + 1;
+                uint64 to = index >> 6;
+                if (to >= from) {
+                    if (to - from >= words)
+                        from = to - words + 1;
+                    for (uint64 w = from; w <= to; w++)
+                        bits[w % words] = 0;
+                }
+                stats.highestIndex = index;
+            }
+            else if (stats.highestIndex - index >= stats.windowSize) {
+                return;
+            }
+            else if (index < stats.highestIndex) {
+                stats.late++;
+            }
+            bits[wordOf(index)] |= (uint64)1 << (index & 63);
+            stats.accepted++;
+        }
+
+        inline const SrtpReplayStats&
+        getStats() const
+        { return stats; }
+
+    private:
+        SrtpReplayWindow(const SrtpReplayWindow&);
+
+        SrtpReplayWindow&
+        operator=(const SrtpReplayWindow&);
+
+        inline uint32
+        wordOf(uint64 index) const
+        { return (uint32)((index >> 6) % words); }
+
+        uint64* bits;
+        uint32 words;
+        bool started;
+        SrtpReplayStats stats;
+    };
+
+END_NAMESPACE
+
+#endif
+
+/** EMACS **
+ * Local variables:
+ * mode: c++
+ * c-default-style: ellemtel
+ * c-basic-offset: 4
+ * End:
+ */
@@ -106,12 +106,85 @@ timevalDiff2microtimeout(const timeval& t1, const timeval& t2)
         (t1.tv_usec - t2.tv_usec);
 }
 
+/**
+ * Full memory barrier, for the data shared between threads without
+ * locks.
+ **/
+inline void
+rtpMemoryBarrier()
+{
+#if defined(__GNUC__)
+    __sync_synchronize();
+#elif defined(_MSWINDOWS_)
+    MemoryBarrier();
+#endif
+}
+
+/**
+ * Atomically add to a counter shared between threads without locks.
+ *
+ * @param counter counter to modify.
+ * @param delta value to add, may be negative.
+ * @return the new value of the counter.
+ **/
+inline uint32
+rtpAtomicAdd(volatile uint32& counter, int32 delta)
+{
+#if defined(__GNUC__)
+    return __sync_add_and_fetch(&counter,delta);
+#elif defined(_MSWINDOWS_)
+    return InterlockedExchangeAdd(reinterpret_cast<volatile LONG*>(&counter),
+                      delta) + delta;
+#else
+    return counter += delta;
+#endif
+}
+
 /// registered default RTP data transport port
 const tpport_t DefaultRTPDataPort = 5004;
 
 /// registered default RTCP transport port
 const tpport_t DefaultRTCPPort = 5005;
 
+/// maximum number of datagrams moved in a single batched socket call
+const size_t MaxRTPBatchSize = 64;
+
+/// default number of slots of the lock-free data packet handoff queues
+const size_t DefaultRTPHandoffSlots = 256;
+
+/**
+ * @struct RTPDatagram
+ * @short Descriptor of a datagram in batched socket operations.
+ *
+ * On input, buffer and size describe the memory region the datagram
+ * is read to (or written from). On output of a receive operation,
+ * size holds the number of octets actually read and host/port hold
+ * the address of the sender.
+ **/
+struct RTPDatagram
+{
+        unsigned char* buffer;
+        size_t size;
+        InetHostAddress host;
+        tpport_t port;
+};
+
+#ifdef  CCXX_IPV6
+/**
+ * @struct RTPDatagramIPV6
+ * @short Descriptor of a datagram in batched IPv6 socket operations.
+ *
+ * @see RTPDatagram
+ **/
+struct RTPDatagramIPV6
+{
+        unsigned char* buffer;
+        size_t size;
+        IPV6Host host;
+        tpport_t port;
+};
+#endif
+
 END_NAMESPACE
 
 #endif  // ndef CCXX_RTP_BASE_H_
@@ -45,6 +45,10 @@
 #include <sys/ioctl.h>
 inline size_t ccioctl(int so, int request, size_t& len)
     { return ioctl(so,request,&len); }
+#if defined(__linux__) && defined(MSG_WAITFORONE)
+// recvmmsg(2) and sendmmsg(2) are available for batched datagram I/O
+#define CCRTP_BATCHED_IO
+#endif
 #else
 inline size_t ccioctl(SOCKET so, int request, size_t& len )
 {
@@ -117,6 +121,17 @@ public:
     recv(unsigned char* buffer, size_t len)
     { return UDPSocket::receive(buffer, len); }
 
+    /**
+     * Read up to count datagrams waiting in the socket in a single
+     * call, without blocking.
+     *
+     * @param batch array of datagram descriptors to fill.
+     * @param count number of elements in batch.
+     * @return number of datagrams actually read.
+     **/
+    size_t
+    recvBatch(RTPDatagram* batch, size_t count);
+
     /**
      * Get size of next datagram waiting to be read.
      **/
@@ -155,6 +170,17 @@ public:
     send(const unsigned char* const buffer, size_t len)
     { return UDPSocket::send(buffer, len); }
 
+    /**
+     * Send count datagrams, each one to its own peer, in a single
+     * call.
+     *
+     * @param batch array of datagram descriptors to send.
+     * @param count number of elements in batch.
+     * @return number of datagrams actually sent.
+     **/
+    size_t
+    sendBatch(const RTPDatagram* batch, size_t count);
+
     inline SOCKET getRecvSocket() const
     { return UDPSocket::so; }
 
@@ -209,6 +235,10 @@ public:
     recv(unsigned char* buffer, size_t len)
     { return recvSocket->recv(buffer, len); }
 
+    inline size_t
+    recvBatch(RTPDatagram* batch, size_t count)
+    { return recvSocket->recvBatch(batch, count); }
+
     inline size_t
     getNextPacketSize() const
     { return recvSocket->getNextPacketSize(); }
@@ -239,6 +269,10 @@ public:
     send(const unsigned char* const buffer, size_t len)
     { return sendSocket->send(buffer, len); }
 
+    inline size_t
+    sendBatch(const RTPDatagram* batch, size_t count)
+    { return sendSocket->sendBatch(batch, count); }
+
     inline SOCKET getRecvSocket() const
     { return recvSocket->getRecvSocket(); }
 
@@ -300,6 +334,17 @@ public:
     recv(unsigned char* buffer, size_t len)
     { return UDPSocket::receive(buffer, len); }
 
+    /**
+     * Read up to count datagrams waiting in the socket in a single
+     * call, without blocking.
+     *
+     * @param batch array of datagram descriptors to fill.
+     * @param count number of elements in batch.
+     * @return number of datagrams actually read.
+     **/
+    size_t
+    recvBatch(RTPDatagramIPV6* batch, size_t count);
+
     /**
      * Get size of next datagram waiting to be read.
      **/
@@ -338,6 +383,17 @@ public:
     send(const unsigned char* const buffer, size_t len)
     { return UDPSocket::send(buffer, len); }
 
+    /**
+     * Send count datagrams, each one to its own peer, in a single
+     * call.
+     *
+     * @param batch array of datagram descriptors to send.
+     * @param count number of elements in batch.
+     * @return number of datagrams actually sent.
+     **/
+    size_t
+    sendBatch(const RTPDatagramIPV6* batch, size_t count);
+
     inline SOCKET getRecvSocket() const
     { return UDPSocket::so; }
 
@@ -392,6 +448,10 @@ public:
     recv(unsigned char* buffer, size_t len)
     { return recvSocket->recv(buffer, len); }
 
+    inline size_t
+    recvBatch(RTPDatagramIPV6* batch, size_t count)
+    { return recvSocket->recvBatch(batch, count); }
+
     inline size_t
     getNextPacketSize() const
     { return recvSocket->getNextPacketSize(); }
@@ -422,6 +482,10 @@ public:
     send(const unsigned char* const buffer, size_t len)
     { return sendSocket->send(buffer, len); }
 
+    inline size_t
+    sendBatch(const RTPDatagramIPV6* batch, size_t count)
+    { return sendSocket->sendBatch(batch, count); }
+
     inline SOCKET getRecvSocket() const
     { return recvSocket->getRecvSocket(); }
 
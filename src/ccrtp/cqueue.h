@@ -46,6 +46,7 @@
 
 #include <ccrtp/ioqueue.h>
 #include <ccrtp/CryptoContextCtrl.h>
+#include <ccrtp/CryptoContextTable.h>
 #include <list>
 
 NAMESPACE_COMMONCPP
@@ -178,6 +179,68 @@ public:
     getSendRTCPPacketCount() const
     { return ctrlSendCount; }
 
+    /**
+     * Enable or disable reduced-size RTCP (RFC 5506). When
+     * enabled, packets passed to dispatchControlPackets() may be
+     * sent on their own instead of in a compound packet, and
+     * incoming RTCP packets need not start with a SR or RR.
+     *
+     * Regular reports are still sent as full compound packets,
+     * and nothing is sent reduced before the first of them.
+     *
+     * @param enable whether to use reduced-size RTCP (off by default).
+     **/
+    inline void
+    setReducedSizeRTCP(bool enable)
+    { reducedSizeRTCP = enable; }
+
+    inline bool
+    isReducedSizeRTCP() const
+    { return reducedSizeRTCP; }
+
+    /**
+     * Whether RTCP is multiplexed with RTP on a single port (RFC
+     * 5761). In that case, RTCP packets are sent and received
+     * through the data channel, told apart from data packets by
+     * their type.
+     **/
+    inline bool
+    isRTCPMux() const
+    { return rtcpMux; }
+
+    /**
+     * Enable or disable batching of the packets passed to
+     * dispatchControlPackets(). When enabled, they are always held
+     * back and appended to the next regular compound packet, so
+     * that it is protected and sent only once.
+     *
+     * @param enable whether to batch control packets (off by default).
+     **/
+    inline void
+    setControlBatching(bool enable)
+    { controlBatching = enable; }
+
+    inline bool
+    isControlBatching() const
+    { return controlBatching; }
+
+    /**
+     * Send RTCP packets built by the application, such as
+     * feedback messages or reports on behalf of other local
+     * sources.
+     *
+     * With reduced-size RTCP enabled and batching disabled the
+     * packets are sent at once. Otherwise they are appended to the
+     * next compound packet sent by the RTCP service.
+     *
+     * @param packets one or more complete RTCP packets.
+     * @param len length of the packets, in octets.
+     * @return number of octets sent or queued.
+     * @retval 0 if the packets are not valid or do not fit.
+     **/
+    size_t
+    dispatchControlPackets(const unsigned char* packets, size_t len);
+
     /**
      * Set ouput queue CryptoContext.
      *
@@ -195,6 +258,10 @@ public:
      * The endQueue method (provided by RTPQueue) also deletes all
      * registered CryptoContexts.
      *
+     * The context removed is deleted, so it must not be in use,
+     * for instance by the service thread protecting or
+     * unprotecting a packet of its source.
+     *
      * @param cc Pointer to initialized CryptoContext to remove.
      */
     void
@@ -228,6 +295,10 @@ public:
      * The endQueue method (provided by RTPQueue) also deletes all
      * registered CryptoContexts.
      *
+     * The context removed is deleted, so it must not be in use,
+     * for instance by the service thread protecting or
+     * unprotecting a packet of its source.
+     *
      * @param cc
      *     Pointer to initialized CryptoContext to remove. If pointer
      *     if <code>NULL</code> then delete the whole queue
@@ -406,20 +477,6 @@ protected:
     size_t
     sendControlToDestinations(unsigned char* buffer, size_t len);
 
-private:
-    QueueRTCPManager(const QueueRTCPManager &o);
-
-    QueueRTCPManager&
-    operator=(const QueueRTCPManager &o);
-
-    /**
-     * Posting of RTCP messages.
-     *
-     * @return std::size_t number of octets sent
-     */
-    size_t
-    dispatchControlPacket();
-
     /**
      * For picking up incoming RTCP packets if they are waiting. A
      * timeout for the maximum interval since the last RTCP packet
@@ -434,6 +491,51 @@ private:
     void
     takeInControlPacket();
 
+    /**
+     * Process a RTCP compound packet already read into the
+     * reception buffer.
+     *
+     * @param len length of the compound packet, in octets.
+     * @param na source network address.
+     * @param tp source transport port.
+     * @param recvtime time of arrival.
+     **/
+    void
+    processControlPacket(size_t len, InetHostAddress& na, tpport_t tp,
+                 const timeval& recvtime);
+
+    /**
+     * Take in RTCP packets received through the data channel when
+     * RTCP-mux is in use, see IncomingDataQueue.
+     **/
+    bool
+    takeInMuxedControlPacket(const unsigned char* buffer, size_t len,
+                 InetHostAddress& na, tpport_t tp,
+                 const timeval& recvtime);
+
+    /**
+     * Set whether RTCP is multiplexed with RTP on the data
+     * channel (RFC 5761). It is set by sessions built with the
+     * same data and control port.
+     **/
+    inline void
+    setRTCPMux(bool enable)
+    { rtcpMux = enable; }
+
+private:
+    QueueRTCPManager(const QueueRTCPManager &o);
+
+    QueueRTCPManager&
+    operator=(const QueueRTCPManager &o);
+
+    /**
+     * Posting of RTCP messages.
+     *
+     * @return std::size_t number of octets sent
+     */
+    size_t
+    dispatchControlPacket();
+
     /**
      * Computes the interval for sending RTCP compound packets,
      * based on the average size of RTCP packets sent and
@@ -450,6 +552,16 @@ private:
     virtual timeval
     computeRTCPInterval();
 
+    /**
+     * Computes the interval for sending RTCP compound packets
+     * before the random factor is applied, the deterministic
+     * interval Td of section 6.3.5 in RFC 3550.
+     *
+     * @return deterministic interval, in microseconds.
+     **/
+    microtimeout_t
+    computeDeterministicRTCPInterval();
+
     /**
      * Choose which should be the type of the next SDES item
      * sent. This method is called when packing SDES chunks in a
@@ -516,10 +628,18 @@ private:
     getBYE(RTCPPacket &pkt, size_t &pointer, size_t len);
 
     /**
+     * Pack report blocks about the sources we receive data from,
+     * taking them round the list of sources from where the
+     * previous call stopped.
+     *
+     * @param sources number of sources that may still be looked
+     * at in this compound packet, decreased as they are.
+     * @param now time of the compound packet, for the DLSR fields.
      * @return number of Report Blocks packed
      **/
     uint8
-    packReportBlocks(RRBlock* blocks, uint16& len, uint16& available);
+    packReportBlocks(RRBlock* blocks, uint16& len, uint16& available,
+                     uint32& sources, const timeval& now);
 
     /**
      * Builds an SDES RTCP packet. Each chunk is built following
@@ -560,14 +680,28 @@ private:
     /**
      * Purge sources that do not seem active any more.
      *
+     * Only the sources whose check is due in the timer wheel of
+     * MembershipBookkeeping are looked at. A source is marked
+     * inactive after the source expiration period (see
+     * setSourceExpirationPeriod()) without packets, and, if source
+     * removal is enabled (see setSourceRemoval()), deleted after
+     * twice that period, or after the leaving delay since its BYE
+     * (see setLeavingDelay()). A sender becomes a receiver after
+     * two intervals without data packets.
+     *
      * @note MUST be perform at least every RTCP transmission
      *       interval
-     * @todo implement it. It may be dangerous and anyway should
-     * be optional.
      **/
     void
     expireSSRCs();
 
+    /**
+     * Schedule the deletion of a source that sent a BYE after
+     * the leaving delay.
+     **/
+    void
+    scheduleLeaving(SyncSourceLink& link);
+
     /**
      * To be executed when whe are leaving the session.
      **/
@@ -691,11 +825,25 @@ private:
     static const double RECONSIDERATION_COMPENSATION;
     
     mutable Mutex outCryptoMutex;
-    std::list<CryptoContextCtrl *> outCryptoContexts;
+    CryptoContextTable<CryptoContextCtrl> outCryptoContexts;
     uint32 srtcpIndex;
 
     mutable Mutex inCryptoMutex;
-    std::list<CryptoContextCtrl *> inCryptoContexts;
+    CryptoContextTable<CryptoContextCtrl> inCryptoContexts;
+
+    // serializes protection and transmission of control packets
+    Mutex controlSendMutex;
+
+    bool rtcpMux;
+    bool reducedSizeRTCP;
+    bool controlBatching;
+    // guards the two buffers below
+    mutable Mutex pendingControlMutex;
+    // buffer for packets sent at once by dispatchControlPackets()
+    unsigned char* controlPacketBuffer;
+    // packets waiting to be appended to the next compound packet
+    unsigned char* pendingControl;
+    uint16 pendingControlLen;
 
 };
 
@@ -750,6 +898,45 @@ protected:
     { }
 };
 
+/**
+ * An AVP queue (see AVPQueue) that hands data packets over between
+ * threads through lock-free single-producer/single-consumer queues
+ * in both directions (see IncomingDataQueue::setRecvHandoff and
+ * OutgoingDataQueue::setSendHandoff). It is meant to be used as the
+ * ServiceQueue template parameter of RTP sessions in which one
+ * thread calls putData() and the service thread of the session is
+ * the only one taking in data packets, for instance:
+ *
+ * SingleThreadRTPSession<DualRTPUDPIPv4Channel,DualRTPUDPIPv4Channel,
+ *                        LockFreeAVPQueue>
+ **/
+class __EXPORT LockFreeAVPQueue : public AVPQueue
+{
+protected:
+    LockFreeAVPQueue(uint32 size = RTPDataQueue::defaultMembersHashSize,
+             RTPApplication& app = defaultApplication()) :
+        AVPQueue(size,app)
+    {
+        setRecvHandoff(DefaultRTPHandoffSlots);
+        setSendHandoff(DefaultRTPHandoffSlots);
+    }
+
+    /**
+     * Local SSRC is given instead of computed by the queue.
+     **/
+    LockFreeAVPQueue(uint32 ssrc, uint32 size =
+             RTPDataQueue::defaultMembersHashSize,
+             RTPApplication& app = defaultApplication()) :
+        AVPQueue(ssrc,size,app)
+    {
+        setRecvHandoff(DefaultRTPHandoffSlots);
+        setSendHandoff(DefaultRTPHandoffSlots);
+    }
+
+    inline virtual ~LockFreeAVPQueue()
+    { }
+};
+
 /** @}*/ // cqueue
 
 END_NAMESPACE
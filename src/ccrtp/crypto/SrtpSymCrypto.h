@@ -43,6 +43,7 @@
  */
 
 #include <stdint.h>
+#include <string.h>
 #include <CryptoContext.h>
 
 #ifndef SRTP_BLOCK_SIZE
@@ -60,7 +61,8 @@ typedef struct _f8_ctx {
  *
  * The SRTP specification defines two encryption modes, AES-CTR
  * (AES Counter mode) and AES-F8 mode. The AES-CTR is required,
- * AES-F8 is optional.
+ * AES-F8 is optional. The AES-GCM authenticated encryption mode
+ * is defined in RFC 7714.
  *
  * Both modes are desinged to encrypt/decrypt data of arbitrary length
  * (with a specified upper limit, refer to RFC 3711). These modes do
@@ -138,7 +140,10 @@ public:
     /**
      * Counter-mode encryption.
      *
-     * This method performs the AES CM encryption.
+     * This method performs the AES CM encryption. With AES keys
+     * the whole buffer is handed to the counter mode of the crypto
+     * library, other ciphers produce several blocks of cipher
+     * stream at a time which are then XORed in words of 64 bits.
      *
      * @param input
      *    Pointer to input buffer, must be <code>inputLen</code> bytes.
@@ -242,9 +247,147 @@ public:
      */
     void f8_encrypt(const uint8_t* data, uint32_t dataLen, uint8_t* out, uint8_t* iv, SrtpSymCrypto* f8Cipher);
 
+    /**
+     * AES GCM authenticated encryption, in place.
+     *
+     * This method encrypts the data and computes the authentication
+     * tag over the additional authenticated data and the encrypted
+     * data in one pass, see RFC 7714.
+     *
+     * @param data
+     *    Pointer to input and output block, must be <code>dataLen</code>
+     *    bytes.
+     *
+     * @param dataLen
+     *    Number of bytes to process.
+     *
+     * @param aad
+     *    Pointer to the additional authenticated data.
+     *
+     * @param aadLen
+     *    Number of bytes of additional authenticated data.
+     *
+     * @param iv
+     *    The 12 byte initialization vector, see chapter 8.1 in RFC 7714.
+     *
+     * @param tag
+     *    Pointer to a buffer that receives the authentication tag.
+     *
+     * @param tagLen
+     *    Length of the authentication tag, 8, 12 or 16 bytes.
+     *
+     * @return
+     *    false if the key is not an AES GCM key.
+     */
+    bool gcm_encrypt(uint8_t* data, uint32_t dataLen, const uint8_t* aad, uint32_t aadLen,
+                     const uint8_t* iv, uint8_t* tag, int32_t tagLen);
+
+    /**
+     * AES GCM authenticated decryption, in place.
+     *
+     * This method checks the authentication tag and decrypts the data
+     * in one pass, see RFC 7714. If the tag does not match the
+     * content of the data buffer is undefined.
+     *
+     * @param data
+     *    Pointer to input and output block, must be <code>dataLen</code>
+     *    bytes.
+     *
+     * @param dataLen
+     *    Number of bytes to process.
+     *
+     * @param aad
+     *    Pointer to the additional authenticated data.
+     *
+     * @param aadLen
+     *    Number of bytes of additional authenticated data.
+     *
+     * @param iv
+     *    The 12 byte initialization vector, see chapter 8.1 in RFC 7714.
+     *
+     * @param tag
+     *    Pointer to the received authentication tag.
+     *
+     * @param tagLen
+     *    Length of the authentication tag, 8, 12 or 16 bytes.
+     *
+     * @return
+     *    true if the authentication tag is valid.
+     */
+    bool gcm_decrypt(uint8_t* data, uint32_t dataLen, const uint8_t* aad, uint32_t aadLen,
+                     const uint8_t* iv, const uint8_t* tag, int32_t tagLen);
+
+    /**
+     * XOR data with cipher stream, a word at a time.
+     *
+     * @param out
+     *    Pointer to output buffer, may be the same as <code>in</code>.
+     *
+     * @param in
+     *    Pointer to input buffer.
+     *
+     * @param stream
+     *    Pointer to the cipher stream.
+     *
+     * @param length
+     *    Number of bytes to process.
+     */
+    static inline void xorStream(uint8_t* out, const uint8_t* in, const uint8_t* stream, uint32_t length) {
+        uint32_t i = 0;
+        // memcpy lets the compiler use unaligned (vector) loads
+        for (; i + sizeof(uint64_t) <= length; i += sizeof(uint64_t)) {
+            uint64_t a, b;
+            memcpy(&a, in + i, sizeof(a));
+            memcpy(&b, stream + i, sizeof(b));
+            a ^= b;
+            memcpy(out + i, &a, sizeof(a));
+        }
+        for (; i < length; i++)
+            out[i] = in[i] ^ stream[i];
+    }
+
 private:
-    int processBlock(F8_CIPHER_CTX* f8ctx, const uint8_t* in, int32_t length, uint8_t* out);
+    /**
+     * Compute consecutive blocks of the F8 mode cipher stream.
+     *
+     * @param f8ctx
+     *    The F8 context holding IV', the last key stream block and the
+     *    counter of the next block, both updated.
+     *
+     * @param stream
+     *    Pointer to the output buffer, <code>blocks</code> times
+     *    SRTP_BLOCK_SIZE bytes.
+     *
+     * @param blocks
+     *    Number of blocks to compute.
+     */
+    void f8Stream(F8_CIPHER_CTX* f8ctx, uint8_t* stream, uint32_t blocks);
+
+    /**
+     * Compute consecutive blocks of the counter mode cipher stream.
+     *
+     * @param stream
+     *    Pointer to the output buffer, <code>blocks</code> times
+     *    SRTP_BLOCK_SIZE bytes.
+     *
+     * @param blocks
+     *    Number of blocks to compute.
+     *
+     * @param iv
+     *    The initialization vector, its last two bytes are overwritten
+     *    with the counter.
+     *
+     * @param ctr
+     *    The counter of the first block.
+     */
+    void ctrStream(uint8_t* stream, uint32_t blocks, uint8_t* iv, uint16_t ctr);
+
+    /// Number of cipher stream blocks computed at a time by ctr_encrypt and f8_encrypt
+    static const int ctrStreamBlocks = 8;
+
     void* key;
+    /// Cipher mode context of the crypto library, AES CM and AES GCM only
+    void* modeCtx;
     int32_t algorithm;
 };
 
@@ -46,12 +46,12 @@ extern void initializeGcrypt();
 
 #include <stdio.h>
 
-SrtpSymCrypto::SrtpSymCrypto(int algo) : key(NULL), algorithm(algo) {
+SrtpSymCrypto::SrtpSymCrypto(int algo) : key(NULL), modeCtx(NULL), algorithm(algo) {
     initializeGcrypt();
 }
 
 SrtpSymCrypto::SrtpSymCrypto( uint8_t* k, int32_t keyLength, int algo) :
-    key(NULL),  algorithm(algo) {
+    key(NULL), modeCtx(NULL), algorithm(algo) {
 
     initializeGcrypt();
     setNewKey(k, keyLength);
@@ -59,7 +59,8 @@ SrtpSymCrypto::SrtpSymCrypto( uint8_t* k, int32_t keyLength, int algo) :
 
 SrtpSymCrypto::~SrtpSymCrypto() {
     if (key) {
-        if (algorithm == SrtpEncryptionAESCM || algorithm == SrtpEncryptionAESF8)
+        if (algorithm == SrtpEncryptionAESCM || algorithm == SrtpEncryptionAESF8 ||
+            algorithm == SrtpEncryptionAESGCM)
             gcry_cipher_close(static_cast<gcry_cipher_hd_t>(key));
         else if (algorithm == SrtpEncryptionTWOCM || algorithm == SrtpEncryptionTWOF8) {
             memset(key, 0, sizeof(Twofish_key));
@@ -67,6 +68,10 @@ SrtpSymCrypto::~SrtpSymCrypto() {
         }
         key = NULL;
     }
+    if (modeCtx) {
+        gcry_cipher_close(static_cast<gcry_cipher_hd_t>(modeCtx));
+        modeCtx = NULL;
+    }
 }
 
 static int twoFishInit = 0;
@@ -74,7 +79,8 @@ static int twoFishInit = 0;
 bool SrtpSymCrypto::setNewKey(const uint8_t* k, int32_t keyLength) {
 
     // release an existing key before setting a new one
-    if (algorithm == SrtpEncryptionAESCM || algorithm == SrtpEncryptionAESF8) {
+    if (algorithm == SrtpEncryptionAESCM || algorithm == SrtpEncryptionAESF8 ||
+        algorithm == SrtpEncryptionAESGCM) {
         if (key != NULL) {
             gcry_cipher_close(static_cast<gcry_cipher_hd_t>(key));
             key = NULL;
@@ -94,6 +100,20 @@ bool SrtpSymCrypto::setNewKey(const uint8_t* k, int32_t keyLength) {
         gcry_cipher_open(&tmp, algo, GCRY_CIPHER_MODE_ECB, 0);
         key = tmp;
         gcry_cipher_setkey(static_cast<gcry_cipher_hd_t>(key), k, keyLength);
+
+        // counter mode and GCM run through the CTR and GCM modes of
+        // gcrypt, which use AES-NI and process several blocks in
+        // parallel where available.
+        if (modeCtx != NULL) {
+            gcry_cipher_close(static_cast<gcry_cipher_hd_t>(modeCtx));
+            modeCtx = NULL;
+        }
+        int mode = (algorithm == SrtpEncryptionAESCM) ? GCRY_CIPHER_MODE_CTR : GCRY_CIPHER_MODE_GCM;
+        if (algorithm != SrtpEncryptionAESF8 &&
+            gcry_cipher_open(&tmp, algo, mode, 0) == 0) {
+            modeCtx = tmp;
+            gcry_cipher_setkey(static_cast<gcry_cipher_hd_t>(modeCtx), k, keyLength);
+        }
     }
     else if (algorithm == SrtpEncryptionTWOCM || algorithm == SrtpEncryptionTWOF8) {
         if (!twoFishInit) {
@@ -116,7 +136,8 @@ bool SrtpSymCrypto::setNewKey(const uint8_t* k, int32_t keyLength) {
 
 void SrtpSymCrypto::encrypt(const uint8_t* input, uint8_t* output) {
     if (key != NULL) {
-        if (algorithm == SrtpEncryptionAESCM || algorithm == SrtpEncryptionAESF8)
+        if (algorithm == SrtpEncryptionAESCM || algorithm == SrtpEncryptionAESF8 ||
+            algorithm == SrtpEncryptionAESGCM)
             gcry_cipher_encrypt (static_cast<gcry_cipher_hd_t>(key),
                                  output, SRTP_BLOCK_SIZE, input, SRTP_BLOCK_SIZE);
         else if (algorithm == SrtpEncryptionTWOCM || algorithm == SrtpEncryptionTWOF8)
@@ -127,25 +148,9 @@ void SrtpSymCrypto::encrypt(const uint8_t* input, uint8_t* output) {
 
 void SrtpSymCrypto::get_ctr_cipher_stream( uint8_t* output, uint32_t length,
                                      uint8_t* iv ) {
-    uint16_t ctr = 0;
-
-    unsigned char temp[SRTP_BLOCK_SIZE];
-
-    for(ctr = 0; ctr < length/SRTP_BLOCK_SIZE; ctr++ ){
-        //compute the cipher stream
-        iv[14] = (uint8_t)((ctr & 0xFF00) >>  8);
-        iv[15] = (uint8_t)((ctr & 0x00FF));
-
-        encrypt(iv, &output[ctr*SRTP_BLOCK_SIZE]);
-    }
-    if ((length % SRTP_BLOCK_SIZE) > 0) {
-        // Treat the last bytes:
-        iv[14] = (uint8_t)((ctr & 0xFF00) >>  8);
-        iv[15] = (uint8_t)((ctr & 0x00FF));
-
-        encrypt(iv, temp);
-        memcpy(&output[ctr*SRTP_BLOCK_SIZE], temp, length % SRTP_BLOCK_SIZE);
-    }
+    // the cipher stream is the encryption of zeros
+    memset(output, 0, length);
+    ctr_encrypt(output, length, iv);
 }
 
 void SrtpSymCrypto::ctr_encrypt( const uint8_t* input, uint32_t input_length,
@@ -154,69 +159,106 @@ void SrtpSymCrypto::ctr_encrypt( const uint8_t* input, uint32_t input_length,
     if (key == NULL)
         return;
 
+    // the last two octets of the IV hold the block counter
+    iv[14] = iv[15] = 0;
+
+    // a GCM key also derives the session keys in counter mode, but
+    // through the block cipher as its handle is not a CTR one
+    if (modeCtx != NULL && algorithm == SrtpEncryptionAESCM) {
+        gcry_cipher_hd_t hd = static_cast<gcry_cipher_hd_t>(modeCtx);
+        gcry_error_t err = gcry_cipher_setctr(hd, iv, SRTP_BLOCK_SIZE);
+        if (err == 0) {
+            if (input == output)
+                err = gcry_cipher_encrypt(hd, output, input_length, NULL, 0);
+            else
+                err = gcry_cipher_encrypt(hd, output, input_length, input, input_length);
+        }
+        if (err == 0)
+            return;
+        // gcrypt rejects the call before processing any data, so
+        // fall back to the block cipher below.
+    }
+
     uint16_t ctr = 0;
-    unsigned char temp[SRTP_BLOCK_SIZE];
+    unsigned char stream[ctrStreamBlocks * SRTP_BLOCK_SIZE];
+
+    while (input_length > 0) {
+        uint32_t l = sizeof(stream);
+        if (l > input_length)
+            l = input_length;
+        uint32_t blocks = (l + SRTP_BLOCK_SIZE - 1) / SRTP_BLOCK_SIZE;
+        ctrStream(stream, blocks, iv, ctr);
+        ctr += blocks;
+        xorStream(output, input, stream, l);
+        input += l;
+        output += l;
+        input_length -= l;
+    }
+}
 
-    int l = input_length/SRTP_BLOCK_SIZE;
-    for ( ctr = 0; ctr < l; ctr++ ) {
-        iv[14] = (uint8_t)((ctr & 0xFF00) >>  8);
-        iv[15] = (uint8_t)((ctr & 0x00FF));
+void SrtpSymCrypto::ctrStream(uint8_t* stream, uint32_t blocks, uint8_t* iv, uint16_t ctr) {
 
-        encrypt(iv, temp);
-        for (int i = 0; i < SRTP_BLOCK_SIZE; i++ ) {
-            *output++ = temp[i] ^ *input++;
+    if (algorithm == SrtpEncryptionTWOCM || algorithm == SrtpEncryptionTWOF8) {
+        // lay out the counter blocks and encrypt them in one call, which
+        // processes two blocks at a time
+        for (uint32_t i = 0; i < blocks; i++, ctr++) {
+            iv[14] = (uint8_t)((ctr & 0xFF00) >>  8);
+            iv[15] = (uint8_t)((ctr & 0x00FF));
+            memcpy(&stream[i * SRTP_BLOCK_SIZE], iv, SRTP_BLOCK_SIZE);
         }
-
+        Twofish_encrypt_blocks((Twofish_key*)key, (Twofish_Byte*)stream,
+                               (Twofish_Byte*)stream, blocks);
+        return;
     }
-    l = input_length % SRTP_BLOCK_SIZE;
-    if (l > 0) {
-        // Treat the last bytes:
+    for (uint32_t i = 0; i < blocks; i++, ctr++) {
         iv[14] = (uint8_t)((ctr & 0xFF00) >>  8);
         iv[15] = (uint8_t)((ctr & 0x00FF));
 
-        encrypt(iv, temp);
-        for (int i = 0; i < l; i++ ) {
-            *output++ = temp[i] ^ *input++;
-        }
+        encrypt(iv, &stream[i * SRTP_BLOCK_SIZE]);
     }
 }
 
 void SrtpSymCrypto::ctr_encrypt( uint8_t* data, uint32_t data_length, uint8_t* iv ) {
+    ctr_encrypt(data, data_length, data, iv);
+}
 
-    if (key == NULL)
-        return;
-    
-    uint16_t ctr = 0;
-    unsigned char temp[SRTP_BLOCK_SIZE];
+void SrtpSymCrypto::f8_encrypt(const uint8_t* data, uint32_t data_length, uint8_t* iv, SrtpSymCrypto* f8Cipher ) {
 
-    int l = data_length/SRTP_BLOCK_SIZE;
-    for (ctr = 0; ctr < l; ctr++ ) {
-        iv[14] = (uint8_t)((ctr & 0xFF00) >>  8);
-        iv[15] = (uint8_t)((ctr & 0x00FF));
+    f8_encrypt(data, data_length, const_cast<uint8_t*>(data), iv, f8Cipher);
+}
 
-        encrypt(iv, temp);
-        for (int i = 0; i < SRTP_BLOCK_SIZE; i++ ) {
-            *data++ ^= temp[i];
-        }
+bool SrtpSymCrypto::gcm_encrypt(uint8_t* data, uint32_t dataLen, const uint8_t* aad, uint32_t aadLen,
+                                const uint8_t* iv, uint8_t* tag, int32_t tagLen) {
 
-    }
-    l = data_length % SRTP_BLOCK_SIZE;
-    if (l > 0) {
-        // Treat the last bytes:
-        iv[14] = (uint8_t)((ctr & 0xFF00) >>  8);
-        iv[15] = (uint8_t)((ctr & 0x00FF));
+    if (modeCtx == NULL || algorithm != SrtpEncryptionAESGCM)
+        return false;
 
-        encrypt(iv, temp);
-        for (int i = 0; i < l; i++ ) {
-            *data++ ^= temp[i];
-        }
-    }
+    gcry_cipher_hd_t hd = static_cast<gcry_cipher_hd_t>(modeCtx);
 
+    if (gcry_cipher_setiv(hd, iv, 12) != 0)
+        return false;
+    if (aadLen > 0 && gcry_cipher_authenticate(hd, aad, aadLen) != 0)
+        return false;
+    if (gcry_cipher_encrypt(hd, data, dataLen, NULL, 0) != 0)
+        return false;
+    return gcry_cipher_gettag(hd, tag, tagLen) == 0;
 }
 
-void SrtpSymCrypto::f8_encrypt(const uint8_t* data, uint32_t data_length, uint8_t* iv, SrtpSymCrypto* f8Cipher ) {
+bool SrtpSymCrypto::gcm_decrypt(uint8_t* data, uint32_t dataLen, const uint8_t* aad, uint32_t aadLen,
+                                const uint8_t* iv, const uint8_t* tag, int32_t tagLen) {
 
-    f8_encrypt(data, data_length, const_cast<uint8_t*>(data), iv, f8Cipher);
+    if (modeCtx == NULL || algorithm != SrtpEncryptionAESGCM)
+        return false;
+
+    gcry_cipher_hd_t hd = static_cast<gcry_cipher_hd_t>(modeCtx);
+
+    if (gcry_cipher_setiv(hd, iv, 12) != 0)
+        return false;
+    if (aadLen > 0 && gcry_cipher_authenticate(hd, aad, aadLen) != 0)
+        return false;
+    if (gcry_cipher_decrypt(hd, data, dataLen, NULL, 0) != 0)
+        return false;
+    return gcry_cipher_checktag(hd, tag, tagLen) == 0;
 }
 
 #define MAX_KEYLEN 32
@@ -260,10 +302,9 @@ void SrtpSymCrypto::f8_deriveForIV(SrtpSymCrypto* f8Cipher, uint8_t* key, int32_
 void SrtpSymCrypto::f8_encrypt(const uint8_t* in, uint32_t in_length, uint8_t* out,
                          uint8_t* iv, SrtpSymCrypto* f8Cipher ) {
 
-    int offset = 0;
-
     unsigned char ivAccent[SRTP_BLOCK_SIZE];
     unsigned char S[SRTP_BLOCK_SIZE];
+    unsigned char stream[ctrStreamBlocks * SRTP_BLOCK_SIZE];
 
     F8_CIPHER_CTX f8ctx;
 
@@ -284,53 +325,55 @@ void SrtpSymCrypto::f8_encrypt(const uint8_t* in, uint32_t in_length, uint8_t* o
 
     memset(f8ctx.S, 0, SRTP_BLOCK_SIZE); // initial value for key stream
 
-    while (in_length >= SRTP_BLOCK_SIZE) {
-        processBlock(&f8ctx, in+offset, SRTP_BLOCK_SIZE, out+offset);
-        in_length -= SRTP_BLOCK_SIZE;
-        offset += SRTP_BLOCK_SIZE;
-    }
-    if (in_length > 0) {
-        processBlock(&f8ctx, in+offset, in_length, out+offset);
+    /*
+     * Compute the key stream some blocks at a time, then XOR the text with
+     * it in one pass. This keeps the loop chaining the cipher calls free of
+     * any other work.
+     */
+    while (in_length > 0) {
+        uint32_t l = sizeof(stream);
+        if (l > in_length)
+            l = in_length;
+        uint32_t blocks = (l + SRTP_BLOCK_SIZE - 1) / SRTP_BLOCK_SIZE;
+        f8Stream(&f8ctx, stream, blocks);
+        xorStream(out, in, stream, l);
+        in += l;
+        out += l;
+        in_length -= l;
     }
 }
 
-int SrtpSymCrypto::processBlock(F8_CIPHER_CTX *f8ctx, const uint8_t* in, int32_t length, uint8_t* out) {
+void SrtpSymCrypto::f8Stream(F8_CIPHER_CTX *f8ctx, uint8_t* stream, uint32_t blocks) {
 
-    int i;
-    const uint8_t *cp_in;
-    uint8_t* cp_in1, *cp_out;
-    uint32_t *ui32p;
+    uint32_t i;
 
     /*
-     * XOR the previous key stream with IV'
-     * ( S(-1) xor IV' )
+     * The counter does not depend on the key stream: first lay out
+     * IV' xor j for all blocks.
      */
-    cp_in = f8ctx->ivAccent;
-    cp_out = f8ctx->S;
-    for (i = 0; i < SRTP_BLOCK_SIZE; i++) {
-        *cp_out++ ^= *cp_in++;
+    for (i = 0; i < blocks; i++) {
+        uint8_t* block = &stream[i * SRTP_BLOCK_SIZE];
+        uint32_t j = htonl(f8ctx->J + i);
+        uint32_t w;
+
+        memcpy(block, f8ctx->ivAccent, SRTP_BLOCK_SIZE);
+        memcpy(&w, block + 12, sizeof(w));
+        w ^= j;
+        memcpy(block + 12, &w, sizeof(w));
     }
+    f8ctx->J += blocks;
+
     /*
-     * Now XOR (S(n-1) xor IV') with the current counter, then increment the counter
-     */
-    ui32p = (uint32_t *)f8ctx->S;
-    ui32p[3] ^= htonl(f8ctx->J);
-    f8ctx->J++;
-    /*
-     * Now compute the new key stream using encrypt
-     */
-    encrypt(f8ctx->S, f8ctx->S);
-    /*
-     * as the last step XOR the plain text with the key stream to produce
-     * the ciphertext.
+     * Now chain the blocks: S(n) = encrypt(IV' xor j xor S(n-1))
      */
-    cp_out = out;
-    cp_in = in;
-    cp_in1 = f8ctx->S;
-    for (i = 0; i < length; i++) {
-        *cp_out++ = *cp_in++ ^ *cp_in1++;
+    const uint8_t* prev = f8ctx->S;
+    for (i = 0; i < blocks; i++) {
+        uint8_t* block = &stream[i * SRTP_BLOCK_SIZE];
+        xorStream(block, block, prev, SRTP_BLOCK_SIZE);
+        encrypt(block, block);
+        prev = block;
     }
-    return length;
+    memcpy(f8ctx->S, prev, SRTP_BLOCK_SIZE);
 }
 
 /** EMACS **
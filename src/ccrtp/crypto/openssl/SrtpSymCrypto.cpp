@@ -39,24 +39,26 @@
 
 #include <stdlib.h>
 #include <openssl/aes.h>                // the include of openSSL
+#include <openssl/evp.h>
 #include <crypto/SrtpSymCrypto.h>
 #include <crypto/twofish.h>
 #include <string.h>
 #include <stdio.h>
 #include <arpa/inet.h>
 
-SrtpSymCrypto::SrtpSymCrypto(int algo):key(NULL), algorithm(algo) {
+SrtpSymCrypto::SrtpSymCrypto(int algo):key(NULL), modeCtx(NULL), algorithm(algo) {
 }
 
 SrtpSymCrypto::SrtpSymCrypto( uint8_t* k, int32_t keyLength, int algo ):
-    key(NULL), algorithm(algo) {
+    key(NULL), modeCtx(NULL), algorithm(algo) {
 
     setNewKey(k, keyLength);
 }
 
 SrtpSymCrypto::~SrtpSymCrypto() {
     if (key != NULL) {
-        if (algorithm == SrtpEncryptionAESCM || algorithm == SrtpEncryptionAESF8) {
+        if (algorithm == SrtpEncryptionAESCM || algorithm == SrtpEncryptionAESF8 ||
+            algorithm == SrtpEncryptionAESGCM) {
             memset(key, 0, sizeof(AES_KEY) );
         }
         else if (algorithm == SrtpEncryptionTWOCM || algorithm == SrtpEncryptionTWOF8) {
@@ -65,6 +67,10 @@ SrtpSymCrypto::~SrtpSymCrypto() {
         delete[] (uint8_t*)key;
         key = NULL;
     }
+    if (modeCtx != NULL) {
+        EVP_CIPHER_CTX_free(static_cast<EVP_CIPHER_CTX*>(modeCtx));
+        modeCtx = NULL;
+    }
 }
 
 static int twoFishInit = 0;
@@ -77,10 +83,28 @@ bool SrtpSymCrypto::setNewKey(const uint8_t* k, int32_t keyLength) {
     if (!(keyLength == 16 || keyLength == 32)) {
         return false;
     }
-    if (algorithm == SrtpEncryptionAESCM || algorithm == SrtpEncryptionAESF8) {
+    if (algorithm == SrtpEncryptionAESCM || algorithm == SrtpEncryptionAESF8 ||
+        algorithm == SrtpEncryptionAESGCM) {
         key = new uint8_t[sizeof(AES_KEY)];
         memset(key, 0, sizeof(AES_KEY) );
         AES_set_encrypt_key(k, keyLength*8, (AES_KEY *)key);
+
+        // counter mode and GCM run through EVP, which uses AES-NI and
+        // processes several blocks in parallel where available.
+        if (algorithm == SrtpEncryptionAESCM || algorithm == SrtpEncryptionAESGCM) {
+            if (modeCtx == NULL)
+                modeCtx = EVP_CIPHER_CTX_new();
+            const EVP_CIPHER* evp;
+            if (algorithm == SrtpEncryptionAESCM)
+                evp = (keyLength == 16) ? EVP_aes_128_ctr() : EVP_aes_256_ctr();
+            else
+                evp = (keyLength == 16) ? EVP_aes_128_gcm() : EVP_aes_256_gcm();
+            if (modeCtx != NULL &&
+                EVP_EncryptInit_ex(static_cast<EVP_CIPHER_CTX*>(modeCtx), evp, NULL, k, NULL) != 1) {
+                EVP_CIPHER_CTX_free(static_cast<EVP_CIPHER_CTX*>(modeCtx));
+                modeCtx = NULL;
+            }
+        }
     }
     else if (algorithm == SrtpEncryptionTWOCM || algorithm == SrtpEncryptionTWOF8) {
         if (!twoFishInit) {
@@ -99,7 +123,8 @@ bool SrtpSymCrypto::setNewKey(const uint8_t* k, int32_t keyLength) {
 
 
 void SrtpSymCrypto::encrypt(const uint8_t* input, uint8_t* output ) {
-    if (algorithm == SrtpEncryptionAESCM || algorithm == SrtpEncryptionAESF8) {
+    if (algorithm == SrtpEncryptionAESCM || algorithm == SrtpEncryptionAESF8 ||
+        algorithm == SrtpEncryptionAESGCM) {
         AES_encrypt(input, output, (AES_KEY *)key);
     }
     else if (algorithm == SrtpEncryptionTWOCM || algorithm == SrtpEncryptionTWOF8) {
@@ -110,24 +135,9 @@ void SrtpSymCrypto::encrypt(const uint8_t* input, uint8_t* output ) {
 
 void SrtpSymCrypto::get_ctr_cipher_stream(uint8_t* output, uint32_t length,
                                     uint8_t* iv ) {
-    uint16_t ctr = 0;
-    unsigned char temp[SRTP_BLOCK_SIZE];
-
-    for(ctr = 0; ctr < length/SRTP_BLOCK_SIZE; ctr++) {
-        //compute the cipher stream
-        iv[14] = (uint8_t)((ctr & 0xFF00) >>  8);
-        iv[15] = (uint8_t)((ctr & 0x00FF));
-
-        encrypt(iv, &output[ctr*SRTP_BLOCK_SIZE]);
-    }
-    if ((length % SRTP_BLOCK_SIZE) > 0) {
-        // Treat the last bytes:
-        iv[14] = (uint8_t)((ctr & 0xFF00) >>  8);
-        iv[15] = (uint8_t)((ctr & 0x00FF));
-
-        encrypt(iv, temp);
-        memcpy(&output[ctr*SRTP_BLOCK_SIZE], temp, length % SRTP_BLOCK_SIZE );
-    }
+    // the cipher stream is the encryption of zeros
+    memset(output, 0, length);
+    ctr_encrypt(output, length, iv);
 }
 
 void SrtpSymCrypto::ctr_encrypt(const uint8_t* input, uint32_t input_length,
@@ -136,69 +146,111 @@ void SrtpSymCrypto::ctr_encrypt(const uint8_t* input, uint32_t input_length,
     if (key == NULL)
         return;
 
+    // the last two octets of the IV hold the block counter
+    iv[14] = iv[15] = 0;
+
+    // a GCM key also derives the session keys in counter mode, but
+    // through the block cipher as its EVP context is not a CTR one
+    if (modeCtx != NULL && algorithm == SrtpEncryptionAESCM) {
+        EVP_CIPHER_CTX* ctx = static_cast<EVP_CIPHER_CTX*>(modeCtx);
+        int outLength;
+        if (EVP_EncryptInit_ex(ctx, NULL, NULL, NULL, iv) == 1 &&
+            EVP_EncryptUpdate(ctx, output, &outLength, input, input_length) == 1)
+            return;
+        // EVP rejects the call before processing any data, so fall
+        // back to the block cipher below rather than leave the
+        // data unencrypted.
+    }
+
     uint16_t ctr = 0;
-    unsigned char temp[SRTP_BLOCK_SIZE];
+    unsigned char stream[ctrStreamBlocks * SRTP_BLOCK_SIZE];
+
+    while (input_length > 0) {
+        uint32_t l = sizeof(stream);
+        if (l > input_length)
+            l = input_length;
+        uint32_t blocks = (l + SRTP_BLOCK_SIZE - 1) / SRTP_BLOCK_SIZE;
+        ctrStream(stream, blocks, iv, ctr);
+        ctr += blocks;
+        xorStream(output, input, stream, l);
+        input += l;
+        output += l;
+        input_length -= l;
+    }
+}
 
-    int l = input_length/SRTP_BLOCK_SIZE;
-    for (ctr = 0; ctr < l; ctr++ ) {
-        iv[14] = (uint8_t)((ctr & 0xFF00) >>  8);
-        iv[15] = (uint8_t)((ctr & 0x00FF));
+void SrtpSymCrypto::ctrStream(uint8_t* stream, uint32_t blocks, uint8_t* iv, uint16_t ctr) {
 
-        encrypt(iv, temp);
-        for (int i = 0; i < SRTP_BLOCK_SIZE; i++ ) {
-            *output++ = temp[i] ^ *input++;
+    if (algorithm == SrtpEncryptionTWOCM || algorithm == SrtpEncryptionTWOF8) {
+        // lay out the counter blocks and encrypt them in one call, which
+        // processes two blocks at a time
+        for (uint32_t i = 0; i < blocks; i++, ctr++) {
+            iv[14] = (uint8_t)((ctr & 0xFF00) >>  8);
+            iv[15] = (uint8_t)((ctr & 0x00FF));
+            memcpy(&stream[i * SRTP_BLOCK_SIZE], iv, SRTP_BLOCK_SIZE);
         }
-
+        Twofish_encrypt_blocks((Twofish_key*)key, (Twofish_Byte*)stream,
+                               (Twofish_Byte*)stream, blocks);
+        return;
     }
-    l = input_length % SRTP_BLOCK_SIZE;
-    if (l > 0) {
-        // Treat the last bytes:
+    for (uint32_t i = 0; i < blocks; i++, ctr++) {
         iv[14] = (uint8_t)((ctr & 0xFF00) >>  8);
         iv[15] = (uint8_t)((ctr & 0x00FF));
 
-        encrypt(iv, temp);
-        for (int i = 0; i < l; i++ ) {
-            *output++ = temp[i] ^ *input++;
-        }
+        encrypt(iv, &stream[i * SRTP_BLOCK_SIZE]);
     }
 }
 
 void SrtpSymCrypto::ctr_encrypt( uint8_t* data, uint32_t data_length, uint8_t* iv ) {
+    ctr_encrypt(data, data_length, data, iv);
+}
 
-    if (key == NULL)
-        return;
+void SrtpSymCrypto::f8_encrypt(const uint8_t* data, uint32_t data_length,
+                         uint8_t* iv, SrtpSymCrypto* f8Cipher ) {
 
-    uint16_t ctr = 0;
-    unsigned char temp[SRTP_BLOCK_SIZE];
+    f8_encrypt(data, data_length, const_cast<uint8_t*>(data), iv, f8Cipher);
+}
 
-    int l = data_length/SRTP_BLOCK_SIZE;
-    for (ctr = 0; ctr < l; ctr++ ) {
-        iv[14] = (uint8_t)((ctr & 0xFF00) >>  8);
-        iv[15] = (uint8_t)((ctr & 0x00FF));
+bool SrtpSymCrypto::gcm_encrypt(uint8_t* data, uint32_t dataLen, const uint8_t* aad, uint32_t aadLen,
+                                const uint8_t* iv, uint8_t* tag, int32_t tagLen) {
 
-        encrypt(iv, temp);
-        for (int i = 0; i < SRTP_BLOCK_SIZE; i++ ) {
-            *data++ ^= temp[i];
-        }
+    if (modeCtx == NULL || algorithm != SrtpEncryptionAESGCM)
+        return false;
 
-    }
-    l = data_length % SRTP_BLOCK_SIZE;
-    if (l > 0) {
-        // Treat the last bytes:
-        iv[14] = (uint8_t)((ctr & 0xFF00) >>  8);
-        iv[15] = (uint8_t)((ctr & 0x00FF));
+    EVP_CIPHER_CTX* ctx = static_cast<EVP_CIPHER_CTX*>(modeCtx);
+    int outLength;
 
-        encrypt(iv, temp);
-        for (int i = 0; i < l; i++ ) {
-            *data++ ^= temp[i];
-        }
-    }
+    // the default IV length of GCM is the 12 bytes used by SRTP
+    if (EVP_CipherInit_ex(ctx, NULL, NULL, NULL, iv, 1) != 1)
+        return false;
+    if (aadLen > 0 && EVP_CipherUpdate(ctx, NULL, &outLength, aad, aadLen) != 1)
+        return false;
+    if (dataLen > 0 && EVP_CipherUpdate(ctx, data, &outLength, data, dataLen) != 1)
+        return false;
+    if (EVP_CipherFinal_ex(ctx, data + dataLen, &outLength) != 1)
+        return false;
+    return EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, tagLen, tag) == 1;
 }
 
-void SrtpSymCrypto::f8_encrypt(const uint8_t* data, uint32_t data_length,
-                         uint8_t* iv, SrtpSymCrypto* f8Cipher ) {
+bool SrtpSymCrypto::gcm_decrypt(uint8_t* data, uint32_t dataLen, const uint8_t* aad, uint32_t aadLen,
+                                const uint8_t* iv, const uint8_t* tag, int32_t tagLen) {
 
-    f8_encrypt(data, data_length, const_cast<uint8_t*>(data), iv, f8Cipher);
+    if (modeCtx == NULL || algorithm != SrtpEncryptionAESGCM)
+        return false;
+
+    EVP_CIPHER_CTX* ctx = static_cast<EVP_CIPHER_CTX*>(modeCtx);
+    int outLength;
+
+    if (EVP_CipherInit_ex(ctx, NULL, NULL, NULL, iv, 0) != 1)
+        return false;
+    if (aadLen > 0 && EVP_CipherUpdate(ctx, NULL, &outLength, aad, aadLen) != 1)
+        return false;
+    if (dataLen > 0 && EVP_CipherUpdate(ctx, data, &outLength, data, dataLen) != 1)
+        return false;
+    if (EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, tagLen, const_cast<uint8_t*>(tag)) != 1)
+        return false;
+    // the tag is checked when finishing the decryption
+    return EVP_CipherFinal_ex(ctx, data + dataLen, &outLength) == 1;
 }
 
 #define MAX_KEYLEN 32
@@ -242,16 +294,15 @@ void SrtpSymCrypto::f8_deriveForIV(SrtpSymCrypto* f8Cipher, uint8_t* key, int32_
 void SrtpSymCrypto::f8_encrypt(const uint8_t* in, uint32_t in_length, uint8_t* out,
                          uint8_t* iv, SrtpSymCrypto* f8Cipher ) {
 
-
-    int offset = 0;
-
     unsigned char ivAccent[SRTP_BLOCK_SIZE];
     unsigned char S[SRTP_BLOCK_SIZE];
+    unsigned char stream[ctrStreamBlocks * SRTP_BLOCK_SIZE];
 
     F8_CIPHER_CTX f8ctx;
 
     if (key == NULL)
         return;
+
     /*
      * Get memory for the derived IV (IV')
      */
@@ -261,61 +312,62 @@ void SrtpSymCrypto::f8_encrypt(const uint8_t* in, uint32_t in_length, uint8_t* o
      */
     f8Cipher->encrypt(iv, f8ctx.ivAccent);
 
-    f8ctx.J = 0;                       // initialize the counter
-    f8ctx.S = S;               // get the key stream buffer
+    f8ctx.J = 0;                        // initialize the counter
+    f8ctx.S = S;                        // get the key stream buffer
 
     memset(f8ctx.S, 0, SRTP_BLOCK_SIZE); // initial value for key stream
 
-    while (in_length >= SRTP_BLOCK_SIZE) {
-        processBlock(&f8ctx, in+offset, SRTP_BLOCK_SIZE, out+offset);
-        in_length -= SRTP_BLOCK_SIZE;
-        offset += SRTP_BLOCK_SIZE;
-    }
-    if (in_length > 0) {
-        processBlock(&f8ctx, in+offset, in_length, out+offset);
+    /*
+     * Compute the key stream some blocks at a time, then XOR the text with
+     * it in one pass. This keeps the loop chaining the cipher calls free of
+     * any other work.
+     */
+    while (in_length > 0) {
+        uint32_t l = sizeof(stream);
+        if (l > in_length)
+            l = in_length;
+        uint32_t blocks = (l + SRTP_BLOCK_SIZE - 1) / SRTP_BLOCK_SIZE;
+        f8Stream(&f8ctx, stream, blocks);
+        xorStream(out, in, stream, l);
+        in += l;
+        out += l;
+        in_length -= l;
     }
 }
 
-int SrtpSymCrypto::processBlock(F8_CIPHER_CTX *f8ctx, const uint8_t* in, int32_t length, uint8_t* out) {
+void SrtpSymCrypto::f8Stream(F8_CIPHER_CTX *f8ctx, uint8_t* stream, uint32_t blocks) {
 
-    int i;
-    const uint8_t *cp_in;
-    uint8_t* cp_in1, *cp_out;
-    uint32_t *ui32p;
+    uint32_t i;
 
     /*
-     * XOR the previous key stream with IV'
-     * ( S(-1) xor IV' )
+     * The counter does not depend on the key stream: first lay out
+     * IV' xor j for all blocks.
      */
-    cp_in = f8ctx->ivAccent;
-    cp_out = f8ctx->S;
-    for (i = 0; i < SRTP_BLOCK_SIZE; i++) {
-        *cp_out++ ^= *cp_in++;
+    for (i = 0; i < blocks; i++) {
+        uint8_t* block = &stream[i * SRTP_BLOCK_SIZE];
+        uint32_t j = htonl(f8ctx->J + i);
+        uint32_t w;
+
+        memcpy(block, f8ctx->ivAccent, SRTP_BLOCK_SIZE);
+        memcpy(&w, block + 12, sizeof(w));
+        w ^= j;
+        memcpy(block + 12, &w, sizeof(w));
     }
+    f8ctx->J += blocks;
+
     /*
-     * Now XOR (S(n-1) xor IV') with the current counter, then increment the counter
-     */
-    ui32p = (uint32_t *)f8ctx->S;
-    ui32p[3] ^= htonl(f8ctx->J);
-    f8ctx->J++;
-    /*
-     * Now compute the new key stream using AES encrypt
-     */
-    encrypt(f8ctx->S, f8ctx->S);
-    /*
-     * as the last step XOR the plain text with the key stream to produce
-     * the ciphertext.
+     * Now chain the blocks: S(n) = encrypt(IV' xor j xor S(n-1))
      */
-    cp_out = out;
-    cp_in = in;
-    cp_in1 = f8ctx->S;
-    for (i = 0; i < length; i++) {
-        *cp_out++ = *cp_in++ ^ *cp_in1++;
+    const uint8_t* prev = f8ctx->S;
+    for (i = 0; i < blocks; i++) {
+        uint8_t* block = &stream[i * SRTP_BLOCK_SIZE];
+        xorStream(block, block, prev, SRTP_BLOCK_SIZE);
+        encrypt(block, block);
+        prev = block;
     }
-    return length;
+    memcpy(f8ctx->S, prev, SRTP_BLOCK_SIZE);
 }
 
-
 /** EMACS **
  * Local variables:
  * mode: c++
@@ -186,6 +186,29 @@ extern void Twofish_encrypt(
                             ); 
  
  
+/**
+ * Encrypt several blocks of data. 
+ * 
+ * This function encrypts consecutive blocks of 16 bytes, each one on 
+ * its own as Twofish_encrypt() does. Two blocks are processed at a time 
+ * with their rounds interleaved, so that the table lookups of one block 
+ * overlap with those of the other. This is meant for modes where the 
+ * blocks are independent, such as computing a CTR mode key stream. 
+ * 
+ * @param xkey     pointer to Twofish_key, internal form of the key 
+ *                 produces by Twofish_prepare_key() 
+ * @param p        Plaintext to be encrypted, n*16 bytes 
+ * @param c        Place to store the ciphertext, may be the same as p 
+ * @param n        Number of blocks 
+ */ 
+extern void Twofish_encrypt_blocks(  
+                            Twofish_key * xkey, 
+                            Twofish_Byte p[],  
+                            Twofish_Byte c[], 
+                            int n 
+                            ); 
+ 
+ 
 /**
  * Decrypt a single block of data. 
  * 
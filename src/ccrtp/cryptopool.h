@@ -0,0 +1,175 @@
+// Copyright (C) 2026 the GNU ccRTP contributors.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+//
+// As a special exception, you may use this file as part of a free software
+// library without restriction.  Specifically, if other files instantiate
+// templates or use macros or inline functions from this file, or you compile
+// this file and link it with other files to produce an executable, this
+// file does not by itself cause the resulting executable to be covered by
+// the GNU General Public License.  This exception does not however
+// invalidate any other reasons why the executable file might be covered by
+// the GNU General Public License.
+//
+// This exception applies only to the code released under the name GNU
+// ccRTP.  If you copy code from other releases into a copy of GNU
+// ccRTP, as the General Public License permits, the exception does
+// not apply to the code that you add in this way.  To avoid misleading
+// anyone as to the status of such modified files, you must delete
+// this exception notice from them.
+//
+// If you write modifications of your own for GNU ccRTP, it is your choice
+// whether to permit this exception to apply to your modifications.
+// If you do not wish that, delete this exception notice.
+//
+
+/**
+ * @file cryptopool.h
+ * @short Worker threads for SRTP processing of data packets.
+ **/
+
+#ifndef CCXX_RTP_CRYPTOPOOL_H_
+#define CCXX_RTP_CRYPTOPOOL_H_
+
+#include <ccrtp/rtppkt.h>
+
+NAMESPACE_COMMONCPP
+
+/**
+ * @class SRTPCryptoPool
+ *
+ * A pool of worker threads that protect and unprotect SRTP data
+ * packets on behalf of one or more data queues, so that the SRTP
+ * work of a session is spread over several processors and taken off
+ * the threads that put and take in the packets.
+ *
+ * A crypto context holds the cipher and MAC state of one stream and
+ * is not thread safe, so all the work for a stream goes to the same
+ * worker, selected by a key (the SSRC of received packets). Jobs
+ * submitted with the same key are run in submission order, which
+ * preserves the order and the ROC updates of each stream.
+ *
+ * @see IncomingDataQueue::setInQueueCryptoPool
+ * @see OutgoingDataQueue::setOutQueueCryptoPool
+ **/
+class __EXPORT SRTPCryptoPool
+{
+public:
+    /**
+     * @class Job
+     * A unit of work run by a worker thread.
+     **/
+    class Job
+    {
+    public:
+        Job() : next(NULL)
+        { }
+
+        virtual ~Job()
+        { }
+
+        /**
+         * Called in the worker thread. The job may delete itself.
+         **/
+        virtual void
+        run() = 0;
+
+    private:
+        friend class SRTPCryptoPool;
+        // worker queues are linked through the jobs.
+        Job* next;
+    };
+
+    /**
+     * Create the pool and start its worker threads.
+     *
+     * @param nthreads number of worker threads, 0 for one per
+     * online processor.
+     * @param pri optional thread priority value.
+     **/
+    SRTPCryptoPool(unsigned int nthreads = 0, int pri = 0);
+
+    /**
+     * Run the jobs still queued and stop the worker threads.
+     **/
+    ~SRTPCryptoPool();
+
+    /**
+     * Get the number of worker threads of this pool.
+     *
+     * @return number of workers.
+     **/
+    inline unsigned int
+    getWorkerCount() const
+    { return workerCount; }
+
+    /**
+     * Queue a job to the worker selected by a key. Jobs with the
+     * same key are run in submission order.
+     *
+     * @param key selects the worker, usually an SSRC.
+     * @param job job to run.
+     **/
+    void
+    submit(uint32 key, Job* job);
+
+    /**
+     * Unprotect a batch of received packets, spreading the
+     * packets of different sources over the workers. The calling
+     * thread takes part and returns when all the packets have
+     * been processed. See IncomingRTPPkt::unprotectBatch().
+     *
+     * @param pkts array of packets to unprotect.
+     * @param pccs SRTP CryptoContext of each packet, NULL for
+     * packets not protected.
+     * @param results receives the value IncomingRTPPkt::unprotect()
+     * would return for each packet.
+     * @param count number of packets in the arrays.
+     **/
+    void
+    unprotectBatch(IncomingRTPPkt** pkts, CryptoContext** pccs,
+               int32* results, size_t count);
+
+private:
+    SRTPCryptoPool(const SRTPCryptoPool&);
+
+    SRTPCryptoPool&
+    operator=(const SRTPCryptoPool&);
+
+    /**
+     * Get the index of the worker jobs with a key are run by.
+     **/
+    inline unsigned int
+    getWorkerIndex(uint32 key) const
+    { return ((key * 0x9e3779b1U) >> 16) % workerCount; }
+
+    class Worker;
+    class UnprotectJob;
+    friend class Worker;
+
+    Worker** workers;
+    unsigned int workerCount;
+};
+
+END_NAMESPACE
+
+#endif  //CCXX_RTP_CRYPTOPOOL_H_
+
+/** EMACS **
+ * Local variables:
+ * mode: c++
+ * c-basic-offset: 8
+ * End:
+ */
@@ -46,6 +46,8 @@
 
 #include <ccrtp/queuebase.h>
 #include <ccrtp/CryptoContext.h>
+#include <ccrtp/CryptoContextTable.h>
+#include <ccrtp/cryptopool.h>
 
 #include <list>
 
@@ -163,6 +165,13 @@ public:
     setNetworkAddress(SyncSource& source, InetAddress addr)
     { source.setNetworkAddress(addr); }
 
+    /**
+     * Get how many AppDataUnit objects refer to a source.
+     **/
+    inline uint32
+    getDataUnitsCount(const SyncSource& source) const
+    { return source.dataUnits; }
+
 protected:
     SyncSourceHandler()
     { }
@@ -352,7 +361,7 @@ protected:
     struct IncomingRTPPktLink
     {
         IncomingRTPPktLink(IncomingRTPPkt* pkt, SyncSourceLink* sLink,
-                   struct timeval& recv_ts,
+                   const struct timeval& recv_ts,
                    uint32 shifted_ts,
                    IncomingRTPPktLink* sp,
                    IncomingRTPPktLink* sn,
@@ -363,12 +372,26 @@ protected:
             prev(p), next(n),
             srcPrev(sp), srcNext(sn),
             receptionTime(recv_ts),
-            shiftedTimestamp(shifted_ts)
+            shiftedTimestamp(shifted_ts),
+            extSeqNum(0)
         { }
 
         ~IncomingRTPPktLink()
         { }
 
+        // links may be allocated from a RTPBlockPool
+        inline static void* operator new(size_t size)
+        { return RTPBlockPool::allocate(size,NULL); }
+
+        inline static void* operator new(size_t size, RTPBlockPool* pool)
+        { return RTPBlockPool::allocate(size,pool); }
+
+        inline static void operator delete(void* p)
+        { RTPBlockPool::deallocate(p); }
+
+        inline static void operator delete(void* p, RTPBlockPool*)
+        { RTPBlockPool::deallocate(p); }
+
         inline SyncSourceLink* getSourceLink() const
         { return sourceLink; }
 
@@ -435,6 +458,17 @@ protected:
         inline void setTimestamp(uint32 ts)
         { shiftedTimestamp = ts;}
 
+        /**
+         * Get the sequence number of the packet extended with
+         * the number of cycles, as computed when it was inserted
+         * in the reordering ring of its source.
+         **/
+        inline uint32 getExtSeqNum() const
+        { return extSeqNum; }
+
+        inline void setExtSeqNum(uint32 seq)
+        { extSeqNum = seq; }
+
         // the packet this link refers to.
         IncomingRTPPkt* packet;
         // the synchronization source this packet comes from.
@@ -449,6 +483,8 @@ protected:
         // substracting the initial timestamp for its source
         // (it is an increment from the initial timestamp).
         uint32 shiftedTimestamp;
+        // extended sequence number (reordering ring index).
+        uint32 extSeqNum;
     };
 
     /**
@@ -477,11 +513,12 @@ protected:
                    IncomingRTPPktLink* fp = NULL,
                    IncomingRTPPktLink* lp = NULL,
                    SyncSourceLink* ps = NULL,
-                   SyncSourceLink* ns = NULL,
-                   SyncSourceLink* ncollis = NULL) :
+                   SyncSourceLink* ns = NULL) :
             membership(m), source(s), first(fp), last(lp),
-            prev(ps), next(ns), nextCollis(ncollis),
-            prevConflict(NULL)
+            prev(ps), next(ns),
+            prevConflict(NULL), ring(NULL), ringBits(NULL), ringMask(0),
+            ringMaxSeqNum(0), prevExpiry(NULL), nextExpiry(NULL),
+            expiryTime(0), expirySlot(-1)
         { m->setLink(*s,this); // record that the source is associated
           initStats();         // to this link.
         }
@@ -538,18 +575,6 @@ protected:
         inline void setNext(SyncSourceLink *ns)
         { next = ns; }
 
-        /**
-         * Get the link object for the next RTP source in the
-         * hash table entry collision list.  Note that
-         * collision does not refer to SSRC collision, but
-         * hash table collision.
-         **/
-        inline SyncSourceLink* getNextCollis()
-        { return nextCollis; }
-
-        inline void setNextCollis(SyncSourceLink* ns)
-        { nextCollis = ns; }
-
         inline ConflictingTransportAddress* getPrevConflict() const
         { return prevConflict; }
 
@@ -578,6 +603,21 @@ protected:
         inline timeval getLastRTCPSRTime() const
         { return lastRTCPSRTime; }
 
+        /**
+         * Get the next source in the list returned by
+         * MembershipBookkeeping::takeExpirationDue().
+         **/
+        inline SyncSourceLink* getNextExpiry() const
+        { return nextExpiry; }
+
+        /**
+         * Get the time the expiration check of this source was
+         * last scheduled for, in seconds, 0 if as soon as
+         * possible.
+         **/
+        inline uint32 getExpiryTime() const
+        { return expiryTime; }
+
         /**
          * Get the total number of RTP packets received from this
          * source.
@@ -738,6 +778,110 @@ protected:
          **/
         void computeStats();
 
+        /**
+         * Update the extended highest sequence number and the
+         * cumulative packet lost, as each valid data packet is
+         * received.
+         **/
+        void updateCumulativeStats();
+
+        /**
+         * Compute the fraction of packets lost since the last
+         * time it was computed, i.e. since the last report
+         * about this source.
+         **/
+        void computeFractionLost();
+
+        /**
+         * Get the packet in the queue of this source with a given
+         * extended sequence number, through the reordering ring.
+         *
+         * @return the packet link, NULL if not indexed.
+         **/
+        inline IncomingRTPPktLink* getRingEntry(uint32 seq) const
+        { IncomingRTPPktLink* pl = ring ? ring[seq & ringMask] : NULL;
+          return (pl && pl->getExtSeqNum() == seq)? pl : NULL; }
+
+        /**
+         * Whether a extended sequence number is within the last
+         * ring size sequence numbers. All the queued packets
+         * within this window are indexed.
+         **/
+        inline bool isInRingWindow(uint32 seq) const
+        { return (ringMaxSeqNum - seq) <= ringMask; }
+
+        /**
+         * Start the reordering window at the first packet
+         * inserted in the (empty) queue of this source.
+         **/
+        inline void setRingBase(uint16 seq)
+        { ringMaxSeqNum = extendSeqNum(seq); }
+
+        /**
+         * Index a packet just inserted in the queue of this source.
+         **/
+        void setRingEntry(IncomingRTPPktLink* pl);
+
+        /**
+         * Remove a packet being unlinked from the queue of this
+         * source from the reordering ring.
+         **/
+        inline void clearRingEntry(const IncomingRTPPktLink* pl)
+        { uint32 i = pl->getExtSeqNum() & ringMask;
+          if ( ring && ring[i] == pl ) {
+                ring[i] = NULL;
+                ringBits[i >> 6] &= ~(static_cast<uint64>(1) << (i & 63));
+          } }
+
+        /**
+         * Get the indexed packet closest before a extended
+         * sequence number within the ring window. Empty slots
+         * are skipped a word of the occupancy bitmap at a time.
+         *
+         * @return the packet link, NULL if there is none.
+         **/
+        IncomingRTPPktLink* getRingPrev(uint32 seq) const;
+
+        /**
+         * Get the indexed packet closest after a extended
+         * sequence number within the ring window.
+         *
+         * @return the packet link, NULL if there is none.
+         **/
+        IncomingRTPPktLink* getRingNext(uint32 seq) const;
+
+        /**
+         * Allocate a reordering ring with a number of slots (a
+         * power of two) and index the packets already queued.
+         **/
+        void setRingSize(uint32 size);
+
+        inline uint32 getRingSize() const
+        { return ring ? ringMask + 1 : 0; }
+
+        /**
+         * Get the number of packets discarded by the playout
+         * buffer because they arrived after their turn.
+         **/
+        inline uint32 getPlayoutLateCount() const
+        { return playoutLate; }
+
+        /**
+         * Get the number of packets that were not available at
+         * their playout time.
+         **/
+        inline uint32 getPlayoutConcealedCount() const
+        { return playoutConcealed; }
+
+        inline microtimeout_t getPlayoutDelay() const
+        { return playoutDelay; }
+
+        /**
+         * Extend a sequence number with the number of cycles,
+         * relative to the highest one indexed in the ring.
+         **/
+        uint32 extendSeqNum(uint16 seq) const;
+
         MembershipBookkeeping* membership;
         // The source this link object refers to.
         SyncSource* source;
@@ -746,8 +890,6 @@ protected:
         // Links for synchronization sources located before
         // and after this one in the list of sources.
         SyncSourceLink* prev, * next;
-        // Prev and next inside the hash table collision list.
-        SyncSourceLink* nextCollis;
         ConflictingTransportAddress* prevConflict;
         unsigned char* senderInfo;
         unsigned char* receiverInfo;
@@ -788,6 +930,33 @@ protected:
         uint32 expectedPrior;
         uint32 receivedPrior;
         uint32 seqNumAccum;
+
+        // reordering ring of queued packets, indexed by
+        // extended sequence number (see setRecvRingSize()).
+        IncomingRTPPktLink** ring;
+        // one bit per ring slot, set for the slots in use.
+        uint64* ringBits;
+        uint32 ringMask;
+        uint32 ringMaxSeqNum;
+
+        // adaptive playout (see getPlayoutData()).
+        // mean transit time, in microseconds, plus a constant.
+        int64 transitMean;
+        // playout time of a packet minus its (shifted)
+        // timestamp, in microseconds.
+        int64 playoutOffset;
+        microtimeout_t playoutDelay;
+        uint32 playoutLate;
+        uint32 playoutConcealed;
+        uint16 playoutNextSeqNum;
+        bool playoutStarted;
+
+        // expiration checks timer wheel (see
+        // MembershipBookkeeping::scheduleExpiration()).
+        SyncSourceLink* prevExpiry, * nextExpiry;
+        uint32 expiryTime;
+        // wheel slot, -1 if not scheduled.
+        int32 expirySlot;
     };
 
     /**
@@ -821,6 +990,18 @@ protected:
     bool
     BYESource(uint32 ssrc);
 
+    /**
+     * Change the state of a source, keeping the number of
+     * members up to date. Sources in stateInactive and
+     * stateLeaving are not counted, and are counted again when
+     * they come back.
+     *
+     * @param source synchronization source.
+     * @param ns new state.
+     **/
+    void
+    setState(SyncSource& source, SyncSource::State ns);
+
     /**
      * Remove the description of the source identified by
      * <code>ssrc</code>
@@ -831,6 +1012,52 @@ protected:
     bool
     removeSource(uint32 ssrc);
 
+    /**
+     * Get the next source to report about in RTCP report
+     * blocks. The sources are taken round the list, and the
+     * position is kept from one report to the next, so that
+     * every source is eventually reported however many there
+     * are.
+     *
+     * @return the next source, NULL if there are none.
+     **/
+    SyncSourceLink*
+    nextReportSource();
+
+    /**
+     * Get the number of sources in the list of sources,
+     * including those not counted as members.
+     **/
+    inline uint32
+    getSourcesCount() const
+    { return sourcesCount; }
+
+    /**
+     * Schedule the next expiration check of a source, replacing
+     * the one scheduled before if any.
+     *
+     * Checks are kept in a hierarchical timer wheel, so that
+     * scheduling a check and taking the checks due cost O(1)
+     * per source, whatever the number of members.
+     *
+     * @param link the source.
+     * @param when time of the check, in seconds (as
+     * timeval.tv_sec). 0 to check it as soon as possible.
+     **/
+    void
+    scheduleExpiration(SyncSourceLink& link, uint32 when);
+
+    /**
+     * Take the sources whose expiration check is due. They are
+     * no longer scheduled.
+     *
+     * @param now current time, in seconds.
+     * @return the first source due, the others follow through
+     * SyncSourceLink::getNextExpiry(). NULL if none is due.
+     **/
+    SyncSourceLink*
+    takeExpirationDue(uint32 now);
+
     inline SyncSourceLink* getFirst()
     { return first; }
 
@@ -849,6 +1076,14 @@ protected:
     getSendersCount()
     { return Members::getSendersCount(); }
 
+    inline void
+    increaseSendersCount()
+    { Members::increaseSendersCount(); }
+
+    inline void
+    decreaseSendersCount()
+    { Members::decreaseSendersCount(); }
+
     static const size_t defaultMembersHashSize;
     static const uint32 SEQNUMMOD;
 
@@ -865,11 +1100,71 @@ private:
     void
     endMembers();
 
-    // Hash table with sources of RTP and RTCP packets
-    uint32 sourceBucketsNum;
-    SyncSourceLink** sourceLinks;
+    struct SourceSlot
+    {
+        uint32 ssrc;
+        // NULL if the slot is empty.
+        SyncSourceLink* link;
+    };
+
+    /**
+     * Find the slot of <code>ssrc</code> in a table, or the empty
+     * slot where it would be inserted.
+     **/
+    static SourceSlot*
+    findSourceSlot(SourceSlot* slots, uint32 mask, uint32 ssrc);
+
+    /**
+     * Look for <code>ssrc</code> in the table and, while it is
+     * being resized, in the previous one.
+     *
+     * @return the link of the source, NULL if not registered.
+     **/
+    SyncSourceLink*
+    findSource(uint32 ssrc);
+
+    /**
+     * Move some slots of the previous table into the current one,
+     * or all of them if <code>all</code> is true.
+     **/
+    void
+    rehashSourceSlots(bool all);
+
+    /**
+     * Allocate a table twice as big and start moving the sources
+     * into it.
+     **/
+    void
+    growSourceSlots();
+
+    void
+    unscheduleExpiration(SyncSourceLink& link);
+
+    void
+    placeExpiration(SyncSourceLink& link, uint32 when);
+
+    // Hash table with sources of RTP and RTCP packets, open
+    // addressing with linear probing, its size a power of two.
+    SourceSlot* sourceSlots;
+    uint32 sourceSlotsMask;
+    uint32 sourceSlotsUsed;
+    // Previous table, its sources are moved into sourceSlots a
+    // few at a time after the table grows. NULL if none.
+    SourceSlot* oldSourceSlots;
+    uint32 oldSourceSlotsMask;
+    uint32 oldSourceSlotsNext;
+    // Timer wheel of the expiration checks: two levels of
+    // expiryWheelSlots lists of sources, one second per slot in the
+    // first level and expiryWheelSlots seconds in the second.
+    enum { expiryWheelSlots = 64 };
+    SyncSourceLink* expiryWheel[2 * expiryWheelSlots];
+    // time the checks have been taken up to, in seconds.
+    uint32 expiryWheelTime;
     // List of sources, ordered from older to newer
     SyncSourceLink* first, * last;
+    uint32 sourcesCount;
+    // next source to report about, NULL to start from first.
+    SyncSourceLink* reportNext;
 };
 
 /**
@@ -939,6 +1234,18 @@ public:
     SyncSourcesIterator end()
     { return SyncSourcesIterator(NULL); }
 
+    /**
+     * Lock the list of synchronization sources, so that no source
+     * is deleted while it is walked with begin() and end() from
+     * a thread other than the service one. Only needed when
+     * source removal is enabled (see setSourceRemoval()).
+     **/
+    inline void lockSourcesList() const
+    { sourcesLock.readLock(); }
+
+    inline void unlockSourcesList() const
+    { sourcesLock.unlock(); }
+
     /**
      * Retreive data from a specific timestamped packet if such a
      * packet is currently available in the receive buffer.
@@ -952,6 +1259,110 @@ public:
     getData(uint32 stamp, const SyncSource* src = NULL);
 
 
+    /**
+     * Retrieve the next data unit that is due for playout, through
+     * an adaptive jitter buffer. The playout time of each packet
+     * is its timestamp plus the mean transit time of its source
+     * plus a playout delay. The delay is recomputed at the start
+     * of each talkspurt as a multiple of the interarrival jitter of
+     * the source, within the limits given by setPlayoutDelay().
+     * Only packets with the marker bit set and a payload type for
+     * which setPlayoutTalkspurtMarker() is enabled start a
+     * talkspurt.
+     *
+     * Packets are retrieved in sequence number order. Packets that
+     * arrive after the packet that follows them has been retrieved
+     * are discarded as late. The number of packets missing when
+     * retrieving the packet that follows them is accounted as
+     * concealed, see getPlayoutConcealedCount().
+     *
+     * @param now current time.
+     * @param src synchronization source. If NULL, the source of
+     * the first packet in the queue.
+     * @return data unit due for playout, NULL if there is none yet.
+     **/
+    const AppDataUnit*
+    getPlayoutData(const timeval& now, const SyncSource* src = NULL);
+
+    /**
+     * Set the limits of the adaptive playout delay (see
+     * getPlayoutData()).
+     *
+     * @param min minimum delay, in microseconds.
+     * @param max maximum delay, in microseconds.
+     **/
+    inline void
+    setPlayoutDelay(microtimeout_t min, microtimeout_t max)
+    { minPlayoutDelay = min; maxPlayoutDelay = (max < min)? min : max; }
+
+    inline microtimeout_t
+    getMinPlayoutDelay() const
+    { return minPlayoutDelay; }
+
+    inline microtimeout_t
+    getMaxPlayoutDelay() const
+    { return maxPlayoutDelay; }
+
+    /**
+     * Set whether the marker bit of packets of a payload type
+     * signals the start of a talkspurt, at which getPlayoutData()
+     * adapts the playout delay. This holds for audio (RFC 3551),
+     * whereas for video the marker bit signals the last packet of
+     * a frame. By default it is enabled for the static audio
+     * payload types only.
+     *
+     * @param pt payload type.
+     * @param enable whether the marker bit starts a talkspurt.
+     **/
+    inline void
+    setPlayoutTalkspurtMarker(PayloadType pt, bool enable)
+    { if ( enable )
+            talkspurtMarkerTypes[(pt & 0x7f) >> 5] |= 1u << (pt & 0x1f);
+      else
+            talkspurtMarkerTypes[(pt & 0x7f) >> 5] &= ~(1u << (pt & 0x1f)); }
+
+    inline bool
+    isPlayoutTalkspurtMarker(PayloadType pt) const
+    { return 0 != (talkspurtMarkerTypes[(pt & 0x7f) >> 5] &
+               (1u << (pt & 0x1f))); }
+
+    /**
+     * Get the current playout delay for a source.
+     *
+     * @param src synchronization source.
+     * @return delay, in microseconds.
+     **/
+    inline microtimeout_t
+    getPlayoutDelay(const SyncSource& src) const
+    { return isMine(src)? getLink(src)->getPlayoutDelay() : 0; }
+
+    /**
+     * Get the number of packets from a source discarded by
+     * getPlayoutData() because they arrived too late.
+     **/
+    inline uint32
+    getPlayoutLateCount(const SyncSource& src) const
+    { return isMine(src)? getLink(src)->getPlayoutLateCount() : 0; }
+
+    /**
+     * Get the number of packets from a source that were not
+     * available at their playout time, and should thus be
+     * concealed by the application.
+     **/
+    inline uint32
+    getPlayoutConcealedCount(const SyncSource& src) const
+    { return isMine(src)? getLink(src)->getPlayoutConcealedCount() : 0; }
+
+    /**
+     * Get the number of packets from a source that were not
+     * available at their playout time and have not arrived since
+     * then.
+     **/
+    inline uint32
+    getPlayoutLostCount(const SyncSource& src) const
+    { uint32 c = getPlayoutConcealedCount(src), l = getPlayoutLateCount(src);
+      return (c > l)? c - l : 0; }
+
     /**
      * Determine if packets are waiting in the reception queue.
      *
@@ -1037,6 +1448,29 @@ public:
     getMaxPacketDropout() const
     { return maxPacketDropout; }
 
+    /**
+     * Set the size of the reordering ring kept for each source.
+     * Packets queued from a source are indexed by extended
+     * sequence number in a ring, so that a disordered packet is
+     * placed and a duplicate is detected without walking the
+     * queue of its source. By default there is no ring.
+     *
+     * Packets more than size sequence numbers older than the
+     * newest one of their source are still placed by walking the
+     * queue. The ring should thus cover the maximum reordering
+     * depth expected plus the packets usually waiting to be
+     * retrieved.
+     *
+     * @param size number of slots, rounded up to a power of two
+     * not greater than 32768. 0 disables the ring.
+     **/
+    void
+    setRecvRingSize(uint32 size);
+
+    inline uint32
+    getRecvRingSize() const
+    { return recvRingSize; }
+
     // default value for constructors that allow to specify
     // members table s\ize
         inline static size_t
@@ -1060,6 +1494,10 @@ public:
          * The endQueue method (provided by RTPQueue) also deletes all
          * registered CryptoContexts.
          *
+         * The context removed is deleted, so it must not be in use,
+         * for instance by the service thread protecting or
+         * unprotecting a packet of its source.
+         *
          * @param cc
          *     Pointer to initialized CryptoContext to remove. If pointer
          *     if <code>NULL</code> then delete the whole queue
@@ -1077,14 +1515,31 @@ public:
         CryptoContext*
         getInQueueCryptoContext(uint32 ssrc);
 
+        /**
+         * Get the input queue CryptoContext of an SSRC, creating it
+         * from the CryptoContext registered for SSRC 0 if there is
+         * none yet.
+         *
+         * Contexts are created when the first data packet of a
+         * source is received. Calling this when the source becomes
+         * known, for instance through signalling, takes the creation
+         * off the reception path. The queue calls it when the first
+         * RTCP packet of a source arrives.
+         *
+         * @param ssrc incoming SSRC.
+         * @return Pointer to the CryptoContext of the SSRC or NULL if
+         * SRTP is not in use.
+         */
+        CryptoContext*
+        prepareInQueueCryptoContext(uint32 ssrc);
+
 protected:
     /**
      * @param size initial size of the membership table.
      **/
     IncomingDataQueue(uint32 size);
 
-    virtual ~IncomingDataQueue()
-    { }
+    virtual ~IncomingDataQueue();
 
     /**
      * Apply collision and loop detection and correction algorithm
@@ -1102,6 +1557,15 @@ protected:
                        bool is_new, InetAddress& na,
                        tpport_t tp);
 
+    /**
+     * Delete a source unless packets of it are still queued or
+     * data units refer to it.
+     *
+     * @param sourceLink link to the source object.
+     * @return whether the source was deleted.
+     **/
+    bool removeIdleSource(SyncSourceLink& sourceLink);
+
     /**
      * Set the number of RTCP intervals that the stack will wait
      * to change the state of a source from stateActive to
@@ -1116,10 +1580,35 @@ protected:
      * @note If RTCP is not being used, the RTCP interval is
      * assumed to be the default: 5 seconds.
      * @note The default for this value is, as RECOMMENDED, 5.
+     * 0 disables expiration, so sources stay active forever.
      **/
     void setSourceExpirationPeriod(uint8 intervals)
     { sourceExpirationPeriod = intervals; }
 
+    inline uint8 getSourceExpirationPeriod() const
+    { return sourceExpirationPeriod; }
+
+    /**
+     * Set whether expired sources and sources that left with a
+     * BYE are deleted. When disabled, they are only marked
+     * inactive or leaving and are kept for the whole session.
+     *
+     * A source is deleted only once none of its packets is
+     * queued and no AppDataUnit refers to it. The application
+     * must lock the list of sources while walking it (see
+     * lockSourcesList()), and packets must be taken in by the
+     * thread that services RTCP, as with the session classes and
+     * pools of this library, which enable removal when built.
+     *
+     * @param enable whether to delete sources (off by default
+     * for queues other than those sessions).
+     **/
+    inline void setSourceRemoval(bool enable)
+    { sourceRemoval = enable; }
+
+    inline bool isSourceRemoval() const
+    { return sourceRemoval; }
+
     /**
      * This function is used by the service thread to process
      * the next incoming packet and place it in the receive list.
@@ -1129,6 +1618,98 @@ protected:
     virtual size_t
     takeInDataPacket();
 
+    /**
+     * Read as many data packets as allowed by getRecvBatchSize()
+     * in a single call to recvDataBatch() and take all of them
+     * into the receive list. Called by takeInDataPacket() when
+     * batched reception is enabled.
+     *
+     * @return number of bytes received.
+     **/
+    size_t
+    takeInDataPacketBatch();
+
+    /**
+     * Create (or recreate, if the maximum packet size has changed)
+     * the free lists packets are received through.
+     **/
+    void
+    preparePools();
+
+    /**
+     * Validate, decrypt and record a data packet just read from
+     * the network, and insert it in the receive list.
+     *
+     * @param buffer packet memory region, obtained from
+     * RTPBlockPool::allocate(). Ownership is taken.
+     * @param len packet length, in octets.
+     * @param na source network address.
+     * @param tp source transport port.
+     * @param recvtime time of arrival.
+     * @return len if the packet was processed, 0 if it was rejected
+     * as invalid.
+     **/
+    size_t
+    processDataPacket(unsigned char* buffer, size_t len,
+              InetHostAddress& na, tpport_t tp,
+              const timeval& recvtime);
+
+    /**
+     * First step of processDataPacket(): build a packet from a data
+     * packet just read from the network, check its header and find
+     * the SRTP context it is protected with.
+     *
+     * @param buffer packet memory region, obtained from
+     * RTPBlockPool::allocate(). Ownership is taken.
+     * @param len packet length, in octets.
+     * @param padSet receives whether the padding bit was set, it is
+     * cleared until the packet is unprotected.
+     * @param pcc receives the SRTP context of the packet, NULL if
+     * the packet is not protected.
+     * @return the packet, NULL if it was rejected as invalid.
+     **/
+    IncomingRTPPkt*
+    buildDataPacket(unsigned char* buffer, size_t len, bool& padSet,
+            CryptoContext*& pcc);
+
+    /**
+     * Last step of processDataPacket(): record an unprotected data
+     * packet and insert it in the receive list.
+     *
+     * @param packet packet returned by buildDataPacket(). Ownership
+     * is taken.
+     * @param srtpResult value returned by IncomingRTPPkt::unprotect(),
+     * 1 for packets not protected.
+     * @param padSet padding bit as returned by buildDataPacket().
+     * @param na source network address.
+     * @param tp source transport port.
+     * @param recvtime time of arrival.
+     * @return false if the packet was rejected as invalid.
+     **/
+    bool
+    acceptDataPacket(IncomingRTPPkt* packet, int32 srtpResult,
+             bool padSet, InetHostAddress& na, tpport_t tp,
+             const timeval& recvtime);
+
+    /**
+     * Take in a RTCP packet received through the data channel,
+     * when RTP and RTCP are multiplexed on a single port (RFC
+     * 5761). Called for the packets IncomingRTPPkt::isControlPacket()
+     * tells apart. The default implementation does not take them,
+     * so that they go on as data packets.
+     *
+     * @param buffer packet memory region. Ownership is not taken.
+     * @param len packet length, in octets.
+     * @param na source network address.
+     * @param tp source transport port.
+     * @param recvtime time of arrival.
+     * @return whether the packet was taken as a control packet.
+     **/
+    virtual bool
+    takeInMuxedControlPacket(const unsigned char*, size_t,
+                 InetHostAddress&, tpport_t, const timeval&)
+    { return false; }
+
     void renewLocalSSRC();
 
     /**
@@ -1143,6 +1724,25 @@ protected:
     IncomingDataQueue::IncomingRTPPktLink*
     getWaiting(uint32 timestamp, const SyncSource *src = NULL);
 
+    /**
+     * Take the first packet of a source out of the reception
+     * queue if it is due for playout. The queue must be write
+     * locked by the caller.
+     *
+     * @param srcLink synchronization source.
+     * @param now current time, in microseconds.
+     * @return packet link, NULL if the packet is not due yet.
+     **/
+    IncomingRTPPktLink*
+    getPlayoutPacket(SyncSourceLink& srcLink, uint64 now);
+
+    /**
+     * Unlink the first packet of a source from the reception
+     * queue. The queue must be write locked by the caller.
+     **/
+    void
+    unlinkFirstPacket(IncomingRTPPktLink* pl);
+
     /**
      * Log reception of a new RTP packet from this source. Usually
      * updates data such as the packet counter, the expected
@@ -1173,6 +1773,50 @@ protected:
 
     void purgeIncomingQueue();
 
+    /**
+     * Hand received data packets over from the thread that takes
+     * them in to the threads that retrieve them (getData(),
+     * getPlayoutData(), isWaiting(), getFirstTimestamp()) through
+     * a lock-free queue, so that reception does not contend with
+     * the application for the queue lock. Packets are moved into
+     * the reception queue when they are looked for.
+     *
+     * Only one thread at a time may take in data packets. This
+     * must be called before the service of the queue starts.
+     *
+     * @param slots number of packets that may be waiting to be
+     * moved. When they are exhausted, packets are inserted with
+     * the queue locked. 0 disables the handoff.
+     **/
+    void
+    setRecvHandoff(size_t slots);
+
+    inline bool
+    isRecvHandoff() const
+    { return NULL != recvHandoff; }
+
+    /**
+     * Unprotect the SRTP data packets of a reception batch in the
+     * worker threads of an SRTP crypto pool, the packets of each
+     * source in the same worker. Packets are inserted into the
+     * reception queue in the order they were received once the
+     * whole batch has been processed. Only batches of more than
+     * one packet are handed to the pool.
+     *
+     * The pool is shared by the queues of several sessions and
+     * must outlive this queue.
+     *
+     * @param pool crypto pool, NULL to unprotect packets in the
+     * thread that takes them in.
+     **/
+    inline void
+    setInQueueCryptoPool(SRTPCryptoPool* pool)
+    { recvCryptoPool = pool; }
+
+    inline SRTPCryptoPool*
+    getInQueueCryptoPool() const
+    { return recvCryptoPool; }
+
     /**
      * Virtual called when a new synchronization source has joined
      * the session.
@@ -1254,6 +1898,34 @@ protected:
     bool
     insertRecvPacket(IncomingRTPPktLink* packetLink);
 
+    /**
+     * Look for the place of a disordered packet in the queue of
+     * its source through the reordering ring of the source.
+     *
+     * @param srcLink source of the packet.
+     * @param seq extended sequence number of the packet.
+     * @param plink on input, the last packet of the source. On
+     * output, the packet to insert after, NULL to insert first.
+     * @return false if the packet is a duplicate.
+     **/
+    bool
+    findRingPlace(SyncSourceLink& srcLink, uint32 seq,
+              IncomingRTPPktLink*& plink);
+
+    /**
+     * Queue a just received packet for retrieval, either through
+     * the handoff queue or inserting it right away.
+     **/
+    void
+    queueRecvPacket(IncomingRTPPktLink* packetLink);
+
+    /**
+     * Move the packets waiting in the handoff queue into the
+     * reception queue.
+     **/
+    void
+    drainRecvHandoff() const;
+
     /**
      * This function performs the physical I/O for reading a
      * packet from the source.  It is a virtual that is
@@ -1272,6 +1944,45 @@ protected:
     virtual size_t
     getNextDataPacketSize() const = 0;
 
+    /**
+     * This function performs the physical I/O for reading a
+     * batch of packets from the source without blocking. The
+     * default implementation reads just one packet through
+     * recvData(). It is a virtual that is overriden in the derived
+     * class for channels with batched reception.
+     *
+     * @return number of packets read.
+     * @param batch array of packet descriptors to fill.
+     * @param count number of elements in batch.
+     **/
+    virtual size_t
+    recvDataBatch(RTPDatagram* batch, size_t count);
+
+#ifdef  CCXX_IPV6
+    /**
+     * Whether the data channel is IPv6, in which case
+     * takeInDataPacketBatch() reads through recvDataBatchIPV6()
+     * instead of recvDataBatch().
+     *
+     * @return true if the data channel is IPv6.
+     **/
+    virtual bool
+    isDataIPV6() const
+    { return false; }
+
+    /**
+     * IPv6 counterpart of recvDataBatch(), overriden in the
+     * derived class for IPv6 channels.
+     *
+     * @return number of packets read.
+     * @param batch array of packet descriptors to fill.
+     * @param count number of elements in batch.
+     **/
+    virtual size_t
+    recvDataBatchIPV6(RTPDatagramIPV6* batch, size_t count)
+    { return 0; }
+#endif
+
     mutable ThreadLock recvLock;
     // reception queue
     IncomingRTPPktLink* recvFirst, * recvLast;
@@ -1282,10 +1993,42 @@ protected:
     uint8 minValidPacketSequence;
     uint16 maxPacketMisorder;
     uint16 maxPacketDropout;
+    // slots of the per source reordering rings, 0 if disabled.
+    uint32 recvRingSize;
+    // limits of the adaptive playout delay.
+    static const microtimeout_t defaultMinPlayoutDelay;
+    static const microtimeout_t defaultMaxPlayoutDelay;
+    microtimeout_t minPlayoutDelay;
+    microtimeout_t maxPlayoutDelay;
+    // payload types whose marker bit starts a talkspurt, one bit
+    // per type.
+    uint32 talkspurtMarkerTypes[4];
     static const size_t defaultMembersSize;
     uint8 sourceExpirationPeriod;
+    bool sourceRemoval;
+    // held to walk or delete from the list of sources, see
+    // lockSourcesList().
+    mutable ThreadLock sourcesLock;
+    // reception buffers for batched reception.
+    RTPDatagram* recvBatchInfo;
+#ifdef  CCXX_IPV6
+    RTPDatagramIPV6* recvBatchInfoIPV6;
+#endif
+    size_t recvBatchSlots;
+    // free lists for buffers, packets and links of received
+    // packets, see preparePools().
+    RTPBlockPool* recvBufferPool;
+    RTPBlockPool* recvPacketPool;
+    RTPBlockPool* recvLinkPool;
+    // packets received but not yet in the reception queue, see
+    // setRecvHandoff(). The consumer side is serialized through
+    // recvHandoffMutex.
+    SPSCQueue<IncomingRTPPktLink>* recvHandoff;
+    mutable Mutex recvHandoffMutex;
+    // see setInQueueCryptoPool()
+    SRTPCryptoPool* recvCryptoPool;
     mutable Mutex cryptoMutex;
-        std::list<CryptoContext *> cryptoContexts;
+    CryptoContextTable<CryptoContext> cryptoContexts;
 };
 
 /** @}*/ // iqueue
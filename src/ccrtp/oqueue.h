@@ -46,6 +46,8 @@
 
 #include <ccrtp/queuebase.h>
 #include <ccrtp/CryptoContext.h>
+#include <ccrtp/CryptoContextTable.h>
+#include <ccrtp/cryptopool.h>
 #include <list>
 
 NAMESPACE_COMMONCPP
@@ -280,6 +282,26 @@ public:
     bool
     isSending() const;
 
+    /**
+     * Interface of objects told when data packets are appended to
+     * the sending queue, so that a thread that services many
+     * queues need not poll the idle ones (see setSendNotifier()).
+     **/
+    class SendNotifier
+    {
+    public:
+        virtual ~SendNotifier()
+        { }
+
+        /**
+         * Called by the thread that appends the packets, the one
+         * that calls putData() or a crypto pool worker, once they
+         * can be seen through isSending().
+         **/
+        virtual void
+        onSendQueued() = 0;
+    };
+
 
     /**
      * This is used to create a data packet in the send queue.
@@ -383,6 +405,55 @@ public:
     inline microtimeout_t getExpireTimeout() const
     { return expireTimeout; }
 
+    /**
+     * @enum SendRingOverflow
+     *
+     * What putData() does when the send queue is in preallocated
+     * buffers mode and all its slots are in use.
+     **/
+    typedef enum {
+        ringDropOldest,    ///< Discard the first packet in the queue.
+        ringDropNewest,    ///< Discard the packet being enqueued.
+        ringBlock          ///< Wait for a slot to be freed.
+    } SendRingOverflow;
+
+    /**
+     * Switch the send queue to preallocated buffers mode, or back
+     * to the default mode. In preallocated buffers mode the queue
+     * holds a fixed number of packets, whose memory is allocated
+     * once, so that neither putData() nor the dispatch of packets
+     * touch the heap. Each slot has room for a full segment (see
+     * setMaxSendSegmentSize()), the header with CSRC identifiers
+     * and the SRTP authentication tag of the current crypto
+     * context. Packets that do not fit (for instance because of
+     * padding) are allocated from the heap.
+     *
+     * ringBlock waits at most the expire timeout, after which
+     * the oldest packet is dropped: it would expire anyway.
+     *
+     * Should be called before data is enqueued, after the maximum
+     * segment size and the crypto context are set.
+     *
+     * @param slots maximum number of packets in the queue, 0 for
+     * the default mode (no limit and heap allocated packets).
+     * @param overflow policy to apply when the queue is full.
+     **/
+    void
+    setSendRing(size_t slots, SendRingOverflow overflow = ringDropOldest);
+
+    /**
+     * Get the number of slots of the send queue.
+     *
+     * @return number of slots, 0 if not in preallocated buffers mode.
+     **/
+    inline size_t
+    getSendRingSize() const
+    { return sendRingSlots; }
+
+    inline SendRingOverflow
+    getSendRingOverflow() const
+    { return sendRingOverflow; }
+
     /**
      * Get the total number of packets sent so far
      *
@@ -427,6 +498,10 @@ public:
          * The endQueue method (provided by RTPQueue) also deletes all
          * registered CryptoContexts.
          *
+         * The context removed is deleted, so it must not be in use,
+         * for instance by the service thread protecting or
+         * unprotecting a packet of its source.
+         *
          * @param cc Pointer to initialized CryptoContext to remove.
          */
         void
@@ -446,8 +521,7 @@ public:
 protected:
     OutgoingDataQueue();
 
-    virtual ~OutgoingDataQueue()
-    { }
+    virtual ~OutgoingDataQueue();
 
     struct OutgoingRTPPktLink
     {
@@ -458,6 +532,19 @@ protected:
 
         ~OutgoingRTPPktLink() { delete packet; }
 
+        // links may be allocated from a RTPBlockPool
+        inline static void* operator new(size_t size)
+        { return RTPBlockPool::allocate(size,NULL); }
+
+        inline static void* operator new(size_t size, RTPBlockPool* pool)
+        { return RTPBlockPool::allocate(size,pool); }
+
+        inline static void operator delete(void* p)
+        { RTPBlockPool::deallocate(p); }
+
+        inline static void operator delete(void* p, RTPBlockPool*)
+        { RTPBlockPool::deallocate(p); }
+
         inline OutgoingRTPPkt* getPacket() { return packet; }
 
         inline void setPacket(OutgoingRTPPkt* pkt) { packet = pkt; }
@@ -507,6 +594,18 @@ protected:
     size_t
     dispatchDataPacket();
 
+    /**
+     * Send the packets at the head of the sending queue that are
+     * due at the same time as the first one (up to
+     * getSendBatchSize() packets) to every destination, in as few
+     * socket calls as possible. Called by dispatchDataPacket()
+     * when batched transmission is enabled.
+     *
+     * @return number of payload bytes sent.
+     **/
+    size_t
+    dispatchDataPacketBatch();
+
     /**
      * For thoses cases in which the application requires a method
      * to set the sequence number for the outgoing stream (such as
@@ -537,6 +636,61 @@ protected:
 
     void purgeOutgoingQueue();
 
+    /**
+     * Hand data packets over from the thread that calls putData()
+     * to the thread that services the queue through a lock-free
+     * queue, so that the application does not contend with the
+     * service thread for the queue lock. Packets are moved into
+     * the sending queue when the service thread looks for packets
+     * to send.
+     *
+     * Only one thread at a time may call putData(). This must be
+     * called before the service of the queue starts.
+     *
+     * @param slots number of packets that may be waiting to be
+     * moved. When they are exhausted, packets are enqueued with
+     * the queue locked. 0 disables the handoff.
+     *
+     * @note setPartial() only sees the packets already moved into
+     * the sending queue.
+     **/
+    void
+    setSendHandoff(size_t slots);
+
+    inline bool
+    isSendHandoff() const
+    { return NULL != sendHandoff; }
+
+    /**
+     * Protect the data packets of the local source in a worker
+     * thread of an SRTP crypto pool instead of the thread that
+     * calls putData(). Packets are appended to the sending queue
+     * by the worker, in the order they were put.
+     *
+     * The pool is shared by the queues of several sessions and
+     * must outlive this queue. This must be called after the
+     * local SSRC and the SRTP context have been set and before
+     * the first packet is put.
+     *
+     * @param pool crypto pool, NULL to protect packets in putData().
+     **/
+    void
+    setOutQueueCryptoPool(SRTPCryptoPool* pool);
+
+    inline SRTPCryptoPool*
+    getOutQueueCryptoPool() const
+    { return sendCryptoPool; }
+
+    /**
+     * Set the object to tell when data packets are appended to
+     * the sending queue.
+     *
+     * @param notifier notifier, NULL for none.
+     **/
+    inline void
+    setSendNotifier(SendNotifier* notifier)
+    { sendNotifier = notifier; }
+
         virtual void
         setControlPeer(const InetAddress &host, tpport_t port) {}
 
@@ -545,9 +699,38 @@ protected:
     setControlPeerIPV6(const IPV6Address &host, tpport_t port) {}
 #endif
 
+    virtual void
+        setDataPeer(const InetAddress &host, tpport_t port) {}
+
+#ifdef  CCXX_IPV6
+    virtual void
+    setDataPeerIPV6(const IPV6Address &host, tpport_t port) {}
+#endif
+
+    /**
+     * This function performs the physical I/O for writing a
+     * batch of packets, each one to its own destination. The
+     * default implementation sets the peer and sends packets one
+     * by one. It is a virtual that is overriden in the derived
+     * class for channels with batched transmission. Also used
+     * to send multiplexed RTCP packets, see
+     * QueueRTCPManager::setRTCPMux().
+     *
+     * @param batch Descriptors of the packets to write.
+     * @param count Number of packets in batch.
+     * @return number of packets sent.
+     **/
+    virtual size_t
+    sendDataBatch(const RTPDatagram* batch, size_t count);
+
+#ifdef  CCXX_IPV6
+    virtual size_t
+    sendDataBatchIPV6(const RTPDatagramIPV6* batch, size_t count);
+#endif
+
         // The crypto contexts for outgoing SRTP sessions.
     mutable Mutex cryptoMutex;
-        std::list<CryptoContext *> cryptoContexts;
+    CryptoContextTable<CryptoContext> cryptoContexts;
 
 private:
         /**
@@ -558,14 +741,6 @@ private:
     inline virtual void onExpireSend(OutgoingRTPPkt&)
     { }
 
-    virtual void
-        setDataPeer(const InetAddress &host, tpport_t port) {}
-
-#ifdef  CCXX_IPV6
-    virtual void
-    setDataPeerIPV6(const IPV6Address &host, tpport_t port) {}
-#endif
-
     /**
      * This function performs the physical I/O for writing a
      * packet to the destination.  It is a virtual that is
@@ -583,6 +758,95 @@ private:
     sendDataIPV6(const unsigned char* const buffer, size_t len) {return 0;}
 #endif
 
+    /**
+     * Append one message per destination for a packet to the
+     * transmission batch, flushing the batch whenever it gets
+     * full. The destination lists must be locked by the caller.
+     *
+     * @param packet packet to send.
+     * @param count number of messages already in the batch.
+     * @return number of messages in the batch after appending.
+     **/
+    size_t
+    addToSendBatch(OutgoingRTPPkt* packet, size_t count);
+
+    /**
+     * Take a slot for a packet to be put. In preallocated buffers
+     * mode, when all the slots are taken, wait until one is free
+     * if the overflow policy is ringBlock. A packet holds its slot
+     * from the time it is put until it is sent or dropped, whether
+     * it is in a crypto job, in the handoff queue or in the sending
+     * queue.
+     *
+     * @return false if the packet to be enqueued must be dropped.
+     **/
+    bool
+    waitSendSlot();
+
+    /**
+     * Free the slots of packets sent or dropped, waking up a
+     * producer blocked in waitSendSlot().
+     **/
+    void
+    releaseSendSlots(size_t count);
+
+    /**
+     * Append a packet to the sending queue, applying the overflow
+     * policy of the preallocated buffers mode. The sending queue
+     * must be write locked by the caller.
+     **/
+    void
+    insertSendPacket(OutgoingRTPPktLink* link);
+
+    /**
+     * Move the packets waiting in the handoff queue into the
+     * sending queue, which must be write locked by the caller.
+     **/
+    void
+    drainSendHandoff();
+
+    /**
+     * Protect a run of packets built by putData() in a single
+     * SRTP batch and append them to the sending queue, in order.
+     *
+     * @param packets packets to queue.
+     * @param count number of packets.
+     * @param pcc SRTP context of the local source, NULL if none.
+     **/
+    void
+    queueSendPackets(OutgoingRTPPkt** packets, size_t count,
+             CryptoContext* pcc);
+
+    /**
+     * Append protected packets to the sending queue, in order.
+     **/
+    void
+    appendSendPackets(OutgoingRTPPkt** packets, size_t count);
+
+    /**
+     * Wait until the crypto pool has queued all the packets
+     * handed to it.
+     **/
+    void
+    waitCryptoJobs();
+
+    /**
+     * Precompute the key stream of the next packets to send if the
+     * crypto context of the local source is set to do so, see
+     * CryptoContext::setKeystreamPrecompute(). Called when the
+     * sending queue has been emptied.
+     **/
+    void
+    precomputeSendKeystream();
+
+    class SendCryptoJob;
+    friend class SendCryptoJob;
+
+#ifdef  CCXX_IPV6
+    size_t
+    addToSendBatchIPV6(OutgoingRTPPkt* packet, size_t count);
+#endif
+
     static const microtimeout_t defaultSchedulingTimeout;
     static const microtimeout_t defaultExpireTimeout;
     mutable ThreadLock sendLock;
@@ -593,6 +857,38 @@ private:
     microtimeout_t schedulingTimeout;
     // how old a packet can reach in the sending queue before deletetion
     microtimeout_t expireTimeout;
+    // messages for batched transmission.
+    RTPDatagram* sendBatchInfo;
+    // number of packets in the send queue
+    size_t sendQueueLength;
+    // preallocated buffers mode, see setSendRing()
+    size_t sendRingSlots;
+    // packets put and not yet sent or dropped, see waitSendSlot().
+    volatile uint32 sendOutstanding;
+    // producers blocked waiting for a slot.
+    volatile uint32 sendSlotWaiters;
+    Conditional sendSlotCond;
+    SendRingOverflow sendRingOverflow;
+    RTPBlockPool* sendBufferPool;
+    RTPBlockPool* sendPacketPool;
+    RTPBlockPool* sendLinkPool;
+    // packets put but not yet in the sending queue, see
+    // setSendHandoff(). The consumer side is serialized through
+    // sendLock.
+    SPSCQueue<OutgoingRTPPktLink>* sendHandoff;
+    // crypto offload, see setOutQueueCryptoPool(). All the jobs of
+    // this queue go to the worker selected by sendCryptoPoolKey.
+    SRTPCryptoPool* sendCryptoPool;
+    uint32 sendCryptoPoolKey;
+    // told when packets are appended, see setSendNotifier().
+    SendNotifier* sendNotifier;
+    // jobs handed to the pool and not yet finished, see
+    // waitCryptoJobs().
+    Conditional cryptoJobCond;
+    size_t cryptoJobs;
+#ifdef  CCXX_IPV6
+    RTPDatagramIPV6* sendBatchInfoIPV6;
+#endif
 
 
     struct {
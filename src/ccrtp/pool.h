@@ -44,6 +44,7 @@
 #define CCXX_RTP_POOL_H
 
 #include <list>
+#include <map>
 #include <ccrtp/rtp.h>
 
 NAMESPACE_COMMONCPP
@@ -76,11 +77,27 @@ public:
     controlTransmissionService(RTPSessionBase& s)
     { s.controlTransmissionService(); }
 
+    inline bool
+    isPendingControl(RTPSessionBase& s)
+    { return s.isPendingControl(0); }
+
+    void
+    takeInControlPacket(RTPSessionBase& s)
+    { s.takeInControlPacket(); }
+
     inline SOCKET getDataRecvSocket(RTPSessionBase& s) const
     { return s.getDataRecvSocket(); }
 
     inline SOCKET getControlRecvSocket(RTPSessionBase& s) const
     { return s.getControlRecvSocket(); }
+
+    inline bool
+    isSending(RTPSessionBase& s) const
+    { return s.isSending(); }
+
+    inline void
+    setSendNotifier(RTPSessionBase& s, OutgoingDataQueue::SendNotifier* n)
+    { s.setSendNotifier(n); }
 };
 
 /**
@@ -160,13 +177,13 @@ public:
     inline virtual ~RTPSessionPool()
     { }
 
-    bool
+    virtual bool
     addSession(RTPSessionBase& session);
 
-    bool
+    virtual bool
     removeSession(RTPSessionBase& session);
 
-    size_t
+    virtual size_t
     getPoolLength() const;
 
     virtual void startRunning() = 0;
@@ -230,6 +247,229 @@ protected:
     void run();
 };
 
+#ifdef  __linux__
+/**
+ * A session pool served by one thread that waits for incoming
+ * packets through the Linux epoll interface.
+ *
+ * The data and control sockets of each session are registered once
+ * when the session is added to the pool, so that the cost of each
+ * wakeup depends on the number of sessions with pending packets or
+ * expired timers rather than on the pool size, and there is no
+ * FD_SETSIZE limit. Transmission of data and control packets is
+ * scheduled through a timer queue ordered by the next time each
+ * session must be serviced. A session with no data packets queued
+ * sleeps until its next RTCP check, and is woken up as soon as
+ * packets are put (see OutgoingDataQueue::setSendNotifier()).
+ *
+ * Sessions are serviced without holding the pool lock.
+ **/
+class __EXPORT EpollRTPSessionPool :
+        public RTPSessionPool,
+        public Thread
+{
+public:
+    /**
+     * @param pri optional thread priority value.
+     **/
+    EpollRTPSessionPool(int pri = 0);
+
+    ~EpollRTPSessionPool();
+
+    bool
+    addSession(RTPSessionBase& session);
+
+    bool
+    removeSession(RTPSessionBase& session);
+
+    void startRunning()
+    { setActive(); Thread::start(); }
+
+protected:
+    /**
+     * Runnable method for the thread. This thread serves all the
+     * RTP sessions added to this pool.
+     */
+    void run();
+
+    /**
+     * Called by the service thread after a wakeup in which there
+     * were neither incoming packets nor expired timers. No lock is
+     * held while this method runs.
+     **/
+    virtual void
+    onPoolIdle()
+    { }
+
+    /**
+     * Get how late the service of the most overdue session is.
+     *
+     * @param now current time, in microseconds.
+     * @return microseconds the first timer of this pool is overdue
+     * by, 0 if no timer is overdue.
+     **/
+    microtimeout_t
+    getTimerBacklog(uint64 now) const;
+
+    /**
+     * Move the session whose timer is the most overdue from this
+     * pool to another one, along with its timer. Both pools must
+     * be write locked by the caller.
+     *
+     * @param pool pool the session is moved to.
+     * @return whether a session was moved.
+     **/
+    bool
+    moveOverdueSession(EpollRTPSessionPool& pool);
+
+private:
+    class SessionTimer;
+    friend class SessionTimer;
+
+    /**
+     * Register the data and control sockets of a session in the
+     * epoll set of this pool.
+     *
+     * @return whether the sockets could be registered.
+     **/
+    bool
+    registerSockets(SessionTimer* timer);
+
+    /**
+     * Remove the sockets of a session from the epoll set of this
+     * pool.
+     **/
+    void
+    unregisterSockets(RTPSessionBase& session);
+
+    /**
+     * Set the time a session must be serviced at, replacing the
+     * previous one. The pool must be write locked.
+     *
+     * @param when time in microseconds.
+     **/
+    void
+    scheduleSession(SessionTimer* timer, uint64 when);
+
+    /**
+     * Take a session off the timer queue. The pool must be write
+     * locked.
+     **/
+    void
+    unscheduleSession(SessionTimer* timer);
+
+    /**
+     * Release the timer of a session removed from this pool. The
+     * pool must be write locked.
+     **/
+    void
+    deleteTimer(SessionTimer* timer);
+
+    /**
+     * Bring forward to now the timers of the sessions with data
+     * packets put since they were last serviced. The pool must be
+     * write locked.
+     **/
+    void
+    takeWokenSessions(uint64 now);
+
+    /**
+     * Receive pending packets and send scheduled ones for a
+     * session whose timer has expired.
+     *
+     * @return microseconds until the session must be serviced again.
+     **/
+    microtimeout_t
+    serviceSession(RTPSessionBase& session);
+
+    // maximum number of events picked in each wakeup.
+    static const int maxEvents = 256;
+
+    int epollFd;
+    // eventfd that wakes the service thread up when packets are put
+    // in an idle session.
+    int wakeFd;
+    // sockets registered to the epoll set
+    std::map<SOCKET,SessionTimer*> socketMap;
+    // timer of each session
+    std::map<SessionListElement*,SessionTimer*> sessionTimers;
+    // sessions indexed by the time they must be serviced at
+    // (microseconds)
+    std::multimap<uint64,SessionTimer*> timerQueue;
+    typedef std::multimap<uint64,SessionTimer*>::iterator TimerIterator;
+    // sessions woken up, see takeWokenSessions().
+    Mutex wakeMutex;
+    std::list<SessionTimer*> wokenSessions;
+    // held by the service thread while it services sessions
+    // without the pool lock, so that they are not removed meanwhile.
+    Mutex serviceMutex;
+    bool purgePending;
+};
+
+/**
+ * A session pool served by several threads, each of them running an
+ * epoll event loop (see EpollRTPSessionPool) on its own shard of
+ * sessions. Sessions are hashed onto shards when added to the pool.
+ *
+ * Each service thread is bound to one processor. When a thread finds
+ * nothing to do in its own shard, it takes over the session with the
+ * most overdue timer (RTCP transmission and data packet dispatch) of
+ * the shard that lags behind the most, so that a few busy sessions
+ * hashed onto the same shard do not delay the rest.
+ *
+ * A session is always served by one thread at a time.
+ **/
+class __EXPORT ThreadedRTPSessionPool : public RTPSessionPool
+{
+public:
+    /**
+     * @param nthreads number of service threads (and shards),
+     * 0 for one per online processor.
+     * @param pri optional thread priority value.
+     **/
+    ThreadedRTPSessionPool(unsigned int nthreads = 0, int pri = 0);
+
+    ~ThreadedRTPSessionPool();
+
+    bool
+    addSession(RTPSessionBase& session);
+
+    bool
+    removeSession(RTPSessionBase& session);
+
+    size_t
+    getPoolLength() const;
+
+    void startRunning();
+
+    /**
+     * Get the number of service threads of this pool.
+     *
+     * @return number of shards.
+     **/
+    inline unsigned int
+    getShardCount() const
+    { return shardCount; }
+
+    /**
+     * Minimum delay in the service of a shard for other shards to
+     * take sessions away from it, in microseconds.
+     **/
+    static const microtimeout_t stealThreshold = 2000;
+
+private:
+    class Shard;
+    friend class Shard;
+
+    Shard** shards;
+    unsigned int shardCount;
+    // write locked to add and remove sessions, read locked to
+    // move them between shards, so that a session is never added
+    // twice nor missed while it moves.
+    ThreadLock shardLock;
+};
+#endif
+
 END_NAMESPACE
 
 #endif //CCXX_RTP_POOL_H
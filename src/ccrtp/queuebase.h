@@ -71,8 +71,7 @@ class __EXPORT AppDataUnit
 public:
     AppDataUnit(const IncomingRTPPkt& packet, const SyncSource& src);
 
-    inline ~AppDataUnit()
-    { }
+    ~AppDataUnit();
 
     /**
      * @param src the AppDataUnit object being copied
@@ -274,6 +273,25 @@ public:
     getMaxSendSegmentSize()
     { return maxSendSegmentSize; }
 
+    inline size_t
+    getSendBatchSize() const
+    { return sendBatchSize; }
+
+    /**
+     * Set the maximum number of scheduled data packets sent in
+     * each transmission pass of the service thread. Packets due
+     * at the same time (such as the segments of a video frame) are
+     * then sent to every destination in a single socket call.
+     *
+     * @param count maximum number of packets per pass. With the
+     * default value (1) each pass sends exactly one packet. Values
+     * above MaxRTPBatchSize are truncated.
+     **/
+    inline void
+    setSendBatchSize(size_t count)
+    { sendBatchSize = (count > MaxRTPBatchSize)? MaxRTPBatchSize :
+                      ((count > 0)? count : 1); }
+
 protected:
     OutgoingDataQueueBase();
 
@@ -285,6 +303,8 @@ private:
     static const size_t defaultMaxSendSegmentSize;
     // maximum packet size before fragmenting sends.
     size_t maxSendSegmentSize;
+    // maximum number of packets sent in each transmission pass.
+    size_t sendBatchSize;
 };
 
 /**
@@ -317,8 +337,30 @@ public:
     setMaxRecvPacketSize(size_t maxsize)
     { maxRecvPacketSize = maxsize; }
 
+    inline size_t
+    getRecvBatchSize() const
+    { return recvBatchSize; }
+
+    /**
+     * Set the maximum number of data packets read from the
+     * network in each reception pass of the service thread.
+     *
+     * @param count maximum number of packets per pass. With the
+     * default value (1) each pass gets exactly one packet. Values
+     * above MaxRTPBatchSize are truncated.
+     *
+     * @note reception buffers for count packets of
+     * getMaxRecvPacketSize() octets are allocated when count is
+     * higher than 1, so it is advisable to lower the maximum
+     * receive packet size before enabling batched reception.
+     **/
+    inline void
+    setRecvBatchSize(size_t count)
+    { recvBatchSize = (count > MaxRTPBatchSize)? MaxRTPBatchSize :
+                      ((count > 0)? count : 1); }
+
 protected:
-    IncomingDataQueueBase()
+    IncomingDataQueueBase() : recvBatchSize(1)
     { setMaxRecvPacketSize(getDefaultMaxRecvPacketSize()); }
 
     inline virtual
@@ -329,6 +371,97 @@ private:
     static const size_t defaultMaxRecvPacketSize;
     // filter value for received packets length.
     size_t maxRecvPacketSize;
+    // maximum number of packets read in each reception pass.
+    size_t recvBatchSize;
+};
+
+/**
+ * @class SPSCQueue
+ * @short Bounded queue of pointers for one producer and one consumer.
+ *
+ * Items can be pushed by exactly one thread and popped by exactly one
+ * other thread at the same time without any lock: each index is only
+ * written by one side, and memory barriers order the accesses to the
+ * slots with respect to the updates of the indexes. Several threads
+ * may share one of the sides as long as they serialize their access
+ * by other means.
+ **/
+template <class T>
+class SPSCQueue
+{
+public:
+    /**
+     * @param size minimum number of slots, rounded up to the
+     * next power of two.
+     **/
+    SPSCQueue(size_t size) :
+        head(0), tail(0)
+    {
+        size_t slots = 1;
+        while ( slots < size )
+            slots <<= 1;
+        items = new T* [slots];
+        mask = slots - 1;
+    }
+
+    ~SPSCQueue()
+    { delete [] items; }
+
+    /**
+     * Append an item. Must only be called from the producer side.
+     *
+     * @return false if the queue is full.
+     **/
+    bool
+    push(T* item)
+    {
+        size_t t = tail;
+        if ( t - head > mask )
+            return false;
+        items[t & mask] = item;
+        // the slot must be written before it is published
+        rtpMemoryBarrier();
+        tail = t + 1;
+        return true;
+    }
+
+    /**
+     * Take the oldest item. Must only be called from the
+     * consumer side.
+     *
+     * @return the item, or NULL if the queue is empty.
+     **/
+    T*
+    pop()
+    {
+        size_t h = head;
+        if ( h == tail )
+            return NULL;
+        rtpMemoryBarrier();
+        T* item = items[h & mask];
+        // the slot must be read before it is reused
+        rtpMemoryBarrier();
+        head = h + 1;
+        return item;
+    }
+
+    inline bool
+    isEmpty() const
+    { return head == tail; }
+
+    inline size_t
+    getSize() const
+    { return mask + 1; }
+
+private:
+    T** items;
+    size_t mask;
+    // index of the next item to pop, written by the consumer.
+    volatile size_t head;
+    // keep the indexes in different cache lines.
+    char pad[64];
+    // index of the next free slot, written by the producer.
+    volatile size_t tail;
 };
 
 /** @}*/ // queuebase
@@ -343,10 +343,12 @@ protected:
      *
      * @param len length of the RTCP compound packet in
      *        the reception buffer
+     * @param reducedSize whether the first packet may be of any
+     *        RTCP type, as with reduced-size RTCP (RFC 5506).
      * @return whether the header is valid.
      */
     bool
-    checkCompoundRTCPHeader(size_t len);
+    checkCompoundRTCPHeader(size_t len, bool reducedSize = false);
 
     // buffer to hold RTCP compound packets being sent. Allocated
     // in construction time
@@ -77,6 +77,11 @@ NAMESPACE_COMMONCPP
  * allowing to customize this aspect in derived classes (see
  * SingleThreadRTPSession or RTPSessionPoolBase).
  *
+ * A session built with the same data and control port multiplexes
+ * RTCP with RTP on the data channel (RFC 5761). No control channel
+ * is then created, and RTCP packets are told apart from data
+ * packets as they are received.
+ *
  * @author David Sugar <dyfet@ostel.com>
  * @short RTP protocol stack based on Common C++.
  **/
@@ -175,7 +180,7 @@ NAMESPACE_COMMONCPP
                 Socket::Error error = dso->setMulticast(true);
                 if ( error ) return error;
                 error = dso->setTimeToLive(ttl);
-                if ( error ) return error;
+                if ( error || !cso ) return error;
                 error = cso->setMulticast(true);
                 if ( error ) return error;
                 return cso->setTimeToLive(ttl);
@@ -220,6 +225,18 @@ NAMESPACE_COMMONCPP
              InetHostAddress& na, tpport_t& tp)
             { na = dso->getSender(tp); return dso->recv(buffer, len); }
 
+        /**
+         * Receive a batch of packets from the data channel/socket
+         * without blocking.
+         *
+         * @param batch Descriptors of the memory regions to read to.
+         * @param count Maximum number of packets to get.
+         * @return Number of packets actually read.
+         */
+        inline size_t
+        recvDataBatch(RTPDatagram* batch, size_t count)
+            { return dso->recvBatch(batch, count); }
+
         inline void
         setDataPeer(const InetAddress &host, tpport_t port)
             { dso->setPeer(host,port); }
@@ -233,6 +250,14 @@ NAMESPACE_COMMONCPP
         sendData(const unsigned char* const buffer, size_t len)
             { return dso->send(buffer, len); }
 
+        /**
+         * @param batch packets to write, each one with its destination
+         * @param count number of packets in batch
+         */
+        inline size_t
+        sendDataBatch(const RTPDatagram* batch, size_t count)
+            { return dso->sendBatch(batch, count); }
+
         inline SOCKET getDataRecvSocket() const
             { return dso->getRecvSocket(); }
 
@@ -242,11 +267,11 @@ NAMESPACE_COMMONCPP
          */
         inline bool
         isPendingControl(microtimeout_t timeout)
-            { return cso->isPendingRecv(timeout); }
+            { return cso && cso->isPendingRecv(timeout); }
 
         InetHostAddress
         getControlSender(tpport_t *port = NULL) const
-            { return cso->getSender(port); }
+            { return cso? cso->getSender(port) : dso->getSender(port); }
 
         /**
          * Receive data from the control channel/socket.
@@ -260,11 +285,16 @@ NAMESPACE_COMMONCPP
         inline size_t
         recvControl(unsigned char *buffer, size_t len,
                 InetHostAddress& na, tpport_t& tp)
-            { na = cso->getSender(tp); return cso->recv(buffer,len); }
+            {
+                // with RTCP-mux, control packets come through recvData()
+                if ( !cso ) return 0;
+                na = cso->getSender(tp); return cso->recv(buffer,len);
+            }
 
+        // with RTCP-mux the data peer is used.
         inline void
         setControlPeer(const InetAddress &host, tpport_t port)
-            { cso->setPeer(host,port); }
+            { if ( cso ) cso->setPeer(host,port); }
 
         /**
          * @return number of octets actually written
@@ -273,10 +303,10 @@ NAMESPACE_COMMONCPP
          */
         inline size_t
         sendControl(const unsigned char* const buffer, size_t len)
-            { return cso->send(buffer,len); }
+            { return cso? cso->send(buffer,len) : dso->send(buffer,len); }
 
         inline SOCKET getControlRecvSocket() const
-            { return cso->getRecvSocket(); }
+            { return cso? cso->getRecvSocket() : dso->getRecvSocket(); }
 
         /**
          * Join a multicast group.
@@ -290,7 +320,7 @@ NAMESPACE_COMMONCPP
                 Socket::Error error  = dso->setMulticast(true);
                 if ( error ) return error;
                 error = dso->join(ia,iface);
-                if ( error ) return error;
+                if ( error || !cso ) return error;
                 error = cso->setMulticast(true);
                 if ( error ) {
                     dso->drop(ia);
@@ -316,7 +346,7 @@ NAMESPACE_COMMONCPP
                 Socket::Error error = dso->setMulticast(false);
                 if ( error ) return error;
                 error = dso->leaveGroup(ia);
-                if ( error ) return error;
+                if ( error || !cso ) return error;
                 error = cso->setMulticast(false);
                 if ( error ) return error;
                 return cso->leaveGroup(ia);
@@ -349,8 +379,9 @@ NAMESPACE_COMMONCPP
                     dataBasePort = dataPort;
                     controlBasePort = controlPort;
                 }
+                ServiceQueue::setSourceRemoval(true);
                 dso = new RTPDataChannel(ia,dataBasePort);
-                cso = new RTCPChannel(ia,controlBasePort);
+                buildControl(ia);
             }
 
         void
@@ -364,11 +395,27 @@ NAMESPACE_COMMONCPP
                     dataBasePort = dataPort;
                     controlBasePort = controlPort;
                 }
+                ServiceQueue::setSourceRemoval(true);
                 dso = new RTPDataChannel(InetHostAddress("0.0.0.0"),dataBasePort);
-                cso = new RTCPChannel(InetHostAddress("0.0.0.0"),controlBasePort);
+                buildControl(InetHostAddress("0.0.0.0"));
                 joinGroup(ia,iface);
             }
 
+        /**
+         * Create the control channel, unless it is the data port
+         * itself, in which case RTCP is multiplexed with RTP.
+         **/
+        void
+        buildControl(const InetHostAddress& ia)
+            {
+                if ( controlBasePort == dataBasePort ) {
+                    cso = NULL;
+                    ServiceQueue::setRTCPMux(true);
+                } else {
+                    cso = new RTCPChannel(ia,controlBasePort);
+                }
+            }
+
         /**
          * Ensure a port number is odd. If it is an even number, return
          * the next lower (odd) port number.
@@ -637,6 +684,11 @@ typedef SingleThreadRTPSession<SymmetricRTPChannel,
  * allowing to customize this aspect in derived classes (see
  * SingleThreadRTPSession or RTPSessionPoolBase).
  *
+ * A session built with the same data and control port multiplexes
+ * RTCP with RTP on the data channel (RFC 5761). No control channel
+ * is then created, and RTCP packets are told apart from data
+ * packets as they are received.
+ *
  * @author David Sugar <dyfet@ostel.com>
  * @short RTP protocol stack based on Common C++.
  **/
@@ -762,6 +814,22 @@ protected:
          IPV6Host& na, tpport_t& tp)
         { na = dso->getSender(tp); return dso->recv(buffer, len); }
 
+    /**
+     * Receive a batch of packets from the data channel/socket
+     * without blocking. Called by takeInDataPacketBatch().
+     *
+     * @param batch Descriptors of the memory regions to read to.
+     * @param count Maximum number of packets to get.
+     * @return Number of packets actually read.
+     */
+    inline size_t
+    recvDataBatchIPV6(RTPDatagramIPV6* batch, size_t count)
+        { return dso->recvBatch(batch, count); }
+
+    inline bool
+    isDataIPV6() const
+        { return true; }
+
         inline void
         setDataPeerIPV6(const IPV6Host &host, tpport_t port)
         { dso->setPeer(host,port); }
@@ -774,6 +842,14 @@ protected:
     sendDataIPV6(const unsigned char* const buffer, size_t len)
         { return dso->send(buffer, len); }
 
+    /**
+     * @param batch packets to write, each one with its destination
+     * @param count number of packets in batch
+     */
+    inline size_t
+    sendDataBatchIPV6(const RTPDatagramIPV6* batch, size_t count)
+        { return dso->sendBatch(batch, count); }
+
     inline SOCKET getDataRecvSocket() const
         { return dso->getRecvSocket(); }
 
@@ -783,11 +859,11 @@ protected:
      */
         inline bool
     isPendingControl(microtimeout_t timeout)
-        { return cso->isPendingRecv(timeout); }
+        { return cso && cso->isPendingRecv(timeout); }
 
     inline IPV6Host
     getControlSender(tpport_t *port = NULL) const
-        { return cso->getSender(port); }
+        { return cso? cso->getSender(port) : dso->getSender(port); }
 
     /**
      * Receive data from the control channel/socket.
@@ -801,11 +877,16 @@ protected:
         inline size_t
     recvControl(unsigned char *buffer, size_t len,
             IPV6Host& na, tpport_t& tp)
-        { na = cso->getSender(tp); return cso->recv(buffer,len); }
+        {
+            // with RTCP-mux, control packets come through recvData()
+            if ( !cso ) return 0;
+            na = cso->getSender(tp); return cso->recv(buffer,len);
+        }
 
+        // with RTCP-mux the data peer is used.
         inline void
         setControlPeerIPV6(const IPV6Host &host, tpport_t port)
-        { cso->setPeer(host,port); }
+        { if ( cso ) cso->setPeer(host,port); }
 
     /**
      * @return number of octets actually written
@@ -814,16 +895,16 @@ protected:
      */
         inline size_t
     sendControl(const unsigned char* const buffer, size_t len)
-        { return cso->send(buffer,len); }
+        { return cso? cso->send(buffer,len) : dso->send(buffer,len); }
 
     inline SOCKET getControlRecvSocket() const
-        { return cso->getRecvSocket(); }
+        { return cso? cso->getRecvSocket() : dso->getRecvSocket(); }
 
     inline void
     endSocket()
         {
-            dso->endSocket();
-            cso->endSocket();
+            if (dso) dso->endSocket();
+            if (cso) cso->endSocket();
             if (dso) delete dso;
             dso = NULL;
             if (cso) delete cso;
@@ -842,8 +923,9 @@ private:
                 dataBasePort = dataPort;
                 controlBasePort = controlPort;
             }
+            ServiceQueue::setSourceRemoval(true);
             dso = new RTPDataChannel(ia,dataBasePort);
-            cso = new RTCPChannel(ia,controlBasePort);
+            buildControl(ia);
         }
 
     void
@@ -857,11 +939,27 @@ private:
                 dataBasePort = dataPort;
                 controlBasePort = controlPort;
             }
+            ServiceQueue::setSourceRemoval(true);
             dso = new RTPDataChannel(IPV6Host("0.0.0.0"),dataBasePort);
-            cso = new RTCPChannel(IPV6Host("0.0.0.0"),controlBasePort);
+            buildControl(IPV6Host("0.0.0.0"));
             joinGroup(ia,iface);
         }
 
+    /**
+     * Create the control channel, unless it is the data port
+     * itself, in which case RTCP is multiplexed with RTP.
+     **/
+    void
+    buildControl(const IPV6Host& ia)
+        {
+            if ( controlBasePort == dataBasePort ) {
+                cso = NULL;
+                ServiceQueue::setRTCPMux(true);
+            } else {
+                cso = new RTCPChannel(ia,controlBasePort);
+            }
+        }
+
     /**
      * Join a multicast group.
      *
@@ -874,7 +972,7 @@ private:
             Socket::Error error  = dso->setMulticast(true);
             if ( error ) return error;
             error = dso->join(ia,iface);
-            if ( error ) return error;
+            if ( error || !cso ) return error;
             error = cso->setMulticast(true);
             if ( error ) {
                 dso->drop(ia);
@@ -900,7 +998,7 @@ private:
             Socket::Error error = dso->setMulticast(false);
             if ( error ) return error;
             error = dso->leaveGroup(ia);
-            if ( error ) return error;
+            if ( error || !cso ) return error;
             error = cso->setMulticast(false);
             if ( error ) return error;
             return cso->leaveGroup(ia);
@@ -918,7 +1016,7 @@ private:
             Socket::Error error = dso->setMulticast(true);
             if ( error ) return error;
             error = dso->setTimeToLive(ttl);
-            if ( error ) return error;
+            if ( error || !cso ) return error;
             error = cso->setMulticast(true);
             if ( error ) return error;
             return cso->setTimeToLive(ttl);
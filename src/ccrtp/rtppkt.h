@@ -55,6 +55,114 @@ NAMESPACE_COMMONCPP
  * @{
  **/
 
+/**
+ * @class RTPBlockPool
+ * @short Free list of fixed size memory blocks.
+ *
+ * Used to recycle the buffers, packet objects and packet links of
+ * incoming data packets, so that reception does no heap allocation in
+ * steady state. Blocks are released from any thread, usually the
+ * application one (see AppDataUnit), possibly after the queue that
+ * created the pool is gone. Thus pools are reference counted: the
+ * creator and each block in use hold a reference, and the pool is
+ * deleted when the last one is dropped.
+ *
+ * Each block is preceded by a small header that records the pool it
+ * belongs to, so that it can be freed through deallocate() without
+ * knowing its origin.
+ **/
+class __EXPORT RTPBlockPool
+{
+public:
+    /**
+     * Build a pool. The caller holds a reference to it that must be
+     * dropped with release().
+     *
+     * @param size size of the blocks of this pool, in octets.
+     * @param maxfree maximum number of free blocks kept.
+     **/
+    RTPBlockPool(size_t size, size_t maxfree);
+
+    /**
+     * Drop the reference held by the creator of the pool.
+     **/
+    void
+    release();
+
+    inline size_t
+    getBlockSize() const
+    { return blockSize; }
+
+    /**
+     * Fill the free list with blocks, up to the maximum number of
+     * free blocks kept.
+     *
+     * @param count number of blocks to preallocate.
+     **/
+    void
+    reserve(size_t count);
+
+    /**
+     * Get a memory block.
+     *
+     * @param size octets requested.
+     * @param pool pool to take the block from. If NULL or size
+     * exceeds the block size of the pool, the block is taken from
+     * the heap.
+     * @return pointer to the block.
+     **/
+    static void*
+    allocate(size_t size, RTPBlockPool* pool);
+
+    /**
+     * Free a block obtained from allocate(). NULL is ignored.
+     *
+     * @param block pointer to the block.
+     **/
+    static void
+    deallocate(void* block);
+
+private:
+    /// Blocks are only deleted through release() or deallocate().
+    ~RTPBlockPool();
+
+    RTPBlockPool(const RTPBlockPool&);
+
+    RTPBlockPool&
+    operator=(const RTPBlockPool&);
+
+    /**
+     * @union BlockHeader
+     * Placed in front of each block. Sized so that the block that
+     * follows is suitably aligned for any type.
+     **/
+    union BlockHeader
+    {
+        struct
+        {
+            RTPBlockPool* pool;
+            BlockHeader* next;
+        } link;
+        double alignDouble;
+        uint64 alignInt;
+        void* alignPointer[2];
+    };
+
+    void*
+    get();
+
+    void
+    put(BlockHeader* header);
+
+    Mutex poolMutex;
+    BlockHeader* freeList;
+    size_t freeCount;
+    size_t maxFree;
+    size_t blockSize;
+    /// creator plus blocks in use
+    size_t references;
+};
+
 /**
  * @class RTPPacket
  * @short A base class for both IncomingRTPPkt and OutgoingRTPPkt.
@@ -87,10 +195,12 @@ public:
      *        packet
      * @param duplicate whether to memcopy the packet. At present,
      *        this feature is not used.
+     * @param pooled whether block was obtained from
+     *        RTPBlockPool::allocate() rather than new[].
      * @note used in IncomingRTPPkt.
      **/
     RTPPacket(const unsigned char* const block, size_t len,
-          bool duplicate = false);
+          bool duplicate = false, bool pooled = false);
 
     /**
      * Construct a packet object without specifying its real
@@ -101,9 +211,11 @@ public:
      * @param hdrlen length of the header (including CSRC and extension).
      * @param plen payload length.
      * @param paddinglen pad packet to a multiple of paddinglen
+     * @param pool if not NULL, pool to allocate the buffer from.
      * @note used in OutgoingRTPPkt.
      */
-        RTPPacket(size_t hdrlen, size_t plen, uint8 paddinglen, CryptoContext* pcc= NULL);
+        RTPPacket(size_t hdrlen, size_t plen, uint8 paddinglen, CryptoContext* pcc= NULL,
+                  RTPBlockPool* pool = NULL);
 
     /**
      * Get the length of the header, including contributing
@@ -386,6 +498,8 @@ private:
     uint32 hdrSize;
     /// whether the object was contructed with duplicated = true
     bool duplicated;
+    /// whether the buffer must be freed through RTPBlockPool
+    bool pooled;
 
 #ifdef  CCXX_PACKED
 #pragma pack(1)
@@ -558,10 +672,12 @@ public:
      * @param paddinglen pad packet to a multiple of paddinglen.
          * @param pcc Pointer to the SRTP CryptoContext, defaults to NULL
          * if not specified.
+     * @param pool if not NULL, pool to allocate the packet memory from.
          **/
     OutgoingRTPPkt(const uint32* const csrcs, uint16 numcsrc,
                const unsigned char* const data, size_t datalen,
-                       uint8 paddinglen= 0, CryptoContext* pcc= NULL);
+                       uint8 paddinglen= 0, CryptoContext* pcc= NULL,
+               RTPBlockPool* pool = NULL);
 
     /**
      * Construct a new packet (fast variant, with no contributing
@@ -578,13 +694,34 @@ public:
      * @param paddinglen pad packet to a multiple of paddinglen.
          * @param pcc Pointer to the SRTP CryptoContext, defaults to NULL
          * if not specified.
+     * @param pool if not NULL, pool to allocate the packet memory from.
          **/
     OutgoingRTPPkt(const unsigned char* const data, size_t datalen,
-                       uint8 paddinglen= 0, CryptoContext* pcc= NULL);
+                       uint8 paddinglen= 0, CryptoContext* pcc= NULL,
+               RTPBlockPool* pool = NULL);
 
     ~OutgoingRTPPkt()
     { }
 
+    /**
+     * Packet objects may be allocated from a RTPBlockPool.
+     **/
+    inline static void*
+    operator new(size_t size)
+    { return RTPBlockPool::allocate(size,NULL); }
+
+    inline static void*
+    operator new(size_t size, RTPBlockPool* pool)
+    { return RTPBlockPool::allocate(size,pool); }
+
+    inline static void
+    operator delete(void* p)
+    { RTPBlockPool::deallocate(p); }
+
+    inline static void
+    operator delete(void* p, RTPBlockPool*)
+    { RTPBlockPool::deallocate(p); }
+
     /**
      * @param pt Packet payload type.
      **/
@@ -654,6 +791,24 @@ public:
          */
         void protect(uint32 ssrc, CryptoContext* pcc);
 
+        /**
+         * Protect several packets of the same stream at once.
+         *
+         * The payloads of all the packets are encrypted first and
+         * then all the authentication tags are computed, so that the
+         * cipher and the MAC keep their state and key schedule warm
+         * instead of alternating for each packet. The packets must be
+         * given in sending order.
+         *
+         * @param pkts array of packets to protect.
+         * @param count number of packets in the array.
+         * @param ssrc SSRC of the stream, in host order.
+         * @param pcc Pointer to SRTP CryptoContext.
+         */
+        static void
+        protectBatch(OutgoingRTPPkt** pkts, size_t count, uint32 ssrc,
+                     CryptoContext* pcc);
+
     /**
      * Outgoing packets are equal if their sequence numbers match.
      **/
@@ -712,16 +867,39 @@ public:
      *
      * @param block pointer to the buffer the whole packet is stored in.
      * @param len length of the whole packet, expressed in octets.
+     * @param pooled whether block was obtained from
+     * RTPBlockPool::allocate(), so that it is freed through
+     * RTPBlockPool::deallocate().
      *
      * @note If check fails, the packet object is
      * incomplete. checking isHeaderValid() is recommended before
      * using a new RTPPacket object.
      **/
-    IncomingRTPPkt(const unsigned char* block, size_t len);
+    IncomingRTPPkt(const unsigned char* block, size_t len,
+               bool pooled = false);
 
     ~IncomingRTPPkt()
     { }
 
+    /**
+     * Packet objects may be allocated from a RTPBlockPool.
+     **/
+    inline static void*
+    operator new(size_t size)
+    { return RTPBlockPool::allocate(size,NULL); }
+
+    inline static void*
+    operator new(size_t size, RTPBlockPool* pool)
+    { return RTPBlockPool::allocate(size,pool); }
+
+    inline static void
+    operator delete(void* p)
+    { RTPBlockPool::deallocate(p); }
+
+    inline static void
+    operator delete(void* p, RTPBlockPool*)
+    { RTPBlockPool::deallocate(p); }
+
     /**
      * Get validity of this packet
      * @return whether the header check performed at construction
@@ -731,6 +909,19 @@ public:
     isHeaderValid()
     { return headerValid; }
 
+    /**
+     * Tell whether a packet received on a data port is a RTCP
+     * one, as happens when RTP and RTCP are multiplexed on a
+     * single port (RFC 5761). RTCP packet types 192 to 223 take
+     * the place of the marker bit and RTP payload types 64 to 95.
+     *
+     * @param buffer pointer to the received packet.
+     * @param len length of the received packet, in octets.
+     * @return whether the packet should be handled as RTCP.
+     **/
+    static bool
+    isControlPacket(const unsigned char* buffer, size_t len);
+
     /**
      * Get synchronization source numeric identifier.
      *
@@ -754,6 +945,24 @@ public:
         int32
         unprotect(CryptoContext* pcc);
 
+        /**
+         * Unprotect several received packets at once.
+         *
+         * The replay checks and authentication tags of all the
+         * packets are verified first, in reception order, and then
+         * the payloads of the authentic packets are decrypted.
+         *
+         * @param pkts array of packets to unprotect.
+         * @param pccs SRTP CryptoContext of each packet, NULL for
+         *     packets not protected.
+         * @param results receives the value unprotect() would return
+         *     for each packet.
+         * @param count number of packets in the arrays.
+         */
+        static void
+        unprotectBatch(IncomingRTPPkt** pkts, CryptoContext** pccs,
+                       int32* results, size_t count);
+
     /**
      * Two incoming packets are equal if they come from sources
      * with the same SSRC and have the same sequence number.
@@ -772,6 +981,18 @@ public:
     { return !( *this == p ); }
 
 private:
+    /**
+     * Check the replay protection and the authentication tag of a
+     * received packet and update the SRTP CryptoContext, leaving the
+     * payload encrypted (unless the context is an AEAD one).
+     *
+     * @param pcc Pointer to SRTP CryptoContext.
+     * @param index receives the SRTP index of the packet.
+     * @return same as unprotect().
+     */
+    int32
+    verify(CryptoContext* pcc, uint64& index);
+
     /**
      * Copy constructor from objects of its same kind, declared
      * private to avoid its use.
@@ -794,6 +1015,10 @@ private:
     // packets.
     static const uint16 RTP_INVALID_PT_MASK;
     static const uint16 RTP_INVALID_PT_VALUE;
+    // Masks for RTP/RTCP demultiplexing: the second octet of RTCP
+    // packets is in the 192 to 223 range.
+    static const uint8 RTCP_MUX_PT_MASK;
+    static const uint8 RTCP_MUX_PT_VALUE;
 };
 
 /** @}*/ // rtppacket
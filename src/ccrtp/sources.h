@@ -213,14 +213,15 @@ public:
      * packets are received, it will reach the stateInactive
      * state. If, after a small number of RTCP report intervals,
      * no packet is received from an inactive source, it will be
-     * deleted.
+     * deleted (only if enabled, see
+     * IncomingDataQueue::setSourceRemoval()).
      *
      * If RTCP is being used, after receiving a BYE RTCP packet
      * from a synchronization source, it will reach the
-     * stateLeaving state and will be deleted after a delay (see
+     * stateLeaving state and may be deleted after a delay (see
      * QueueRTCPManager::setLeavingDelay()).
      *
-     * Sources in statePrevalid and stateLeaving are not counted
+     * Sources in stateInactive and stateLeaving are not counted
      * for the number of session members estimation.
      **/
     typedef enum {
@@ -289,6 +290,7 @@ protected:
 
 private:
     friend class SyncSourceHandler;
+    friend class AppDataUnit;
 
     inline void
     setState(State st)
@@ -340,6 +342,9 @@ private:
     // service queue. Saves a lot of searches in the membership
     // table.
     void* link;
+    // Number of AppDataUnit objects referring to this source. The
+    // source is not deleted while there are any.
+    mutable volatile uint32 dataUnits;
 };
 
 /**
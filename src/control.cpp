@@ -96,6 +96,13 @@ queueApplication(app), srtcpIndex(0)
     leavingDelay = 1000000; // 1 second
     end2EndDelay = getDefaultEnd2EndDelay();
 
+    rtcpMux = false;
+    reducedSizeRTCP = false;
+    controlBatching = false;
+    controlPacketBuffer = new unsigned char[getPathMTU()];
+    pendingControl = new unsigned char[getPathMTU() / 2];
+    pendingControlLen = 0;
+
     // Fill in fixed fields that will never change
     RTCPPacket* pkt = reinterpret_cast<RTCPPacket*>(rtcpSendBuffer);
     pkt->fh.version = CCRTP_VERSION;
@@ -148,6 +155,13 @@ queueApplication(app), srtcpIndex(0)
     leavingDelay = 1000000; // 1 second
     end2EndDelay = getDefaultEnd2EndDelay();
 
+    rtcpMux = false;
+    reducedSizeRTCP = false;
+    controlBatching = false;
+    controlPacketBuffer = new unsigned char[getPathMTU()];
+    pendingControl = new unsigned char[getPathMTU() / 2];
+    pendingControlLen = 0;
+
     // Fill in fixed fields that will never change
     RTCPPacket* pkt = reinterpret_cast<RTCPPacket*>(rtcpSendBuffer);
     pkt->fh.version = CCRTP_VERSION;
@@ -170,6 +184,12 @@ void QueueRTCPManager::endQueueRTCPManager()
     removeOutQueueCryptoContextCtrl(NULL);   // remove the outgoing crypto context
     removeInQueueCryptoContextCtrl(NULL);    // Remove any incoming crypto contexts
 
+    MutexLock lock(pendingControlMutex);
+    delete [] controlPacketBuffer;
+    controlPacketBuffer = NULL;
+    delete [] pendingControl;
+    pendingControl = NULL;
+    pendingControlLen = 0;
 }
 
 bool QueueRTCPManager::checkSSRCInRTCPPkt(SyncSourceLink& sourceLink,
@@ -307,7 +327,78 @@ bool QueueRTCPManager::timerReconsideration()
 
 void
 QueueRTCPManager::expireSSRCs()
-{}
+{
+    if ( 0 == getSourceExpirationPeriod() )
+        return;
+
+    timeval now;
+    gettimeofday(&now,NULL);
+    SyncSourceLink* link = takeExpirationDue(now.tv_sec);
+    if ( NULL == link )
+        return;
+
+    // members time out after a number of deterministic intervals,
+    // senders after two (see section 6.3.5 in RFC 3550).
+    uint32 interval = (computeDeterministicRTCPInterval() + 999999) / 1000000;
+    uint32 memberTimeout = getSourceExpirationPeriod() * interval;
+    uint32 senderTimeout = 2 * interval;
+    uint32 t = now.tv_sec;
+
+    while ( NULL != link ) {
+        SyncSourceLink* next = link->getNextExpiry();
+        SyncSource& src = *(link->getSource());
+        uint32 lastData = link->getLastPacketTime().tv_sec;
+        uint32 lastControl = link->getLastRTCPPacketTime().tv_sec;
+        uint32 lastTime = ( lastData > lastControl ) ? lastData : lastControl;
+        // time of the next check, 0 to remove the source now.
+        uint32 when = 0;
+
+        if ( link->getExpiryTime() > t ) {
+            // taken early as the clock jumped.
+            when = link->getExpiryTime();
+        } else if ( src.getState() == SyncSource::stateLeaving ) {
+            // checked after the leaving delay since its BYE.
+            when = 0;
+        } else if ( 0 == lastTime ) {
+            // nothing received from the source itself yet (it was
+            // e.g. listed in a report): time it from the first
+            // check.
+            if ( 0 == link->getExpiryTime() )
+                when = t + memberTimeout;
+        } else {
+            if ( src.isSender() && lastData + senderTimeout <= t ) {
+                setSender(src,false);
+                decreaseSendersCount();
+            }
+            if ( lastTime + memberTimeout > t ) {
+                when = lastTime + memberTimeout;
+                if ( src.isSender() && lastData + senderTimeout < when )
+                    when = lastData + senderTimeout;
+                if ( src.getState() == SyncSource::stateInactive )
+                    setState(src,SyncSource::stateActive);
+            } else if ( src.getState() == SyncSource::stateActive ) {
+                setState(src,SyncSource::stateInactive);
+                when = lastTime + 2 * memberTimeout;
+            } else if ( src.getState() == SyncSource::stateInactive &&
+                        lastTime + 2 * memberTimeout > t ) {
+                when = lastTime + 2 * memberTimeout;
+            }
+        }
+
+        if ( when ) {
+            scheduleExpiration(*link,when);
+        } else if ( !isSourceRemoval() ) {
+            // kept inactive, it may come back.
+            if ( src.getState() != SyncSource::stateLeaving )
+                scheduleExpiration(*link,t + memberTimeout);
+        } else if ( !removeIdleSource(*link) ) {
+            // do not pull the source from under its queued
+            // packets or data units.
+            scheduleExpiration(*link,t + 1);
+        }
+        link = next;
+    }
+}
 
 void
 QueueRTCPManager::takeInControlPacket()
@@ -321,6 +412,30 @@ QueueRTCPManager::takeInControlPacket()
     struct timeval recvtime;
     gettimeofday(&recvtime,NULL);
 
+    processControlPacket(len,network_address,transport_port,recvtime);
+}
+
+bool
+QueueRTCPManager::takeInMuxedControlPacket(const unsigned char* buffer,
+                       size_t len, InetHostAddress& na, tpport_t tp,
+                       const timeval& recvtime)
+{
+    if ( !isRTCPMux() )
+        return false;
+    // too long for a RTCP compound packet, drop it.
+    if ( len <= getPathMTU() ) {
+        memcpy(rtcpRecvBuffer,buffer,len);
+        processControlPacket(len,na,tp,recvtime);
+    }
+    return true;
+}
+
+void
+QueueRTCPManager::processControlPacket(size_t len,
+                       InetHostAddress& network_address,
+                       tpport_t transport_port,
+                       const timeval& recvtime)
+{
     // process a 'len' octets long RTCP compound packet
 
     RTCPPacket *pkt = reinterpret_cast<RTCPPacket *>(rtcpRecvBuffer);
@@ -348,7 +463,8 @@ QueueRTCPManager::takeInControlPacket()
         len = ret;      // adjust length after unprotecting the packet
     }
     // Check validity of the header fields of the compound packet
-    if ( !RTCPCompoundHandler::checkCompoundRTCPHeader(len) )
+    if ( !RTCPCompoundHandler::checkCompoundRTCPHeader(len,
+             isReducedSizeRTCP()) )
         return;
 
 
@@ -360,6 +476,8 @@ QueueRTCPManager::takeInControlPacket()
     SyncSource* s = sourceLink->getSource();
 
     if ( source_created ) {
+        // have the SRTP context ready before data packets arrive
+        prepareInQueueCryptoContext(pkt->getSSRC());
         // Set control transport address.
         setControlTransportPort(*s,transport_port);
         // Network address is assumed to be the same as the control one
@@ -555,6 +673,7 @@ bool QueueRTCPManager::getBYE(RTCPPacket& pkt, size_t& pointer, size_t)
             onGotGoodbye(*(srcLink->getSource()),reason);
         BYESource(pkt.getSSRC());
         setState(*(srcLink->getSource()),SyncSource::stateLeaving);
+        scheduleLeaving(*srcLink);
 
         reverseReconsideration();
     }
@@ -694,7 +813,27 @@ bool QueueRTCPManager::onGotSDESChunk(SyncSource& source, SDESChunk& chunk, size
     return cname_found;
 }
 
+void
+QueueRTCPManager::scheduleLeaving(SyncSourceLink& link)
+{
+    timeval now;
+    gettimeofday(&now,NULL);
+    scheduleExpiration(link,now.tv_sec + (leavingDelay + 999999) / 1000000);
+}
+
 timeval QueueRTCPManager::computeRTCPInterval()
+{
+    microtimeout_t interval = computeDeterministicRTCPInterval();
+    interval = static_cast<microtimeout_t>(interval * ( 0.5 +
+        (rand() / (RAND_MAX + 1.0))));
+
+    timeval result;
+    result.tv_sec = interval / 1000000;
+    result.tv_usec = interval % 1000000;
+    return result;
+}
+
+microtimeout_t QueueRTCPManager::computeDeterministicRTCPInterval()
 {
     float bwfract = controlBwFract * getSessionBandwidth();
     uint32 participants = getMembersCount();
@@ -729,14 +868,7 @@ timeval QueueRTCPManager::computeRTCPInterval()
         // 100 seconds instead of infinite
         interval = 100000000;
     }
-
-    interval = static_cast<microtimeout_t>(interval * ( 0.5 +
-        (rand() / (RAND_MAX + 1.0))));
-
-    timeval result;
-    result.tv_sec = interval / 1000000;
-    result.tv_usec = interval % 1000000;
-    return result;
+    return interval;
 }
 
 #define BYE_BUFFER_LENGTH 500
@@ -829,7 +961,8 @@ void QueueRTCPManager::getOnlyBye()
                   network_address,transport_port)) ) {
         // Process a <code>len<code> octets long RTCP compound packet
         // Check validity of the header fields of the compound packet
-        if ( !RTCPCompoundHandler::checkCompoundRTCPHeader(len) )
+        if ( !RTCPCompoundHandler::checkCompoundRTCPHeader(len,
+                 isReducedSizeRTCP()) )
             return;
 
         // TODO: For now, we do nothing with the padding bit
@@ -848,6 +981,7 @@ void QueueRTCPManager::getOnlyBye()
                 if( srcLink->getGoodbye() )
                     onGotGoodbye(*(srcLink->getSource()), "");
                 BYESource(pkt->getSSRC());
+                scheduleLeaving(*srcLink);
             }
             pointer += pkt->getLength();
         }
@@ -908,30 +1042,42 @@ size_t QueueRTCPManager::dispatchControlPacket(void)
 
     // (B) put report blocks
     // After adding report blocks, we have to leave room for at
-    // least a CNAME SDES item
+    // least a CNAME SDES item and the packets queued by
+    // dispatchControlPackets(). These are only appended to, so
+    // the first pending octets stay the same until (D).
+    uint16 pending;
+    {
+        MutexLock lock(pendingControlMutex);
+        pending = pendingControlLen;
+    }
     uint16 available = (uint16)(getPathMTU()
         - lowerHeadersSize
         - len
         - (sizeof(RTCPFixedHeader) +
            2*sizeof(uint8) +
            getApplication().getSDESItem(SDESItemTypeCNAME).length())
+        - pending
         - 100);
 
     // if we have to go to a new RR packet
     bool another = false;
     uint16 prevlen = 0;
     RRBlock* reports;
+    // each source is looked at most once per compound.
+    uint32 sources = getSourcesCount();
+    timeval now;
+    gettimeofday(&now,NULL);
     if ( RTCPPacket::tRR == pkt->fh.type )
         reports = pkt->info.RR.blocks;
     else // ( RTCPPacket::tSR == pkt->fh.type )
         reports = pkt->info.SR.blocks;
     do {
         uint8 blocks = 0;
-        pkt->fh.block_count = blocks = packReportBlocks(reports,len,available);
+        pkt->fh.block_count = blocks = packReportBlocks(reports,len,available,sources,now);
         // the length field specifies 32-bit words
         pkt->fh.length = htons( ((len - prevlen) >> 2) - 1);
         prevlen = len;
-        if ( 31 == blocks ) {
+        if ( 31 == blocks && sources > 0 ) {
             // we would need room for a new RR packet and
             // a CNAME SDES
             if ( len < (available -
@@ -962,6 +1108,16 @@ size_t QueueRTCPManager::dispatchControlPacket(void)
     // fill the padding with 0s
     packSDES(len);
 
+    // (D) packets queued by dispatchControlPackets()
+    if ( pending ) {
+        MutexLock lock(pendingControlMutex);
+        memcpy(rtcpSendBuffer + len,pendingControl,pending);
+        len += pending;
+        pendingControlLen -= pending;
+        memmove(pendingControl,pendingControl + pending,
+            pendingControlLen);
+    }
+
     // TODO: virtual for sending APP RTCP packets?
 
     // actually send the packet.
@@ -973,6 +1129,50 @@ size_t QueueRTCPManager::dispatchControlPacket(void)
     return count;
 }
 
+size_t QueueRTCPManager::dispatchControlPackets(const unsigned char* packets, size_t len)
+{
+    // the sender SSRC of the first packet selects the SRTCP
+    // context, so there must be at least one.
+    if ( len < sizeof(RTCPFixedHeader) + sizeof(uint32) || (len & 0x03) )
+        return 0;
+
+    // Check every packet is tagged with version == CCRTP_VERSION
+    // and a RTCP packet type, and their lengths add up to len.
+    // Octets are read one by one as packets need not be aligned.
+    size_t pointer = 0;
+    while ( pointer + sizeof(RTCPFixedHeader) <= len ) {
+        if ( (packets[pointer] >> 6) != CCRTP_VERSION ||
+             packets[pointer + 1] < 192 || packets[pointer + 1] > 223 )
+            return 0;
+        pointer += ((packets[pointer + 2] << 8 |
+                 packets[pointer + 3]) + 1) << 2;
+    }
+    if ( pointer != len )
+        return 0;
+
+    MutexLock lock(pendingControlMutex);
+    if ( NULL == pendingControl )
+        return 0;
+
+    // RFC 5506 allows reduced-size packets only once a full
+    // compound packet has been sent.
+    if ( reducedSizeRTCP && !controlBatching && ctrlSendCount > 0 ) {
+        // leave room for the SRTCP index and authentication tag.
+        if ( len > (size_t)(getPathMTU() - lowerHeadersSize - 100) )
+            return 0;
+        memcpy(controlPacketBuffer,packets,len);
+        size_t count = sendControlToDestinations(controlPacketBuffer,len);
+        updateAvgRTCPSize(len);
+        return count;
+    }
+
+    if ( pendingControlLen + len > (size_t)(getPathMTU() / 2) )
+        return 0;
+    memcpy(pendingControl + pendingControlLen,packets,len);
+    pendingControlLen += (uint16)len;
+    return len;
+}
+
 void QueueRTCPManager::packSDES(uint16 &len)
 {
     uint16 prevlen = len;
@@ -1026,19 +1226,26 @@ void QueueRTCPManager::packSDES(uint16 &len)
     pkt->fh.length = htons((len - prevlen - 1) >>2);
 }
 
-uint8 QueueRTCPManager::packReportBlocks(RRBlock* blocks, uint16 &len, uint16& available)
+uint8 QueueRTCPManager::packReportBlocks(RRBlock* blocks, uint16 &len, uint16& available,
+                                        uint32& sources, const timeval& now)
 {
     uint8 j = 0;
-    // pack as many report blocks as we can
-    SyncSourceLink* i = getFirst();
-    for ( ;
-          ( ( i != NULL ) &&
-        ( len < (available - sizeof(RTCPCompoundHandler::RRBlock)) ) &&
-        ( j < 31 ) );
-          i = i->getNext() ) {
+    // pack as many report blocks as we can, going on from the
+    // source after the last one reported.
+    while ( ( sources > 0 ) &&
+            ( len < (available - sizeof(RTCPCompoundHandler::RRBlock)) ) &&
+            ( j < 31 ) ) {
+        SyncSourceLink* i = nextReportSource();
+        sources--;
+        if ( NULL == i )
+            break;
         SyncSourceLink& srcLink = *i;
-        // update stats.
-        srcLink.computeStats();
+        // only sources we have received data packets from
+        // lately (see section 6.4 in RFC 3550).
+        if ( !srcLink.getSource()->isSender() )
+            continue;
+        // cumulative stats are updated as packets arrive.
+        srcLink.computeFractionLost();
         blocks[j].ssrc = htonl(srcLink.getSource()->getID());
         blocks[j].rinfo.fractionLost = srcLink.getFractionLost();
         blocks[j].rinfo.lostMSB =
@@ -1059,8 +1266,7 @@ uint8 QueueRTCPManager::packReportBlocks(RRBlock* blocks, uint16 &len, uint16& a
                 htonl( ((ntohl(si->NTPMSW) & 0x0FFFF) << 16 )+
                        ((ntohl(si->NTPLSW) & 0xFFFF0000) >> 16)
                        );
-            timeval now, diff;
-            gettimeofday(&now,NULL);
+            timeval diff;
             timeval last = srcLink.getLastRTCPSRTime();
             timersub(&now,&last,&diff);
             blocks[j].rinfo.dlsr =
@@ -1123,6 +1329,7 @@ SDESItemType QueueRTCPManager::nextSDESType(SDESItemType t)
 size_t QueueRTCPManager::sendControlToDestinations(unsigned char* buffer, size_t len)
 {
     size_t count = 0;
+    MutexLock lock(controlSendMutex);
     lockDestinationList();
     
     // Cast to have easy access to ssrc et al
@@ -1148,6 +1355,28 @@ size_t QueueRTCPManager::sendControlToDestinations(unsigned char* buffer, size_t
 
     if ( isSingleDestination() ) {
         count = sendControl(buffer,len);
+    } else if ( isRTCPMux() ) {
+        // with RTCP-mux control packets go to the data port and
+        // through the data channel. Each datagram carries its
+        // destination, so that the peer of the data channel, which
+        // the data packets sent meanwhile use, is not changed.
+        RTPDatagram msgs[MaxRTPBatchSize];
+        size_t n = 0;
+        for (std::list<TransportAddress*>::iterator i =
+                 destList.begin(); destList.end() != i; i++) {
+            TransportAddress* dest = *i;
+            msgs[n].buffer = buffer;
+            msgs[n].size = len;
+            msgs[n].host =
+                InetHostAddress(dest->getNetworkAddress().getAddress());
+            msgs[n].port = dest->getDataTransportPort();
+            if ( ++n == MaxRTPBatchSize ) {
+                count += sendDataBatch(msgs,n) * len;
+                n = 0;
+            }
+        }
+        if ( n )
+            count += sendDataBatch(msgs,n) * len;
     } else {
         // when no destination has been added, NULL == dest.
         for (std::list<TransportAddress*>::iterator i =
@@ -1170,18 +1399,28 @@ QueueRTCPManager::protect(uint8* pkt, size_t len, CryptoContextCtrl* pcc) {
     uint32 ssrc = *(reinterpret_cast<uint32*>(pkt + 4)); // always SSRC of sender
     ssrc =ntohl(ssrc);
 
-    pcc->srtcpEncrypt(pkt + 8, len - 8, srtcpIndex, ssrc);
-
     uint32 encIndex = srtcpIndex | 0x80000000;  // set the E flag
 
-    uint32* ip = reinterpret_cast<uint32*>(pkt+len);
-    *ip = htonl(encIndex);   
-
     // NO MKI support yet - here we assume MKI is zero. To build in MKI
     // take MKI length into account when storing the authentication tag.
 
-    // Compute MAC and store in packet after the SRTCP index field
-    pcc->srtcpAuthenticate(pkt, len, encIndex, pkt + len + sizeof(uint32));
+    if (pcc->isAead()) {
+        // Encrypt and store the tag just after the encrypted packet,
+        // followed by the SRTCP index field (RFC 7714)
+        pcc->srtcpAeadEncrypt(pkt, len, encIndex, ssrc, pkt + len);
+
+        uint32* ip = reinterpret_cast<uint32*>(pkt + len + pcc->getTagLength());
+        *ip = htonl(encIndex);
+    }
+    else {
+        pcc->srtcpEncrypt(pkt + 8, len - 8, srtcpIndex, ssrc);
+
+        uint32* ip = reinterpret_cast<uint32*>(pkt+len);
+        *ip = htonl(encIndex);
+
+        // Compute MAC and store in packet after the SRTCP index field
+        pcc->srtcpAuthenticate(pkt, len, encIndex, pkt + len + sizeof(uint32));
+    }
 
     srtcpIndex++;
     srtcpIndex &= ~0x80000000;       // clear possible overflow
@@ -1198,8 +1437,11 @@ QueueRTCPManager::unprotect(uint8* pkt, size_t len, CryptoContextCtrl* pcc) {
     // Compute the total length of the payload
     uint32 payloadLen = len - (pcc->getTagLength() + pcc->getMkiLength() + 4);
 
-    // point to the SRTCP index field just after the real payload
+    // point to the SRTCP index field just after the real payload, or
+    // after the authentication tag with AES GCM
     const uint32* index = reinterpret_cast<uint32*>(pkt + payloadLen);
+    if (pcc->isAead())
+        index = reinterpret_cast<uint32*>(pkt + payloadLen + pcc->getTagLength());
     uint32 ssrc = *(reinterpret_cast<uint32*>(pkt + 4)); // always SSRC of sender
     ssrc =ntohl(ssrc);
 
@@ -1210,14 +1452,20 @@ QueueRTCPManager::unprotect(uint8* pkt, size_t len, CryptoContextCtrl* pcc) {
        return -2;
     }
 
-    uint8 mac[20];
+    if (pcc->isAead()) {
+        // Check the tag and decrypt the content in one pass
+        if (!pcc->srtcpAeadDecrypt(pkt, payloadLen, encIndex, ssrc, pkt + payloadLen))
+            return -1;
+
+        pcc->update(remoteIndex);
+        return payloadLen;
+    }
 
     // Now get a pointer to the authentication tag field
     const uint8* tag = pkt + (len - pcc->getTagLength());
 
     // Authenticate includes the index, but not MKI and not (obviously) the tag itself
-    pcc->srtcpAuthenticate(pkt, payloadLen, encIndex, mac);
-    if (memcmp(tag, mac, pcc->getTagLength()) != 0) {
+    if (!pcc->srtcpCheckTag(pkt, payloadLen, encIndex, tag)) {
         return -1;
     }
 
@@ -1235,117 +1483,51 @@ QueueRTCPManager::unprotect(uint8* pkt, size_t len, CryptoContextCtrl* pcc) {
 void
 QueueRTCPManager::setOutQueueCryptoContextCtrl(CryptoContextCtrl* cc)
 {
-    std::list<CryptoContextCtrl *>::iterator i;
-
     MutexLock lock(outCryptoMutex);
-        // check if a CryptoContext for a SSRC already exists. If yes
-        // remove it from list before inserting the new one.
-    for( i = outCryptoContexts.begin(); i!= outCryptoContexts.end(); i++ ) {
-        if( (*i)->getSsrc() == cc->getSsrc() ) {
-            CryptoContextCtrl* tmp = *i;
-            outCryptoContexts.erase(i);
-            delete tmp;
-            break;
-        }
-    }
-    outCryptoContexts.push_back(cc);
+    // a context for the same SSRC is replaced.
+    outCryptoContexts.insert(cc);
 }
 
 void
 QueueRTCPManager::removeOutQueueCryptoContextCtrl(CryptoContextCtrl* cc)
 {
-    std::list<CryptoContextCtrl *>::iterator i;
-
     MutexLock lock(outCryptoMutex);
-    if (cc == NULL) {     // Remove any incoming crypto contexts
-        for (i = outCryptoContexts.begin(); i != outCryptoContexts.end(); ) {
-            CryptoContextCtrl* tmp = *i;
-            i = outCryptoContexts.erase(i);
-            delete tmp;
-        }
-    }
-    else {
-        for( i = outCryptoContexts.begin(); i != outCryptoContexts.end(); i++ ) {
-            if( (*i)->getSsrc() == cc->getSsrc() ) {
-                CryptoContextCtrl* tmp = *i;
-                outCryptoContexts.erase(i);
-                delete tmp;
-                return;
-            }
-        }
-    }
+    if (cc == NULL)      // Remove any crypto contexts
+        outCryptoContexts.clear();
+    else
+        outCryptoContexts.remove(cc->getSsrc());
 }
 
 CryptoContextCtrl*
 QueueRTCPManager::getOutQueueCryptoContextCtrl(uint32 ssrc)
 {
-    std::list<CryptoContextCtrl *>::iterator i;
-
-    MutexLock lock(outCryptoMutex);
-    for( i = outCryptoContexts.begin(); i != outCryptoContexts.end(); i++ ){
-        if( (*i)->getSsrc() == ssrc) {
-            return (*i);
-        }
-    }
-    return NULL;
+    // lookups do not need the lock, see CryptoContextTable.
+    return outCryptoContexts.find(ssrc);
 }
 
 void
 QueueRTCPManager::setInQueueCryptoContextCtrl(CryptoContextCtrl* cc)
 {
-    std::list<CryptoContextCtrl *>::iterator i;
-
     MutexLock lock(inCryptoMutex);
-    // check if a CryptoContext for a SSRC already exists. If yes
-    // remove it from list before inserting the new one.
-    for( i = inCryptoContexts.begin(); i!= inCryptoContexts.end(); i++ ) {
-        if( (*i)->getSsrc() == cc->getSsrc() ) {
-            CryptoContextCtrl* tmp = *i;
-            inCryptoContexts.erase(i);
-            delete tmp;
-            break;
-        }
-    }
-    inCryptoContexts.push_back(cc);
+    // a context for the same SSRC is replaced.
+    inCryptoContexts.insert(cc);
 }
 
 void
 QueueRTCPManager::removeInQueueCryptoContextCtrl(CryptoContextCtrl* cc)
 {
-    std::list<CryptoContextCtrl *>::iterator i;
-
     MutexLock lock(inCryptoMutex);
-    if (cc == NULL) {     // Remove any incoming crypto contexts
-        for (i = inCryptoContexts.begin(); i != inCryptoContexts.end(); ) {
-            CryptoContextCtrl* tmp = *i;
-            i = inCryptoContexts.erase(i);
-            delete tmp;
-        }
-    }
-    else {
-        for( i = inCryptoContexts.begin(); i!= inCryptoContexts.end(); i++ ){
-            if( (*i)->getSsrc() == cc->getSsrc() ) {
-                CryptoContextCtrl* tmp = *i;
-                inCryptoContexts.erase(i);
-                delete tmp;
-                return;
-            }
-        }
-    }
+    if (cc == NULL)      // Remove any crypto contexts
+        inCryptoContexts.clear();
+    else
+        inCryptoContexts.remove(cc->getSsrc());
 }
 
 CryptoContextCtrl*
 QueueRTCPManager::getInQueueCryptoContextCtrl(uint32 ssrc)
 {
-    std::list<CryptoContextCtrl *>::iterator i;
-
-    MutexLock lock(inCryptoMutex);
-    for( i = inCryptoContexts.begin(); i!= inCryptoContexts.end(); i++ ){
-        if( (*i)->getSsrc() == ssrc) {
-            return (*i);
-        }
-    }
-    return NULL;
+    // lookups do not need the lock, see CryptoContextTable.
+    return inCryptoContexts.find(ssrc);
 }
 
 END_NAMESPACE
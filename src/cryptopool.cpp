@@ -0,0 +1,275 @@
+// Copyright (C) 2026 the GNU ccRTP contributors.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+//
+// As a special exception, you may use this file as part of a free software
+// library without restriction.  Specifically, if other files instantiate
+// templates or use macros or inline functions from this file, or you compile
+// this file and link it with other files to produce an executable, this
+// file does not by itself cause the resulting executable to be covered by
+// the GNU General Public License.  This exception does not however
+// invalidate any other reasons why the executable file might be covered by
+// the GNU General Public License.
+//
+// This exception applies only to the code released under the name GNU
+// ccRTP.  If you copy code from other releases into a copy of GNU
+// ccRTP, as the General Public License permits, the exception does
+// not apply to the code that you add in this way.  To avoid misleading
+// anyone as to the status of such modified files, you must delete
+// this exception notice from them.
+//
+// If you write modifications of your own for GNU ccRTP, it is your choice
+// whether to permit this exception to apply to your modifications.
+// If you do not wish that, delete this exception notice.
+//
+
+#include "private.h"
+#include <ccrtp/cryptopool.h>
+
+NAMESPACE_COMMONCPP
+
+/**
+ * Worker thread of an SRTPCryptoPool: runs the jobs of its queue in
+ * the order they were submitted.
+ **/
+class SRTPCryptoPool::Worker : public Thread
+{
+public:
+    Worker(int pri) :
+        Thread(pri), first(NULL), last(NULL), pending(0), stopping(false)
+    { }
+
+    void
+    submit(Job* job);
+
+    /**
+     * Run the jobs still queued and wait for the thread to end.
+     **/
+    void
+    stop();
+
+protected:
+    void run();
+
+private:
+    /**
+     * Take the first job of the queue.
+     *
+     * @param done set when the queue is empty and the worker is
+     * being stopped.
+     **/
+    Job*
+    takeJob(bool& done);
+
+    Mutex jobMutex;
+    Job* first, * last;
+    // one count per queued job, plus one to stop.
+    Semaphore pending;
+    bool stopping;
+};
+
+void
+SRTPCryptoPool::Worker::submit(Job* job)
+{
+    {
+        MutexLock lock(jobMutex);
+        job->next = NULL;
+        if ( last )
+            last->next = job;
+        else
+            first = job;
+        last = job;
+    }
+    pending.post();
+}
+
+void
+SRTPCryptoPool::Worker::stop()
+{
+    {
+        MutexLock lock(jobMutex);
+        stopping = true;
+    }
+    pending.post();
+    join();
+}
+
+SRTPCryptoPool::Job*
+SRTPCryptoPool::Worker::takeJob(bool& done)
+{
+    MutexLock lock(jobMutex);
+    Job* job = first;
+    if ( job ) {
+        first = job->next;
+        if ( NULL == first )
+            last = NULL;
+    }
+    done = ( NULL == job ) && stopping;
+    return job;
+}
+
+void
+SRTPCryptoPool::Worker::run()
+{
+    bool done = false;
+    while ( !done ) {
+        pending.wait();
+        Job* job = takeJob(done);
+        if ( job )
+            job->run();
+    }
+}
+
+/**
+ * The packets of a received batch that go to one worker, in
+ * reception order.
+ **/
+class SRTPCryptoPool::UnprotectJob : public SRTPCryptoPool::Job
+{
+public:
+    UnprotectJob(Semaphore& sem) :
+        count(0), finished(sem)
+    { }
+
+    inline void
+    add(IncomingRTPPkt* pkt, CryptoContext* pcc, int32* result)
+    {
+        pkts[count] = pkt;
+        pccs[count] = pcc;
+        results[count] = result;
+        count++;
+    }
+
+    /**
+     * Unprotect the packets, without notifying the end.
+     **/
+    void
+    unprotect();
+
+    void
+    run()
+    { unprotect(); finished.post(); }
+
+private:
+    IncomingRTPPkt* pkts[MaxRTPBatchSize];
+    CryptoContext* pccs[MaxRTPBatchSize];
+    int32* results[MaxRTPBatchSize];
+    size_t count;
+    Semaphore& finished;
+};
+
+void
+SRTPCryptoPool::UnprotectJob::unprotect()
+{
+    int32 r[MaxRTPBatchSize];
+    IncomingRTPPkt::unprotectBatch(pkts,pccs,r,count);
+    for ( size_t i = 0; i < count; i++ )
+        *(results[i]) = r[i];
+}
+
+SRTPCryptoPool::SRTPCryptoPool(unsigned int nthreads, int pri) :
+workers(NULL), workerCount(nthreads)
+{
+    if ( 0 == workerCount ) {
+#ifdef  _SC_NPROCESSORS_ONLN
+        long processors = sysconf(_SC_NPROCESSORS_ONLN);
+        workerCount = (processors > 0)? static_cast<unsigned int>(processors) : 1;
+#else
+        workerCount = 1;
+#endif
+    }
+    workers = new Worker*[workerCount];
+    for ( unsigned int i = 0; i < workerCount; i++ ) {
+        workers[i] = new Worker(pri);
+        workers[i]->start();
+    }
+}
+
+SRTPCryptoPool::~SRTPCryptoPool()
+{
+    for ( unsigned int i = 0; i < workerCount; i++ ) {
+        workers[i]->stop();
+        delete workers[i];
+    }
+    delete [] workers;
+}
+
+void
+SRTPCryptoPool::submit(uint32 key, Job* job)
+{
+    workers[getWorkerIndex(key)]->submit(job);
+}
+
+void
+SRTPCryptoPool::unprotectBatch(IncomingRTPPkt** pkts, CryptoContext** pccs,
+                   int32* results, size_t count)
+{
+    Semaphore finished(0);
+    UnprotectJob** jobs = new UnprotectJob*[workerCount];
+
+    while ( count > 0 ) {
+        size_t n = (count > MaxRTPBatchSize) ? MaxRTPBatchSize : count;
+
+        // one job per worker, the packets of each source go to the
+        // same job in reception order.
+        for ( unsigned int w = 0; w < workerCount; w++ )
+            jobs[w] = NULL;
+        for ( size_t i = 0; i < n; i++ ) {
+            if ( NULL == pccs[i] ) {
+                results[i] = 1;
+                continue;
+            }
+            unsigned int w = getWorkerIndex(pkts[i]->getSSRC());
+            if ( NULL == jobs[w] )
+                jobs[w] = new UnprotectJob(finished);
+            jobs[w]->add(pkts[i],pccs[i],&results[i]);
+        }
+
+        // the last job is run by this thread.
+        UnprotectJob* own = NULL;
+        size_t submitted = 0;
+        for ( unsigned int w = 0; w < workerCount; w++ ) {
+            if ( NULL == jobs[w] )
+                continue;
+            if ( own ) {
+                workers[w]->submit(jobs[w]);
+                submitted++;
+            } else {
+                own = jobs[w];
+            }
+        }
+        if ( own )
+            own->unprotect();
+        while ( submitted-- > 0 )
+            finished.wait();
+        for ( unsigned int w = 0; w < workerCount; w++ )
+            delete jobs[w];
+
+        pkts += n;
+        pccs += n;
+        results += n;
+        count -= n;
+    }
+    delete [] jobs;
+}
+
+END_NAMESPACE
+
+/** EMACS **
+ * Local variables:
+ * mode: c++
+ * c-basic-offset: 4
+ * End:
+ */
@@ -45,21 +45,31 @@
 
 NAMESPACE_COMMONCPP
 
+// Sources count the data units that refer to them, so that they are
+// not deleted from under the application.
 AppDataUnit::AppDataUnit(const IncomingRTPPkt& packet, const SyncSource& src):
 datablock(&packet), source(&src)
 {
-
+    rtpAtomicAdd(source->dataUnits,1);
 }
 
 AppDataUnit::AppDataUnit(const AppDataUnit &origin):
 datablock(origin.datablock), source(origin.source)
 {
     ++datablock;
+    rtpAtomicAdd(source->dataUnits,1);
+}
+
+AppDataUnit::~AppDataUnit()
+{
+    rtpAtomicAdd(source->dataUnits,-1);
 }
 
 AppDataUnit& AppDataUnit::operator=(const AppDataUnit &rhs)
 {
     datablock.operator=(rhs.datablock);
+    rtpAtomicAdd(rhs.source->dataUnits,1);
+    rtpAtomicAdd(source->dataUnits,-1);
     source = rhs.source;
     return *this;
 }
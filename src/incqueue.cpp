@@ -90,21 +90,61 @@ const uint16 IncomingDataQueue::defaultMaxPacketMisorder = 0;
 const uint16 IncomingDataQueue::defaultMaxPacketDropout = 3000;
 const size_t IncomingDataQueue::defaultMembersSize =
 MembershipBookkeeping::defaultMembersHashSize;
+const microtimeout_t IncomingDataQueue::defaultMinPlayoutDelay = 20000;
+const microtimeout_t IncomingDataQueue::defaultMaxPlayoutDelay = 400000;
+
+// maximum number of free blocks kept in each reception pool.
+static const size_t maxFreeRecvBlocks = 2 * MaxRTPBatchSize;
 
 IncomingDataQueue::IncomingDataQueue(uint32 size) :
 IncomingDataQueueBase(), MembershipBookkeeping(size)
 {
     recvFirst = recvLast = NULL;
+    recvBatchInfo = NULL;
+#ifdef  CCXX_IPV6
+    recvBatchInfoIPV6 = NULL;
+#endif
+    recvBatchSlots = 0;
+    recvBufferPool = recvPacketPool = recvLinkPool = NULL;
+    recvHandoff = NULL;
+    recvCryptoPool = NULL;
     sourceExpirationPeriod = 5; // 5 RTCP report intervals
+    sourceRemoval = false;
     minValidPacketSequence = getDefaultMinValidPacketSequence();
     maxPacketDropout = getDefaultMaxPacketDropout();
     maxPacketMisorder = getDefaultMaxPacketMisorder();
+    recvRingSize = 0;
+    minPlayoutDelay = defaultMinPlayoutDelay;
+    maxPlayoutDelay = defaultMaxPlayoutDelay;
+    for ( size_t i = 0; i < 4; i++ )
+        talkspurtMarkerTypes[i] = 0;
+    for ( int pt = firstStaticPayloadType; pt <= lastStaticAudioPayloadType; pt++ )
+        setPlayoutTalkspurtMarker(static_cast<PayloadType>(pt),true);
+}
+
+IncomingDataQueue::~IncomingDataQueue()
+{
+    // the queue has already been purged
+    delete recvHandoff;
+    for ( size_t i = 0; i < recvBatchSlots; i++ )
+        RTPBlockPool::deallocate(recvBatchInfo[i].buffer);
+    delete [] recvBatchInfo;
+#ifdef  CCXX_IPV6
+    delete [] recvBatchInfoIPV6;
+#endif
+    // packets still held by the application keep their pools alive
+    if ( recvBufferPool ) {
+        recvBufferPool->release();
+        recvPacketPool->release();
+        recvLinkPool->release();
+    }
 }
 
 void
 IncomingDataQueue::purgeIncomingQueue()
 {
     IncomingRTPPktLink* recvnext;
+    drainRecvHandoff();
     // flush the reception queue (incoming packets not yet
     // retrieved)
     recvLock.writeLock();
@@ -116,6 +156,7 @@ IncomingDataQueue::purgeIncomingQueue()
         SyncSourceLink *s = recvFirst->getSourceLink();
         s->setFirst(NULL);
         s->setLast(NULL);
+        s->clearRingEntry(recvFirst);
 
         delete recvFirst->getPacket();
         delete recvFirst;
@@ -144,6 +185,7 @@ bool
 IncomingDataQueue::isWaiting(const SyncSource* src) const
 {
     bool w;
+    drainRecvHandoff();
     recvLock.readLock();
     if ( NULL == src )
         w = ( NULL != recvFirst);
@@ -157,6 +199,7 @@ IncomingDataQueue::isWaiting(const SyncSource* src) const
 uint32
 IncomingDataQueue::getFirstTimestamp(const SyncSource* src) const
 {
+    drainRecvHandoff();
     recvLock.readLock();
 
     // get the first packet
@@ -177,17 +220,47 @@ IncomingDataQueue::getFirstTimestamp(const SyncSource* src) const
     return ts;
 }
 
+void
+IncomingDataQueue::preparePools()
+{
+    // one spare octet per buffer, so that packets longer than the
+    // maximum can be told apart and discarded.
+    size_t bufferSize = getMaxRecvPacketSize() + 1;
+    if ( recvBufferPool && recvBufferPool->getBlockSize() == bufferSize )
+        return;
+
+    // buffers waiting in the batch slots are too small or too big.
+    for ( size_t i = 0; i < recvBatchSlots; i++ ) {
+        RTPBlockPool::deallocate(recvBatchInfo[i].buffer);
+        recvBatchInfo[i].buffer = NULL;
+    }
+    if ( recvBufferPool ) {
+        recvBufferPool->release();
+    } else {
+        recvPacketPool =
+            new RTPBlockPool(sizeof(IncomingRTPPkt),maxFreeRecvBlocks);
+        recvLinkPool =
+            new RTPBlockPool(sizeof(IncomingRTPPktLink),maxFreeRecvBlocks);
+    }
+    recvBufferPool = new RTPBlockPool(bufferSize,maxFreeRecvBlocks);
+}
+
 size_t
 IncomingDataQueue::takeInDataPacket(void)
 {
+    if ( getRecvBatchSize() > 1 )
+        return takeInDataPacketBatch();
+
     InetHostAddress network_address;
     tpport_t transport_port;
 
+    preparePools();
     uint32 nextSize = (uint32)getNextDataPacketSize();
-    unsigned char* buffer = new unsigned char[nextSize];
+    unsigned char* buffer = static_cast<unsigned char*>
+        (RTPBlockPool::allocate(nextSize,recvBufferPool));
     int32 rtn = (int32)recvData(buffer,nextSize,network_address,transport_port);
     if ( (rtn < 0) || ((uint32)rtn > getMaxRecvPacketSize()) ){
-        delete buffer;
+        RTPBlockPool::deallocate(buffer);
         return 0;
     }
 
@@ -195,43 +268,189 @@ IncomingDataQueue::takeInDataPacket(void)
     struct timeval recvtime;
     gettimeofday(&recvtime,NULL);
 
+    if ( IncomingRTPPkt::isControlPacket(buffer,rtn) &&
+         takeInMuxedControlPacket(buffer,rtn,network_address,
+                      transport_port,recvtime) ) {
+        RTPBlockPool::deallocate(buffer);
+        return rtn;
+    }
+
+    return processDataPacket(buffer,rtn,network_address,transport_port,
+                 recvtime);
+}
+
+size_t
+IncomingDataQueue::takeInDataPacketBatch(void)
+{
+    preparePools();
+    size_t count = getRecvBatchSize();
+    if ( count != recvBatchSlots ) {
+        for ( size_t i = 0; i < recvBatchSlots; i++ )
+            RTPBlockPool::deallocate(recvBatchInfo[i].buffer);
+        delete [] recvBatchInfo;
+        recvBatchInfo = new RTPDatagram[count];
+        for ( size_t i = 0; i < count; i++ )
+            recvBatchInfo[i].buffer = NULL;
+#ifdef  CCXX_IPV6
+        delete [] recvBatchInfoIPV6;
+        recvBatchInfoIPV6 = NULL;
+#endif
+        recvBatchSlots = count;
+    }
+    // packets are read straight into pooled buffers, slots whose
+    // buffer was taken by a packet get a new one.
+    size_t slotSize = recvBufferPool->getBlockSize();
+    for ( size_t i = 0; i < count; i++ ) {
+        if ( NULL == recvBatchInfo[i].buffer )
+            recvBatchInfo[i].buffer = static_cast<unsigned char*>
+                (RTPBlockPool::allocate(slotSize,recvBufferPool));
+        recvBatchInfo[i].size = slotSize;
+    }
+
+#ifdef  CCXX_IPV6
+    size_t n;
+    if ( isDataIPV6() ) {
+        // the IPv6 descriptors share the pooled buffers. Membership
+        // bookkeeping only keeps IPv4 addresses, so just the port
+        // of the sender is passed on, as recvData() does.
+        if ( NULL == recvBatchInfoIPV6 )
+            recvBatchInfoIPV6 = new RTPDatagramIPV6[count];
+        for ( size_t i = 0; i < count; i++ ) {
+            recvBatchInfoIPV6[i].buffer = recvBatchInfo[i].buffer;
+            recvBatchInfoIPV6[i].size = recvBatchInfo[i].size;
+        }
+        n = recvDataBatchIPV6(recvBatchInfoIPV6,count);
+        for ( size_t i = 0; i < n; i++ ) {
+            recvBatchInfo[i].size = recvBatchInfoIPV6[i].size;
+            recvBatchInfo[i].host = InetHostAddress();
+            recvBatchInfo[i].port = recvBatchInfoIPV6[i].port;
+        }
+    } else
+        n = recvDataBatch(recvBatchInfo,count);
+#else
+    size_t n = recvDataBatch(recvBatchInfo,count);
+#endif
+
+    // the whole batch is considered to arrive at the same time
+    struct timeval recvtime;
+    gettimeofday(&recvtime,NULL);
+
+    // packets are built first, so that all of them can go through
+    // SRTP processing at once.
+    IncomingRTPPkt* packets[MaxRTPBatchSize];
+    CryptoContext* pccs[MaxRTPBatchSize];
+    int32 results[MaxRTPBatchSize];
+    bool padSets[MaxRTPBatchSize];
+    size_t slots[MaxRTPBatchSize];
+    size_t built = 0;
+    for ( size_t i = 0; i < n; i++ ) {
+        int32 rtn = (int32)recvBatchInfo[i].size;
+        if ( (rtn <= 0) || ((uint32)rtn > getMaxRecvPacketSize()) )
+            continue;
+        unsigned char* buffer = recvBatchInfo[i].buffer;
+        // the buffer of a control packet stays in its slot.
+        if ( IncomingRTPPkt::isControlPacket(buffer,rtn) &&
+             takeInMuxedControlPacket(buffer,rtn,recvBatchInfo[i].host,
+                          recvBatchInfo[i].port,recvtime) )
+            continue;
+        recvBatchInfo[i].buffer = NULL;
+        IncomingRTPPkt* packet =
+            buildDataPacket(buffer,rtn,padSets[built],pccs[built]);
+        if ( NULL == packet )
+            continue;
+        packets[built] = packet;
+        slots[built] = i;
+        built++;
+    }
+
+    if ( recvCryptoPool && built > 1 )
+        recvCryptoPool->unprotectBatch(packets,pccs,results,built);
+    else
+        IncomingRTPPkt::unprotectBatch(packets,pccs,results,built);
+
+    size_t total = 0;
+    for ( size_t j = 0; j < built; j++ ) {
+        size_t i = slots[j];
+        if ( acceptDataPacket(packets[j],results[j],padSets[j],
+                      recvBatchInfo[i].host,recvBatchInfo[i].port,
+                      recvtime) )
+            total += recvBatchInfo[i].size;
+    }
+    return total;
+}
+
+size_t
+IncomingDataQueue::recvDataBatch(RTPDatagram* batch, size_t count)
+{
+    if ( 0 == count )
+        return 0;
+    batch[0].size = recvData(batch[0].buffer,batch[0].size,
+                 batch[0].host,batch[0].port);
+    return 1;
+}
+
+size_t
+IncomingDataQueue::processDataPacket(unsigned char* buffer, size_t len,
+                     InetHostAddress& network_address,
+                     tpport_t transport_port,
+                     const timeval& recvtime)
+{
+    bool padSet;
+    CryptoContext* pcc;
+    IncomingRTPPkt* packet = buildDataPacket(buffer,len,padSet,pcc);
+    if ( NULL == packet )
+        return 0;
+
+    int32 ret = 1;
+    if (pcc != NULL)
+        ret = packet->unprotect(pcc);
+
+    if ( !acceptDataPacket(packet,ret,padSet,network_address,
+                   transport_port,recvtime) )
+        return 0;
+    return len;
+}
+
+IncomingRTPPkt*
+IncomingDataQueue::buildDataPacket(unsigned char* buffer, size_t len,
+                   bool& padSet, CryptoContext*& pcc)
+{
     // Special handling of padding to take care of encrypted content.
     // In case of SRTP the padding length field is also encrypted, thus
     // it gives a wrong length. Check and clear padding bit before
     // creating the RTPPacket. Will be set and re-computed after a possible
     // SRTP decryption.
-    uint8 padSet = (*buffer & 0x20);
+    padSet = (*buffer & 0x20) != 0;
     if (padSet) {
         *buffer = *buffer & ~0x20;          // clear padding bit
     }
     //  build a packet. It will link itself to its source
     IncomingRTPPkt* packet =
-        new IncomingRTPPkt(buffer,rtn);
+        new (recvPacketPool) IncomingRTPPkt(buffer,len,true);
 
     // Generic header validity check.
     if ( !packet->isHeaderValid() ) {
         delete packet;
-        return 0;
+        return NULL;
     }
 
-    CryptoContext* pcc = getInQueueCryptoContext( packet->getSSRC());
-    if (pcc == NULL) {
-        pcc = getInQueueCryptoContext(0);
-        if (pcc != NULL) {
-            pcc = pcc->newCryptoContextForSSRC(packet->getSSRC(), 0, 0L);
-            if (pcc != NULL) {
-                pcc->deriveSrtpKeys(0);
-                setInQueueCryptoContext(pcc);
-            }
-        }
-    }
-    if (pcc != NULL) {
-        int32 ret = packet->unprotect(pcc);
-        if (ret < 0) {
-           if (!onSRTPPacketError(*packet, ret)) {
-               delete packet;
-               return 0;
-            }
+    pcc = getInQueueCryptoContext( packet->getSSRC());
+    if (pcc == NULL)
+        pcc = prepareInQueueCryptoContext(packet->getSSRC());
+    return packet;
+}
+
+bool
+IncomingDataQueue::acceptDataPacket(IncomingRTPPkt* packet, int32 srtpResult,
+                    bool padSet,
+                    InetHostAddress& network_address,
+                    tpport_t transport_port,
+                    const timeval& recvtime)
+{
+    if (srtpResult < 0) {
+        if (!onSRTPPacketError(*packet, srtpResult)) {
+            delete packet;
+            return false;
         }
     }
     if (padSet) {
@@ -240,7 +459,7 @@ IncomingDataQueue::takeInDataPacket(void)
     // virtual for profile-specific validation and processing.
     if ( !onRTPPacketRecv(*packet) ) {
         delete packet;
-        return 0;
+        return false;
     }
 
     bool source_created;
@@ -274,13 +493,13 @@ IncomingDataQueue::takeInDataPacket(void)
          recordReception(*sourceLink,*packet,recvtime) ) {
         // now the packet link is linked in the queues
         IncomingRTPPktLink* packetLink =
-            new IncomingRTPPktLink(packet,
+            new (recvLinkPool) IncomingRTPPktLink(packet,
                            sourceLink,
                            recvtime,
                            packet->getTimestamp() -
                            sourceLink->getInitialDataTimestamp(),
                            NULL,NULL,NULL,NULL);
-        insertRecvPacket(packetLink);
+        queueRecvPacket(packetLink);
     } else {
         // must be discarded due to collision or loop or
         // invalid source
@@ -291,7 +510,7 @@ IncomingDataQueue::takeInDataPacket(void)
     // flip-flopping. This allows losing less packets and for
     // mobile telephony applications or other apps that may change
     // the source transport address during the session.
-    return rtn;
+    return true;
 }
 
 bool IncomingDataQueue::checkSSRCInIncomingRTPPkt(SyncSourceLink& sourceLink,
@@ -363,16 +582,143 @@ bool is_new, InetAddress& network_address, tpport_t transport_port)
     return result;
 }
 
+bool
+IncomingDataQueue::removeIdleSource(SyncSourceLink& sourceLink)
+{
+    // packets waiting in the handoff queue already point to the
+    // source, move them into the reception queue first.
+    drainRecvHandoff();
+    // New data units are only built from queued packets or copied
+    // from existing ones, so none can appear once the source has
+    // no packets and no data units with the queue locked.
+    sourcesLock.writeLock();
+    recvLock.writeLock();
+    bool idle = NULL == sourceLink.getFirst() &&
+        0 == getDataUnitsCount(*(sourceLink.getSource()));
+    if ( idle )
+        removeSource(sourceLink.getSource()->getID());
+    recvLock.unlock();
+    sourcesLock.unlock();
+    return idle;
+}
+
+void
+IncomingDataQueue::setRecvRingSize(uint32 size)
+{
+    uint32 slots = 0;
+    if ( size > 0 ) {
+        slots = 1;
+        while ( slots < size && slots < 32768 )
+            slots <<= 1;
+    }
+    // rings are reallocated as packets are inserted.
+    recvLock.writeLock();
+    recvRingSize = slots;
+    recvLock.unlock();
+}
+
+bool
+IncomingDataQueue::findRingPlace(SyncSourceLink& srcLink, uint32 seq,
+                 IncomingRTPPktLink*& plink)
+{
+    if ( srcLink.getRingEntry(seq) )
+        return false;
+
+    if ( srcLink.isInRingWindow(seq) ) {
+        // all the queued packets within the window are indexed,
+        // so take the closest one before it or, when there is
+        // none in the window, the one before the closest after it.
+        IncomingRTPPktLink* p = srcLink.getRingPrev(seq);
+        if ( p ) {
+            plink = p;
+            return true;
+        }
+        p = srcLink.getRingNext(seq);
+        if ( p ) {
+            plink = p->getSrcPrev();
+            return true;
+        }
+    }
+    // too old for the ring: walk the queue.
+    while ( plink && static_cast<int32>(seq - plink->getExtSeqNum()) <= 0 ) {
+        if ( seq == plink->getExtSeqNum() )
+            return false;
+        plink = plink->getSrcPrev();
+    }
+    return true;
+}
+
+void
+IncomingDataQueue::setRecvHandoff(size_t slots)
+{
+    drainRecvHandoff();
+    MutexLock lock(recvHandoffMutex);
+    delete recvHandoff;
+    recvHandoff = NULL;
+    if ( slots > 0 )
+        recvHandoff = new SPSCQueue<IncomingRTPPktLink>(slots);
+}
+
+void
+IncomingDataQueue::queueRecvPacket(IncomingRTPPktLink* packetLink)
+{
+    if ( NULL == recvHandoff ) {
+        insertRecvPacket(packetLink);
+        return;
+    }
+    if ( recvHandoff->push(packetLink) )
+        return;
+    // the handoff queue is full: take the consumer side so that
+    // the packets waiting are inserted before this one.
+    MutexLock lock(recvHandoffMutex);
+    IncomingRTPPktLink* pl;
+    while ( NULL != (pl = recvHandoff->pop()) )
+        insertRecvPacket(pl);
+    insertRecvPacket(packetLink);
+}
+
+void
+IncomingDataQueue::drainRecvHandoff() const
+{
+    if ( NULL == recvHandoff || recvHandoff->isEmpty() )
+        return;
+    IncomingDataQueue* self = const_cast<IncomingDataQueue*>(this);
+    MutexLock lock(recvHandoffMutex);
+    IncomingRTPPktLink* pl;
+    while ( NULL != (pl = recvHandoff->pop()) )
+        self->insertRecvPacket(pl);
+}
+
 bool
 IncomingDataQueue::insertRecvPacket(IncomingRTPPktLink* packetLink)
 {
     SyncSourceLink *srcLink = packetLink->getSourceLink();
     unsigned short seq = packetLink->getPacket()->getSeqNum();
     recvLock.writeLock();
+    if ( srcLink->getRingSize() != recvRingSize )
+        srcLink->setRingSize(recvRingSize);
     IncomingRTPPktLink* plink = srcLink->getLast();
-    if ( plink && (seq < plink->getPacket()->getSeqNum()) ) {
+    bool disordered;
+    if ( recvRingSize ) {
+        if ( NULL == plink )
+            srcLink->setRingBase(seq);
+        uint32 ext = srcLink->extendSeqNum(seq);
+        packetLink->setExtSeqNum(ext);
+        disordered = plink &&
+            static_cast<int32>(ext - plink->getExtSeqNum()) <= 0;
+        if ( disordered && !findRingPlace(*srcLink,ext,plink) ) {
+            recvLock.unlock();
+            VDL(("Duplicated disordered packet: seqnum %d, SSRC:",
+                 seq,srcLink->getSource()->getID()));
+            delete packetLink->getPacket();
+            delete packetLink;
+            return false;
+        }
+    } else {
+        disordered = plink && (seq < plink->getPacket()->getSeqNum());
         // a disordered packet, so look for its place
-        while ( plink && (seq < plink->getPacket()->getSeqNum()) ){
+        while ( disordered && plink &&
+            (seq <= plink->getPacket()->getSeqNum()) ){
             // the packet is a duplicate
             if ( seq == plink->getPacket()->getSeqNum() ) {
                 recvLock.unlock();
@@ -384,6 +730,8 @@ IncomingDataQueue::insertRecvPacket(IncomingRTPPktLink* packetLink)
             }
             plink = plink->getSrcPrev();
         }
+    }
+    if ( disordered ) {
         if ( !plink ) {
             // we have scanned the whole (and non empty)
             // list, so this must be the older (first)
@@ -459,6 +807,8 @@ IncomingDataQueue::insertRecvPacket(IncomingRTPPktLink* packetLink)
             recvLast = packetLink;
         }
     }
+    if ( recvRingSize )
+        srcLink->setRingEntry(packetLink);
     // account the insertion of this packet into the queue
     srcLink->recordInsertion(*packetLink);
     recvLock.unlock();
@@ -489,6 +839,104 @@ IncomingDataQueue::getData(uint32 stamp, const SyncSource* src)
     return result;
 }
 
+const AppDataUnit*
+IncomingDataQueue::getPlayoutData(const timeval& now, const SyncSource* src)
+{
+    if ( src && !isMine(*src) )
+        return NULL;
+
+    uint64 usecs = static_cast<uint64>(now.tv_sec) * 1000000ul + now.tv_usec;
+    IncomingRTPPktLink* pl = NULL;
+    drainRecvHandoff();
+    recvLock.writeLock();
+    SyncSourceLink* srcLink = src? getLink(*src) :
+        (recvFirst? recvFirst->getSourceLink() : NULL);
+    if ( srcLink )
+        pl = getPlayoutPacket(*srcLink,usecs);
+    recvLock.unlock();
+
+    AppDataUnit* result = NULL;
+    if ( pl ) {
+        result = new AppDataUnit(*(pl->getPacket()),*(srcLink->getSource()));
+        // delete the packet link, but not the packet
+        delete pl;
+    }
+    return result;
+}
+
+IncomingDataQueue::IncomingRTPPktLink*
+IncomingDataQueue::getPlayoutPacket(SyncSourceLink& srcLink, uint64 now)
+{
+    // discard the packets whose turn has passed.
+    IncomingRTPPktLink* pl;
+    while ( NULL != (pl = srcLink.getFirst()) && srcLink.playoutStarted &&
+        static_cast<int16>(pl->getPacket()->getSeqNum() -
+                   srcLink.playoutNextSeqNum) < 0 ) {
+        unlinkFirstPacket(pl);
+        srcLink.playoutLate++;
+        onExpireRecv(*(pl->getPacket()));// notify packet discard
+        delete pl->getPacket();
+        delete pl;
+    }
+    if ( NULL == pl )
+        return NULL;
+
+    uint32 rate = getCurrentRTPClockRate();
+    if ( !srcLink.playoutStarted ||
+         (pl->getPacket()->isMarked() &&
+          isPlayoutTalkspurtMarker(pl->getPacket()->getPayloadType())) ) {
+        // start of a talkspurt: adapt the delay to the jitter,
+        // which is kept in timestamp units.
+        uint64 delay = static_cast<uint64>(4 * srcLink.getJitter()) *
+            1000000ul / rate;
+        if ( delay < minPlayoutDelay )
+            delay = minPlayoutDelay;
+        else if ( delay > maxPlayoutDelay )
+            delay = maxPlayoutDelay;
+        srcLink.playoutDelay = static_cast<microtimeout_t>(delay);
+        srcLink.playoutOffset = srcLink.transitMean + srcLink.playoutDelay;
+    }
+
+    timeval initial = srcLink.getInitialDataTime();
+    int64 due = static_cast<int64>(initial.tv_sec) * 1000000l +
+        initial.tv_usec + srcLink.playoutOffset +
+        static_cast<int64>((static_cast<uint64>(pl->getTimestamp()) *
+                    1000000ul) / rate);
+    if ( static_cast<int64>(now) < due )
+        return NULL;
+
+    uint16 seq = pl->getPacket()->getSeqNum();
+    if ( srcLink.playoutStarted )
+        srcLink.playoutConcealed +=
+            static_cast<uint16>(seq - srcLink.playoutNextSeqNum);
+    srcLink.playoutStarted = true;
+    srcLink.playoutNextSeqNum = seq + 1;
+    unlinkFirstPacket(pl);
+    return pl;
+}
+
+void
+IncomingDataQueue::unlinkFirstPacket(IncomingRTPPktLink* pl)
+{
+    // unlink from the global queue
+    if ( pl->getPrev() )
+        pl->getPrev()->setNext(pl->getNext());
+    else
+        recvFirst = pl->getNext();
+    if ( pl->getNext() )
+        pl->getNext()->setPrev(pl->getPrev());
+    else
+        recvLast = pl->getPrev();
+    // unlink from the queue of its source
+    SyncSourceLink* srcLink = pl->getSourceLink();
+    srcLink->clearRingEntry(pl);
+    srcLink->setFirst(pl->getSrcNext());
+    if ( srcLink->getFirst() )
+        srcLink->getFirst()->setSrcPrev(NULL);
+    else
+        srcLink->setLast(NULL);
+}
+
 // FIX: try to merge and organize
 IncomingDataQueue::IncomingRTPPktLink*
 IncomingDataQueue::getWaiting(uint32 timestamp, const SyncSource* src)
@@ -497,6 +945,7 @@ IncomingDataQueue::getWaiting(uint32 timestamp, const SyncSource* src)
         return NULL;
 
     IncomingRTPPktLink *result;
+    drainRecvHandoff();
     recvLock.writeLock();
     if ( src != NULL ) {
         // process source specific queries:
@@ -533,6 +982,7 @@ IncomingDataQueue::getWaiting(uint32 timestamp, const SyncSource* src)
                 nonempty = true;
                 l->getNext()->setPrev(l->getPrev());
             }
+            srcm->clearRingEntry(l);
             // now, delete it
             onExpireRecv(*(l->getPacket()));// notify packet discard
             delete l->getPacket();
@@ -552,6 +1002,7 @@ IncomingDataQueue::getWaiting(uint32 timestamp, const SyncSource* src)
         } else {
             // (src->getFirst()->getTimestamp() == stamp) is true
             result = srcm->getFirst();
+            srcm->clearRingEntry(result);
             // unlink the selected packet from the global queue
             if ( result->getPrev() )
                 result->getPrev()->setNext(result->getNext());
@@ -587,6 +1038,7 @@ IncomingDataQueue::getWaiting(uint32 timestamp, const SyncSource* src)
                 l->getSrcNext()->setSrcPrev(NULL);
             else
                 src->setLast(NULL);
+            src->clearRingEntry(l);
             // now, delete it
             onExpireRecv(*(l->getPacket()));// notify packet discard
             delete l->getPacket();
@@ -614,6 +1066,7 @@ IncomingDataQueue::getWaiting(uint32 timestamp, const SyncSource* src)
             // unlink the selected packet from the queue
             // of its source
             SyncSourceLink* src = result->getSourceLink();
+            src->clearRingEntry(result);
             src->setFirst(result->getSrcNext());
             if ( src->getFirst() )
                 src->getFirst()->setSrcPrev(NULL);
@@ -687,11 +1140,19 @@ const IncomingRTPPkt& pkt, const timeval recvtime)
         srcLink.incObservedPacketCount();
         srcLink.incObservedOctetCount(pkt.getPayloadSize());
         srcLink.lastPacketTime = recvtime;
+        // kept up to date here, so that reports only compute the
+        // fraction lost.
+        srcLink.updateCumulativeStats();
         if ( srcLink.getObservedPacketCount() == 1 ) {
             // ooops, it's the first packet from this source
-            setSender(*src,true);
             srcLink.setInitialDataTimestamp(pkt.getTimestamp());
         }
+        if ( !src->isSender() ) {
+            // first packet, or the first one since it timed out
+            // as a sender (see QueueRTCPManager::expireSSRCs()).
+            setSender(*src,true);
+            increaseSendersCount();
+        }
         // we record the last time a packet from this source
         // was received, this has statistical interest and is
         // needed to time out old senders that are no sending
@@ -702,8 +1163,11 @@ const IncomingRTPPkt& pkt, const timeval recvtime)
         timeval lastT = srcLink.getLastPacketTime();
         timeval initial = srcLink.getInitialDataTime();
         timersub(&lastT,&initial,&tarrival);
-        uint32 arrival = timeval2microtimeout(tarrival)
-            * getCurrentRTPClockRate();
+        // arrival time in timestamp units.
+        uint32 rate = getCurrentRTPClockRate();
+        uint32 arrival = tarrival.tv_sec * rate +
+            static_cast<uint32>((static_cast<uint64>(tarrival.tv_usec)
+                         * rate) / 1000000ul);
         uint32 transitTime = arrival - pkt.getTimestamp();
         int32 delta = transitTime -
             srcLink.getLastPacketTransitTime();
@@ -714,6 +1178,17 @@ const IncomingRTPPkt& pkt, const timeval recvtime)
                    (1.0f / 16.0f) *
                   (static_cast<float>(delta) -
                    srcLink.getJitter()));
+
+        // mean transit time (plus a constant), in microseconds,
+        // for adaptive playout.
+        uint32 shifted = pkt.getTimestamp() - srcLink.getInitialDataTimestamp();
+        int64 transit = static_cast<int64>(tarrival.tv_sec) * 1000000l +
+            tarrival.tv_usec -
+            static_cast<int64>((static_cast<uint64>(shifted) * 1000000ul) / rate);
+        if ( srcLink.getObservedPacketCount() == 1 )
+            srcLink.transitMean = transit;
+        else
+            srcLink.transitMean += (transit - srcLink.transitMean) / 16;
     }
     return result;
 }
@@ -725,59 +1200,49 @@ IncomingDataQueue::recordExtraction(const IncomingRTPPkt&)
 void
 IncomingDataQueue::setInQueueCryptoContext(CryptoContext* cc)
 {
-    std::list<CryptoContext *>::iterator i;
-
     MutexLock lock(cryptoMutex);
-    // check if a CryptoContext for a SSRC already exists. If yes
-    // remove it from list before inserting the new one.
-    for( i = cryptoContexts.begin(); i!= cryptoContexts.end(); i++ ) {
-        if( (*i)->getSsrc() == cc->getSsrc() ) {
-            CryptoContext* tmp = *i;
-            cryptoContexts.erase(i);
-            delete tmp;
-            break;
-        }
-    }
-    cryptoContexts.push_back(cc);
+    // a context for the same SSRC is replaced.
+    cryptoContexts.insert(cc);
 }
 
 void
 IncomingDataQueue::removeInQueueCryptoContext(CryptoContext* cc)
 {
-    std::list<CryptoContext *>::iterator i;
-
     MutexLock lock(cryptoMutex);
-    if (cc == NULL) {     // Remove any incoming crypto contexts
-        for (i = cryptoContexts.begin(); i != cryptoContexts.end(); ) {
-            CryptoContext* tmp = *i;
-            i = cryptoContexts.erase(i);
-            delete tmp;
-        }
-    }
-    else {
-        for( i = cryptoContexts.begin(); i!= cryptoContexts.end(); i++ ){
-            if( (*i)->getSsrc() == cc->getSsrc() ) {
-                CryptoContext* tmp = *i;
-                cryptoContexts.erase(i);
-                delete tmp;
-                return;
-            }
-        }
-    }
+    if (cc == NULL)      // Remove any crypto contexts
+        cryptoContexts.clear();
+    else
+        cryptoContexts.remove(cc->getSsrc());
 }
 
 CryptoContext*
 IncomingDataQueue::getInQueueCryptoContext(uint32 ssrc)
 {
-    std::list<CryptoContext *>::iterator i;
+    // lookups do not need the lock, see CryptoContextTable.
+    return cryptoContexts.find(ssrc);
+}
+
+CryptoContext*
+IncomingDataQueue::prepareInQueueCryptoContext(uint32 ssrc)
+{
+    CryptoContext* pcc = cryptoContexts.find(ssrc);
+    if (pcc != NULL)
+        return pcc;
 
     MutexLock lock(cryptoMutex);
-    for( i = cryptoContexts.begin(); i!= cryptoContexts.end(); i++ ){
-        if( (*i)->getSsrc() == ssrc) {
-            return (*i);
-        }
+    // the data and the control paths may race to create it.
+    pcc = cryptoContexts.find(ssrc);
+    if (pcc != NULL)
+        return pcc;
+    CryptoContext* tmpl = cryptoContexts.find(0);
+    if (tmpl == NULL)
+        return NULL;
+    pcc = tmpl->newCryptoContextForSSRC(ssrc, 0, 0L);
+    if (pcc != NULL) {
+        pcc->deriveSrtpKeys(0);
+        cryptoContexts.insert(pcc);
     }
-    return NULL;
+    return pcc;
 }
 
 END_NAMESPACE
@@ -39,12 +39,12 @@
  * @file members.cpp
  * @shot MembershipBookkeeping class implementation
  *
- * @todo implement the reallocation mechanism (e.g., when the number
- * of ssrcs per collision list goes up to 2, make the size
- * approx. four times bigger (0.5 ssrcs per list now. when the number
- * of ssrcs per list goes down to 0.5, decrease four times. Do not use
- * 2 or 0.5, but `2 + something' and `0.5 - somehting'). Always
- * jumping between prime numbers -> provide a table from 7 to many.
+ * Sources are kept in an open addressing hash table. When it gets
+ * half full a table twice as big is allocated, and the sources are
+ * moved into it a few at a time by the following lookups, so that
+ * no single packet pays for the whole reallocation.
+ *
+ * @todo shrink the table when most sources have left.
  **/
 
 #include "private.h"
@@ -63,11 +63,182 @@ MembershipBookkeeping::SyncSourceLink::~SyncSourceLink()
         delete prevConflict;
         delete receiverInfo;
         delete senderInfo;
+        delete [] ring;
+        delete [] ringBits;
 #ifdef  CCXX_EXCEPTIONS
     } catch (...) { }
 #endif
 }
 
+// index of the lowest/highest bit set in a non zero word.
+static inline uint32
+lowestBit(uint64 b)
+{
+#ifdef  __GNUC__
+    return __builtin_ctzll(b);
+#else
+    uint32 n = 0;
+    while ( !(b & 1) ) {
+        b >>= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+static inline uint32
+highestBit(uint64 b)
+{
+#ifdef  __GNUC__
+    return 63 - __builtin_clzll(b);
+#else
+    uint32 n = 0;
+    while ( b >>= 1 )
+        n++;
+    return n;
+#endif
+}
+
+// mask of count bits starting at bit first (count <= 64).
+static inline uint64
+bitRange(uint32 first, uint32 count)
+{
+    uint64 m = (64 == count) ? ~static_cast<uint64>(0) :
+        ((static_cast<uint64>(1) << count) - 1);
+    return m << first;
+}
+
+void
+MembershipBookkeeping::SyncSourceLink::setRingSize(uint32 size)
+{
+    delete [] ring;
+    delete [] ringBits;
+    ring = NULL;
+    ringBits = NULL;
+    ringMask = 0;
+    if ( 0 == size )
+        return;
+
+    ring = new IncomingRTPPktLink* [size];
+    ringBits = new uint64 [(size + 63) / 64];
+    ringMask = size - 1;
+    for ( uint32 i = 0; i < size; i++ )
+        ring[i] = NULL;
+    for ( uint32 i = 0; i < (size + 63) / 64; i++ )
+        ringBits[i] = 0;
+    // index the packets already queued, the newest first.
+    IncomingRTPPktLink* pl = last;
+    if ( pl )
+        setRingBase(pl->getPacket()->getSeqNum());
+    while ( pl ) {
+        uint32 ext = extendSeqNum(pl->getPacket()->getSeqNum());
+        pl->setExtSeqNum(ext);
+        uint32 i = ext & ringMask;
+        if ( isInRingWindow(ext) && NULL == ring[i] ) {
+            ring[i] = pl;
+            ringBits[i >> 6] |= static_cast<uint64>(1) << (i & 63);
+        }
+        pl = pl->getSrcPrev();
+    }
+}
+
+void
+MembershipBookkeeping::SyncSourceLink::setRingEntry(IncomingRTPPktLink* pl)
+{
+    uint32 seq = pl->getExtSeqNum();
+    if ( static_cast<int32>(seq - ringMaxSeqNum) > 0 ) {
+        // the window moves forward: the slots of the sequence
+        // numbers skipped are no longer in use. Each slot is
+        // cleared once per turn of the window.
+        uint32 s = ringMaxSeqNum + 1;
+        uint32 n = seq - s;
+        if ( n > ringMask ) {
+            s = 0;
+            n = ringMask + 1;
+        }
+        while ( n > 0 ) {
+            uint32 i = s & ringMask;
+            uint32 count = 64 - (i & 63);
+            if ( count > ringMask + 1 - i )
+                count = ringMask + 1 - i;
+            if ( count > n )
+                count = n;
+            uint64& word = ringBits[i >> 6];
+            uint64 b = word & bitRange(i & 63,count);
+            word &= ~b;
+            while ( b ) {
+                ring[(i & ~63) + lowestBit(b)] = NULL;
+                b &= b - 1;
+            }
+            s += count;
+            n -= count;
+        }
+        ringMaxSeqNum = seq;
+    }
+    if ( isInRingWindow(seq) ) {
+        uint32 i = seq & ringMask;
+        ring[i] = pl;
+        ringBits[i >> 6] |= static_cast<uint64>(1) << (i & 63);
+    }
+}
+
+MembershipBookkeeping::IncomingRTPPktLink*
+MembershipBookkeeping::SyncSourceLink::getRingPrev(uint32 seq) const
+{
+    if ( NULL == ring || !isInRingWindow(seq) )
+        return NULL;
+    // look at seq - 1 down to the bottom of the window.
+    uint32 n = seq - (ringMaxSeqNum - ringMask);
+    while ( n > 0 ) {
+        uint32 i = (seq - 1) & ringMask;
+        uint32 count = (i & 63) + 1;
+        if ( count > n )
+            count = n;
+        uint64 b = ringBits[i >> 6] & bitRange((i & 63) + 1 - count,count);
+        if ( b )
+            return ring[(i & ~63) + highestBit(b)];
+        seq -= count;
+        n -= count;
+    }
+    return NULL;
+}
+
+MembershipBookkeeping::IncomingRTPPktLink*
+MembershipBookkeeping::SyncSourceLink::getRingNext(uint32 seq) const
+{
+    if ( NULL == ring || !isInRingWindow(seq) )
+        return NULL;
+    // look at seq + 1 up to the top of the window.
+    uint32 n = ringMaxSeqNum - seq;
+    while ( n > 0 ) {
+        uint32 i = (seq + 1) & ringMask;
+        uint32 count = 64 - (i & 63);
+        if ( count > ringMask + 1 - i )
+            count = ringMask + 1 - i;
+        if ( count > n )
+            count = n;
+        uint64 b = ringBits[i >> 6] & bitRange(i & 63,count);
+        if ( b )
+            return ring[(i & ~63) + lowestBit(b)];
+        seq += count;
+        n -= count;
+    }
+    return NULL;
+}
+
+uint32
+MembershipBookkeeping::SyncSourceLink::extendSeqNum(uint16 seq) const
+{
+    // take the closest to the highest sequence number indexed.
+    uint32 ext = (ringMaxSeqNum & ~(SEQNUMMOD - 1)) | seq;
+    int32 delta = static_cast<int32>(ext - ringMaxSeqNum);
+    if ( delta > static_cast<int32>(SEQNUMMOD / 2) )
+        ext -= SEQNUMMOD;
+    else if ( delta < -static_cast<int32>(SEQNUMMOD / 2) )
+        ext += SEQNUMMOD;
+    return ext;
+}
+
 void
 MembershipBookkeeping::SyncSourceLink::initStats()
 {
@@ -87,6 +258,12 @@ MembershipBookkeeping::SyncSourceLink::initStats()
     initialDataTime.tv_sec = initialDataTime.tv_usec = 0;
     flag = false;
 
+    transitMean = playoutOffset = 0;
+    playoutDelay = 0;
+    playoutLate = playoutConcealed = 0;
+    playoutNextSeqNum = 0;
+    playoutStarted = false;
+
     badSeqNum = SEQNUMMOD + 1;
     probation = 0;
     baseSeqNum = 0;
@@ -97,6 +274,13 @@ MembershipBookkeeping::SyncSourceLink::initStats()
 
 void
 MembershipBookkeeping::SyncSourceLink::computeStats()
+{
+    updateCumulativeStats();
+    computeFractionLost();
+}
+
+void
+MembershipBookkeeping::SyncSourceLink::updateCumulativeStats()
 {
     // See Appendix A.3
 
@@ -111,9 +295,15 @@ MembershipBookkeeping::SyncSourceLink::computeStats()
     else
         lost = expected - pc;
     setCumulativePacketLost(lost);
+}
 
+void
+MembershipBookkeeping::SyncSourceLink::computeFractionLost()
+{
     // compute the fraction of packets lost during the last
     // reporting interval.
+    uint32 expected =
+        (getExtendedMaxSeqNum() - getBaseSeqNum() + 1);
     uint32 expectedDelta = expected - expectedPrior;
     expectedPrior = expected;
     uint32 receivedDelta = getObservedPacketCount() -
@@ -163,17 +353,46 @@ setReceiverInfo(unsigned char* ri)
 const size_t MembershipBookkeeping::defaultMembersHashSize = 11;
 const uint32 MembershipBookkeeping::SEQNUMMOD = (1<<16);
 
-#define HASH(a) ((a + (a >> 8)) % MembershipBookkeeping::sourceBucketsNum)
+// Slots of the previous table moved into the current one per lookup,
+// enough to finish before the current table gets half full.
+static const uint32 rehashSlotsPerLookup = 8;
+static const uint32 minSourceSlots = 16;
+
+// Mixes all the bits of the SSRC into the lower ones (the finalizer
+// of MurmurHash3): SSRCs are random, but not always well chosen.
+static inline uint32
+hashSSRC(uint32 ssrc)
+{
+    ssrc ^= ssrc >> 16;
+    ssrc *= 0x85ebca6b;
+    ssrc ^= ssrc >> 13;
+    ssrc *= 0xc2b2ae35;
+    ssrc ^= ssrc >> 16;
+    return ssrc;
+}
 
 // Initializes the array (hash table) and the global list of
 // SyncSourceLink objects
 MembershipBookkeeping::MembershipBookkeeping(uint32 initialSize):
 SyncSourceHandler(), ParticipantHandler(), ConflictHandler(), Members(),
-sourceBucketsNum(initialSize),
-sourceLinks( new SyncSourceLink* [sourceBucketsNum] ), first(NULL), last(NULL)
+sourceSlots(NULL), sourceSlotsMask(0), sourceSlotsUsed(0),
+oldSourceSlots(NULL), oldSourceSlotsMask(0), oldSourceSlotsNext(0),
+first(NULL), last(NULL), sourcesCount(0), reportNext(NULL)
 {
-    for ( uint32 i = 0; i < sourceBucketsNum; i++ )
-        sourceLinks[i] = NULL;
+    for ( uint32 i = 0; i < 2 * expiryWheelSlots; i++ )
+        expiryWheel[i] = NULL;
+    timeval now;
+    gettimeofday(&now,NULL);
+    expiryWheelTime = now.tv_sec;
+
+    // keep the table at most half full
+    uint32 size = minSourceSlots;
+    while ( size < 2 * initialSize && size < 0x80000000 )
+        size <<= 1;
+    sourceSlots = new SourceSlot[size];
+    sourceSlotsMask = size - 1;
+    for ( uint32 i = 0; i < size; i++ )
+        sourceSlots[i].link = NULL;
 }
 
 void
@@ -192,86 +411,120 @@ MembershipBookkeeping::endMembers()
 #endif
     }
     last = NULL;
+    sourcesCount = 0;
+    reportNext = NULL;
 #ifdef  CCXX_EXCEPTIONS
     try {
 #endif
-        delete [] sourceLinks;
+        delete [] sourceSlots;
+        delete [] oldSourceSlots;
 #ifdef  CCXX_EXCEPTIONS
     } catch (...) {}
 #endif
 }
 
-bool
-MembershipBookkeeping::isRegistered(uint32 ssrc)
+MembershipBookkeeping::SourceSlot*
+MembershipBookkeeping::findSourceSlot(SourceSlot* slots, uint32 mask,
+                                      uint32 ssrc)
 {
-    bool result = false;
-    SyncSourceLink* sl = sourceLinks[ HASH(ssrc) ];
+    uint32 i = hashSSRC(ssrc) & mask;
+    while ( NULL != slots[i].link && ssrc != slots[i].ssrc )
+        i = (i + 1) & mask;
+    return slots + i;
+}
 
-    while ( sl != NULL ) {
-        if ( ssrc == sl->getSource()->getID() ) {
-            result = true;
-            break;
-        } else if ( ssrc < sl->getSource()->getID() ) {
-            break;
-        } else {
-            // keep on searching
-            sl = sl->getNextCollis();
+MembershipBookkeeping::SyncSourceLink*
+MembershipBookkeeping::findSource(uint32 ssrc)
+{
+    SourceSlot* slot = findSourceSlot(sourceSlots,sourceSlotsMask,ssrc);
+    if ( NULL == slot->link && NULL != oldSourceSlots ) {
+        // not moved yet. The previous table is not modified while
+        // its sources are moved, so it can still be searched.
+        slot = findSourceSlot(oldSourceSlots,oldSourceSlotsMask,ssrc);
+    }
+    return slot->link;
+}
+
+void
+MembershipBookkeeping::rehashSourceSlots(bool all)
+{
+    if ( NULL == oldSourceSlots )
+        return;
+
+    uint32 n = all ? oldSourceSlotsMask + 1 : rehashSlotsPerLookup;
+    while ( n-- > 0 && oldSourceSlotsNext <= oldSourceSlotsMask ) {
+        SourceSlot& old = oldSourceSlots[oldSourceSlotsNext++];
+        if ( NULL == old.link )
+            continue;
+        SourceSlot* slot =
+            findSourceSlot(sourceSlots,sourceSlotsMask,old.ssrc);
+        // sources inserted since the table grew are already there
+        if ( NULL == slot->link ) {
+            *slot = old;
+            sourceSlotsUsed++;
         }
     }
-    return result;
+    if ( oldSourceSlotsNext > oldSourceSlotsMask ) {
+        delete [] oldSourceSlots;
+        oldSourceSlots = NULL;
+        oldSourceSlotsMask = 0;
+        oldSourceSlotsNext = 0;
+    }
+}
+
+void
+MembershipBookkeeping::growSourceSlots()
+{
+    // a resize still in progress is finished first
+    rehashSourceSlots(true);
+
+    uint32 size = 2 * (sourceSlotsMask + 1);
+    oldSourceSlots = sourceSlots;
+    oldSourceSlotsMask = sourceSlotsMask;
+    oldSourceSlotsNext = 0;
+    sourceSlots = new SourceSlot[size];
+    sourceSlotsMask = size - 1;
+    sourceSlotsUsed = 0;
+    for ( uint32 i = 0; i < size; i++ )
+        sourceSlots[i].link = NULL;
+}
+
+bool
+MembershipBookkeeping::isRegistered(uint32 ssrc)
+{
+    return NULL != findSource(ssrc);
 }
 
 // Gets or creates the source and its link structure.
 MembershipBookkeeping::SyncSourceLink*
 MembershipBookkeeping::getSourceBySSRC(uint32 ssrc, bool& created)
 {
-    uint32 hashing = HASH(ssrc);
-    SyncSourceLink* result = sourceLinks[hashing];
-    SyncSourceLink* prev = NULL;
+    rehashSourceSlots(false);
+
+    SyncSourceLink* result = findSource(ssrc);
     created = false;
 
     if ( NULL == result ) {
-        result = sourceLinks[hashing] =
-            new SyncSourceLink(this,new SyncSource(ssrc));
+        if ( 2 * (sourceSlotsUsed + 1) > sourceSlotsMask + 1 )
+            growSourceSlots();
+        SourceSlot* slot =
+            findSourceSlot(sourceSlots,sourceSlotsMask,ssrc);
+        result = new SyncSourceLink(this,new SyncSource(ssrc));
+        slot->ssrc = ssrc;
+        slot->link = result;
+        sourceSlotsUsed++;
         created = true;
-    } else {
-        while ( NULL != result ) {
-            if ( ssrc == result->getSource()->getID() ) {
-                // we found it!
-                break;
-            } else if ( ssrc > result->getSource()->getID() ) {
-                // keep on searching
-                prev = result;
-                result = result->getNextCollis();
-            } else {
-                // ( ssrc < result->getSource()->getID() )
-                // it isn't recorded here -> create it.
-                SyncSourceLink* newlink =
-                    new SyncSourceLink(this,new SyncSource(ssrc));
-                if ( NULL != prev )
-                    prev->setNextCollis(newlink);
-                else
-                    sourceLinks[hashing] = newlink;
-                newlink->setNextCollis(result);
-                result = newlink;
-                created = true;
-                break;
-            }
-        }
-        if ( NULL == result ) {
-            // insert at the end of the collision list
-            result =
-                new SyncSourceLink(this,new SyncSource(ssrc));
-            created = true;
-            prev->setNextCollis(result);
-        }
+        // the first check sets its expiration time
+        scheduleExpiration(*result,0);
     }
     if ( created ) {
-        if ( first )
+        if ( first ) {
             last->setNext(result);
-        else
+            result->setPrev(last);
+        } else
             first =  result;
         last = result;
+        sourcesCount++;
         increaseMembersCount();
     }
 
@@ -284,44 +537,185 @@ MembershipBookkeeping::BYESource(uint32 ssrc)
     bool found = false;
     // If the source identified by ssrc is in the table, mark it
     // as leaving the session. If it was not, do nothing.
-    if ( isRegistered(ssrc) ) {
+    SyncSourceLink* link = findSource(ssrc);
+    if ( NULL != link ) {
         found = true;
-        decreaseMembersCount(); // TODO really decrease right now?
+        // leaving sources are not counted, see setState().
+        setState(*(link->getSource()),SyncSource::stateLeaving);
     }
     return found;
 }
 
+void
+MembershipBookkeeping::setState(SyncSource& source, SyncSource::State ns)
+{
+    SyncSource::State os = source.getState();
+    bool counted = os != SyncSource::stateInactive &&
+        os != SyncSource::stateLeaving;
+    bool counts = ns != SyncSource::stateInactive &&
+        ns != SyncSource::stateLeaving;
+    SyncSourceHandler::setState(source,ns);
+    if ( counted && !counts )
+        decreaseMembersCount();
+    else if ( !counted && counts )
+        increaseMembersCount();
+}
+
 bool
 MembershipBookkeeping::removeSource(uint32 ssrc)
 {
-    bool found = false;
-    SyncSourceLink* old = NULL,
-        * s = sourceLinks[ HASH(ssrc) ];
-    while ( s != NULL ){
-        if ( s->getSource()->getID() == ssrc ) {
-            // we found it
-            if ( old )
-                old->setNextCollis(s->getNextCollis());
-            if ( s->getPrev() )
-                s->getPrev()->setNext(s->getNext());
-            if ( s->getNext() )
-                s->getNext()->setPrev(s->getPrev());
-            decreaseMembersCount();
-            if ( s->getSource()->isSender() )
-                decreaseSendersCount();
-            delete s;
-            found = true;
-            break;
-        } else if ( s->getSource()->getID() > ssrc ) {
-            // it wasn't here
+    // backward shifting below may move a source the resize has not
+    // reached yet behind it, so finish the resize first.
+    rehashSourceSlots(true);
+
+    uint32 i = findSourceSlot(sourceSlots,sourceSlotsMask,ssrc) -
+        sourceSlots;
+    SyncSourceLink* s = sourceSlots[i].link;
+    if ( NULL == s )
+        return false;
+
+    // Empty the slot, then move back the sources after it that
+    // could not be found otherwise (no tombstones needed).
+    sourceSlots[i].link = NULL;
+    sourceSlotsUsed--;
+    uint32 j = i;
+    for (;;) {
+        j = (j + 1) & sourceSlotsMask;
+        if ( NULL == sourceSlots[j].link )
             break;
-        } else {
-            // keep on searching
-            old = s;
-            s = s->getNextCollis();
+        uint32 home = hashSSRC(sourceSlots[j].ssrc) & sourceSlotsMask;
+        // move it unless its home slot lies cyclically in (i,j]
+        if ( ((j - home) & sourceSlotsMask) >=
+             ((j - i) & sourceSlotsMask) ) {
+            sourceSlots[i] = sourceSlots[j];
+            sourceSlots[j].link = NULL;
+            i = j;
         }
     }
-    return found;
+
+    if ( s->getPrev() )
+        s->getPrev()->setNext(s->getNext());
+    else
+        first = s->getNext();
+    if ( s->getNext() )
+        s->getNext()->setPrev(s->getPrev());
+    else
+        last = s->getPrev();
+    unscheduleExpiration(*s);
+    if ( reportNext == s )
+        reportNext = s->getNext();
+    sourcesCount--;
+    SyncSource::State st = s->getSource()->getState();
+    if ( st != SyncSource::stateInactive && st != SyncSource::stateLeaving )
+        decreaseMembersCount();
+    if ( s->getSource()->isSender() )
+        decreaseSendersCount();
+    delete s;
+    return true;
+}
+
+MembershipBookkeeping::SyncSourceLink*
+MembershipBookkeeping::nextReportSource()
+{
+    SyncSourceLink* result = reportNext ? reportNext : first;
+    if ( result )
+        reportNext = result->getNext();
+    return result;
+}
+
+void
+MembershipBookkeeping::scheduleExpiration(SyncSourceLink& link, uint32 when)
+{
+    unscheduleExpiration(link);
+    link.expiryTime = when;
+    // checks already due are taken next time
+    if ( when <= expiryWheelTime )
+        when = expiryWheelTime + 1;
+    placeExpiration(link,when);
+}
+
+void
+MembershipBookkeeping::unscheduleExpiration(SyncSourceLink& link)
+{
+    if ( link.expirySlot < 0 )
+        return;
+    if ( link.prevExpiry )
+        link.prevExpiry->nextExpiry = link.nextExpiry;
+    else
+        expiryWheel[link.expirySlot] = link.nextExpiry;
+    if ( link.nextExpiry )
+        link.nextExpiry->prevExpiry = link.prevExpiry;
+    link.prevExpiry = link.nextExpiry = NULL;
+    link.expirySlot = -1;
+}
+
+void
+MembershipBookkeeping::placeExpiration(SyncSourceLink& link, uint32 when)
+{
+    const uint32 mask = expiryWheelSlots - 1;
+    uint32 delta = when - expiryWheelTime;
+    uint32 slot;
+    if ( delta < expiryWheelSlots ) {
+        slot = when & mask;
+    } else {
+        // checks beyond the second level go to its farthest
+        // slot, and are placed again when it is reached.
+        if ( delta >= expiryWheelSlots * (expiryWheelSlots - 1) )
+            when = expiryWheelTime + expiryWheelSlots * (expiryWheelSlots - 1);
+        slot = expiryWheelSlots + ((when / expiryWheelSlots) & mask);
+    }
+    link.prevExpiry = NULL;
+    link.nextExpiry = expiryWheel[slot];
+    if ( link.nextExpiry )
+        link.nextExpiry->prevExpiry = &link;
+    expiryWheel[slot] = &link;
+    link.expirySlot = slot;
+}
+
+MembershipBookkeeping::SyncSourceLink*
+MembershipBookkeeping::takeExpirationDue(uint32 now)
+{
+    const uint32 mask = expiryWheelSlots - 1;
+    SyncSourceLink* due = NULL;
+    SyncSourceLink* l;
+
+    if ( static_cast<int32>(now - expiryWheelTime) < 0 ||
+         now - expiryWheelTime >= expiryWheelSlots * expiryWheelSlots ) {
+        // the clock jumped: check every source now.
+        for ( uint32 i = 0; i < 2 * expiryWheelSlots; i++ ) {
+            while ( NULL != (l = expiryWheel[i]) ) {
+                unscheduleExpiration(*l);
+                l->nextExpiry = due;
+                due = l;
+            }
+        }
+        expiryWheelTime = now;
+        return due;
+    }
+
+    while ( expiryWheelTime != now ) {
+        expiryWheelTime++;
+        if ( 0 == (expiryWheelTime & mask) ) {
+            // the next expiryWheelSlots seconds move from the
+            // second level to the first one.
+            uint32 slot = expiryWheelSlots +
+                ((expiryWheelTime / expiryWheelSlots) & mask);
+            while ( NULL != (l = expiryWheel[slot]) ) {
+                unscheduleExpiration(*l);
+                uint32 when = l->expiryTime;
+                if ( when < expiryWheelTime )
+                    when = expiryWheelTime;
+                placeExpiration(*l,when);
+            }
+        }
+        uint32 slot = expiryWheelTime & mask;
+        while ( NULL != (l = expiryWheel[slot]) ) {
+            unscheduleExpiration(*l);
+            l->nextExpiry = due;
+            due = l;
+        }
+    }
+    return due;
 }
 
 END_NAMESPACE
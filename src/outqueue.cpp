@@ -42,7 +42,8 @@ NAMESPACE_COMMONCPP
 
 const size_t OutgoingDataQueueBase::defaultMaxSendSegmentSize = 65536;
 
-OutgoingDataQueueBase::OutgoingDataQueueBase()
+OutgoingDataQueueBase::OutgoingDataQueueBase() :
+sendBatchSize(1)
 {
     // segment data in packets of no more than 65536 octets.
     setMaxSendSegmentSize(getDefaultMaxSendSegmentSize());
@@ -179,8 +180,16 @@ OutgoingDataQueueBase(),
 #ifdef  CCXX_IPV6
 DestinationListHandlerIPV6(),
 #endif
-DestinationListHandler(), sendLock(), sendFirst(NULL), sendLast(NULL)
+DestinationListHandler(), sendLock(), sendFirst(NULL), sendLast(NULL),
+sendBatchInfo(NULL), sendQueueLength(0), sendRingSlots(0),
+sendOutstanding(0), sendSlotWaiters(0), sendSlotCond(), sendRingOverflow(ringDropOldest), sendBufferPool(NULL),
+sendPacketPool(NULL), sendLinkPool(NULL), sendHandoff(NULL),
+sendCryptoPool(NULL), sendCryptoPoolKey(0), sendNotifier(NULL),
+cryptoJobCond(), cryptoJobs(0)
 {
+#ifdef  CCXX_IPV6
+    sendBatchInfoIPV6 = NULL;
+#endif
     setInitialTimestamp(random32());
     setSchedulingTimeout(getDefaultSchedulingTimeout());
     setExpireTimeout(getDefaultExpireTimeout());
@@ -199,22 +208,193 @@ DestinationListHandler(), sendLock(), sendFirst(NULL), sendLast(NULL)
     sendInfo.overflowTime.tv_usec = getInitialTime().tv_usec;
 }
 
+OutgoingDataQueue::~OutgoingDataQueue()
+{
+    // workers must not append packets to a destroyed queue
+    waitCryptoJobs();
+    delete [] sendBatchInfo;
+#ifdef  CCXX_IPV6
+    delete [] sendBatchInfoIPV6;
+#endif
+    // the queue has already been purged
+    delete sendHandoff;
+    // packets still queued keep their pools alive
+    if ( sendBufferPool ) {
+        sendBufferPool->release();
+        sendPacketPool->release();
+        sendLinkPool->release();
+    }
+}
+
 void
 OutgoingDataQueue::purgeOutgoingQueue()
 {
     OutgoingRTPPktLink* sendnext;
+    waitCryptoJobs();
     // flush the sending queue (delete outgoing packets
     // unsent so far)
     sendLock.writeLock();
+    drainSendHandoff();
     while ( sendFirst ) {
         sendnext = sendFirst->getNext();
         delete sendFirst;
         sendFirst = sendnext;
     }
     sendLast = NULL;
+    releaseSendSlots(sendQueueLength);
+    sendQueueLength = 0;
+    sendLock.unlock();
+}
+
+void
+OutgoingDataQueue::setSendRing(size_t slots, SendRingOverflow overflow)
+{
+    // room for the fixed header (12 octets), 15 CSRC identifiers,
+    // a full segment and the SRTP tag and MKI.
+    size_t size = 12 + 15 * sizeof(uint32) + getMaxSendSegmentSize();
+    CryptoContext* pcc = getOutQueueCryptoContext(getLocalSSRC());
+    if ( NULL == pcc )
+        pcc = getOutQueueCryptoContext(0);
+    if ( pcc )
+        size += pcc->getTagLength() + pcc->getMkiLength();
+
+    waitCryptoJobs();
+    sendLock.writeLock();
+    if ( sendBufferPool ) {
+        sendBufferPool->release();
+        sendPacketPool->release();
+        sendLinkPool->release();
+        sendBufferPool = sendPacketPool = sendLinkPool = NULL;
+    }
+    sendRingSlots = slots;
+    sendRingOverflow = overflow;
+    if ( slots > 0 ) {
+        sendBufferPool = new RTPBlockPool(size,slots);
+        sendPacketPool = new RTPBlockPool(sizeof(OutgoingRTPPkt),slots);
+        sendLinkPool = new RTPBlockPool(sizeof(OutgoingRTPPktLink),slots);
+        sendBufferPool->reserve(slots);
+        sendPacketPool->reserve(slots);
+        sendLinkPool->reserve(slots);
+    }
     sendLock.unlock();
 }
 
+bool
+OutgoingDataQueue::waitSendSlot()
+{
+    if ( sendRingSlots && sendOutstanding >= sendRingSlots ) {
+        if ( ringDropNewest == sendRingOverflow )
+            return false;
+        if ( ringBlock == sendRingOverflow ) {
+            // packets older than the expire timeout would be dropped
+            // anyway, so do not wait longer than that.
+            struct timeval deadline, now, left;
+            gettimeofday(&deadline,NULL);
+            left.tv_sec = getExpireTimeout() / 1000000;
+            left.tv_usec = getExpireTimeout() % 1000000;
+            timeradd(&deadline,&left,&deadline);
+            // announce the wait before looking at the count again,
+            // see releaseSendSlots().
+            rtpAtomicAdd(sendSlotWaiters,1);
+            sendSlotCond.enterMutex();
+            while ( sendOutstanding >= sendRingSlots ) {
+                gettimeofday(&now,NULL);
+                if ( !timercmp(&now,&deadline,<) )
+                    break;
+                timersub(&deadline,&now,&left);
+                sendSlotCond.wait(left.tv_sec * 1000 +
+                          left.tv_usec / 1000 + 1,true);
+            }
+            sendSlotCond.leaveMutex();
+            rtpAtomicAdd(sendSlotWaiters,-1);
+        }
+    }
+    rtpAtomicAdd(sendOutstanding,1);
+    return true;
+}
+
+void
+OutgoingDataQueue::releaseSendSlots(size_t count)
+{
+    rtpAtomicAdd(sendOutstanding,-static_cast<int32>(count));
+    if ( sendSlotWaiters ) {
+        sendSlotCond.enterMutex();
+        sendSlotCond.signal(true);
+        sendSlotCond.leaveMutex();
+    }
+}
+
+void
+OutgoingDataQueue::setSendHandoff(size_t slots)
+{
+    waitCryptoJobs();
+    sendLock.writeLock();
+    drainSendHandoff();
+    delete sendHandoff;
+    sendHandoff = NULL;
+    if ( slots > 0 )
+        sendHandoff = new SPSCQueue<OutgoingRTPPktLink>(slots);
+    sendLock.unlock();
+}
+
+void
+OutgoingDataQueue::setOutQueueCryptoPool(SRTPCryptoPool* pool)
+{
+    waitCryptoJobs();
+    sendCryptoPool = pool;
+    sendCryptoPoolKey = getLocalSSRC();
+}
+
+void
+OutgoingDataQueue::waitCryptoJobs()
+{
+    // signaled by the job that brings the count down to zero.
+    cryptoJobCond.enterMutex();
+    while ( cryptoJobs > 0 )
+        cryptoJobCond.wait(0,true);
+    cryptoJobCond.leaveMutex();
+}
+
+void
+OutgoingDataQueue::insertSendPacket(OutgoingRTPPktLink* link)
+{
+    if ( sendRingSlots && sendQueueLength >= sendRingSlots ) {
+        if ( ringDropNewest == sendRingOverflow ) {
+            delete link;
+            releaseSendSlots(1);
+            return;
+        }
+        // make room dropping the oldest packet
+        OutgoingRTPPktLink* oldest = sendFirst;
+        sendFirst = sendFirst->getNext();
+        if ( sendFirst )
+            sendFirst->setPrev(NULL);
+        else
+            sendLast = NULL;
+        delete oldest;
+        sendQueueLength--;
+        releaseSendSlots(1);
+    }
+    link->setPrev(sendLast);
+    link->setNext(NULL);
+    if (sendLast)
+        sendLast->setNext(link);
+    else
+        sendFirst = link;
+    sendLast = link;
+    sendQueueLength++;
+}
+
+void
+OutgoingDataQueue::drainSendHandoff()
+{
+    if ( NULL == sendHandoff )
+        return;
+    OutgoingRTPPktLink* link;
+    while ( NULL != (link = sendHandoff->pop()) )
+        insertSendPacket(link);
+}
+
 bool
 OutgoingDataQueue::addDestination(const InetHostAddress& ia,
 tpport_t dataPort, tpport_t controlPort)
@@ -296,7 +476,7 @@ OutgoingDataQueue::isSending(void) const
     if(sendFirst)
         return true;
 
-    return false;
+    return sendHandoff && !sendHandoff->isEmpty();
 }
 
 microtimeout_t
@@ -306,6 +486,12 @@ OutgoingDataQueue::getSchedulingTimeout(void)
     uint32 rate;
     uint32 rem;
 
+    if ( sendHandoff && !sendHandoff->isEmpty() ) {
+        sendLock.writeLock();
+        drainSendHandoff();
+        sendLock.unlock();
+    }
+
     for(;;) {
         // if there is no packet to send, use the default scheduling
         // timeout
@@ -390,6 +576,8 @@ OutgoingDataQueue::getSchedulingTimeout(void)
         sendFirst = sendFirst->getNext();
         onExpireSend(*(packet->getPacket()));  // new virtual to notify
         delete packet;
+        sendQueueLength--;
+        releaseSendSlots(1);
         if ( sendFirst )
             sendFirst->setPrev(NULL);
         else
@@ -406,6 +594,22 @@ OutgoingDataQueue::putData(uint32 stamp, const unsigned char *data, size_t datal
     if ( !data || !datalen )
         return;
 
+    CryptoContext* pcc = getOutQueueCryptoContext(getLocalSSRC());
+    if (pcc == NULL) {
+        pcc = getOutQueueCryptoContext(0);
+        if (pcc != NULL) {
+            pcc = pcc->newCryptoContextForSSRC(getLocalSSRC(), 0, 0L);
+            if (pcc != NULL) {
+                pcc->deriveSrtpKeys(0);
+                setOutQueueCryptoContext(pcc);
+            }
+        }
+    }
+
+    // segments are protected and queued in batches
+    OutgoingRTPPkt* packets[MaxRTPBatchSize];
+    size_t count = 0;
+
     size_t step = 0, offset = 0;
     while ( offset < datalen ) {
         // remainder and step take care of segmentation
@@ -414,22 +618,14 @@ OutgoingDataQueue::putData(uint32 stamp, const unsigned char *data, size_t datal
         step = ( remainder > getMaxSendSegmentSize() ) ?
             getMaxSendSegmentSize() : remainder;
 
-                CryptoContext* pcc = getOutQueueCryptoContext(getLocalSSRC());
-                if (pcc == NULL) {
-                    pcc = getOutQueueCryptoContext(0);
-                    if (pcc != NULL) {
-                        pcc = pcc->newCryptoContextForSSRC(getLocalSSRC(), 0, 0L);
-                        if (pcc != NULL) {
-                            pcc->deriveSrtpKeys(0);
-                            setOutQueueCryptoContext(pcc);
-                        }
-                    }
-                }
-                OutgoingRTPPkt* packet;
+        if ( !waitSendSlot() )
+            break;
+
+        OutgoingRTPPkt* packet;
         if ( sendInfo.sendCC )
-            packet = new OutgoingRTPPkt(sendInfo.sendSources,15,data + offset,step, sendInfo.paddinglen, pcc);
+            packet = new (sendPacketPool) OutgoingRTPPkt(sendInfo.sendSources,15,data + offset,step, sendInfo.paddinglen, pcc, sendBufferPool);
         else
-            packet = new OutgoingRTPPkt(data + offset,step,sendInfo.paddinglen, pcc);
+            packet = new (sendPacketPool) OutgoingRTPPkt(data + offset,step,sendInfo.paddinglen, pcc, sendBufferPool);
 
         packet->setPayloadType(getCurrentPayloadType());
         packet->setSeqNum(sendInfo.sendSeq++);
@@ -442,22 +638,117 @@ OutgoingDataQueue::putData(uint32 stamp, const unsigned char *data, size_t datal
         } else {
             packet->setMarker(false);
         }
+        packets[count++] = packet;
+        if ( MaxRTPBatchSize == count ) {
+            queueSendPackets(packets,count,pcc);
+            count = 0;
+        }
+
+        offset += step;
+    }
+    if ( count )
+        queueSendPackets(packets,count,pcc);
+}
+
+/**
+ * Protect and queue a run of packets in a worker thread of the
+ * crypto pool. The job deletes itself when done.
+ **/
+class OutgoingDataQueue::SendCryptoJob : public SRTPCryptoPool::Job
+{
+public:
+    SendCryptoJob(OutgoingDataQueue& q, OutgoingRTPPkt** pkts, size_t n,
+              CryptoContext* cc) :
+        queue(q), count(n), pcc(cc)
+    {
+        for ( size_t i = 0; i < count; i++ )
+            packets[i] = pkts[i];
+    }
+
+    void
+    run()
+    {
         if (pcc != NULL) {
-            packet->protect(getLocalSSRC(), pcc);
+            OutgoingRTPPkt::protectBatch(packets, count,
+                             queue.sendCryptoPoolKey, pcc);
         }
+        queue.appendSendPackets(packets,count);
+        OutgoingDataQueue& q = queue;
+        delete this;
+        q.cryptoJobCond.enterMutex();
+        if ( 0 == --q.cryptoJobs )
+            q.cryptoJobCond.signal(true);
+        q.cryptoJobCond.leaveMutex();
+    }
+
+private:
+    OutgoingDataQueue& queue;
+    OutgoingRTPPkt* packets[MaxRTPBatchSize];
+    size_t count;
+    CryptoContext* pcc;
+};
+
+/**
+ * Protect a packet sent immediately in the worker thread of the
+ * crypto pool that serializes the uses of its crypto context.
+ **/
+class ImmediateCryptoJob : public SRTPCryptoPool::Job
+{
+public:
+    ImmediateCryptoJob(OutgoingRTPPkt* pkt, uint32 id, CryptoContext* cc) :
+        packet(pkt), pcc(cc), ssrc(id), finished(0)
+    { }
+
+    void
+    run()
+    { packet->protect(ssrc, pcc); finished.post(); }
+
+    inline void
+    wait()
+    { finished.wait(); }
+
+private:
+    OutgoingRTPPkt* packet;
+    CryptoContext* pcc;
+    uint32 ssrc;
+    Semaphore finished;
+};
+
+void
+OutgoingDataQueue::queueSendPackets(OutgoingRTPPkt** packets, size_t count,
+                    CryptoContext* pcc)
+{
+    if ( sendCryptoPool ) {
+        cryptoJobCond.enterMutex();
+        cryptoJobs++;
+        cryptoJobCond.leaveMutex();
+        sendCryptoPool->submit(sendCryptoPoolKey,
+                       new SendCryptoJob(*this,packets,count,pcc));
+        return;
+    }
+    if (pcc != NULL) {
+        OutgoingRTPPkt::protectBatch(packets, count, getLocalSSRC(), pcc);
+    }
+    appendSendPackets(packets,count);
+}
+
+void
+OutgoingDataQueue::appendSendPackets(OutgoingRTPPkt** packets, size_t count)
+{
+    for ( size_t i = 0; i < count; i++ ) {
         // insert the packet into the "tail" of the sending queue
-        sendLock.writeLock();
         OutgoingRTPPktLink *link =
-            new OutgoingRTPPktLink(packet,sendLast,NULL);
-        if (sendLast)
-            sendLast->setNext(link);
-        else
-            sendFirst = link;
-        sendLast = link;
-        sendLock.unlock();
-
-        offset += step;
+            new (sendLinkPool) OutgoingRTPPktLink(packets[i],NULL,NULL);
+        if ( NULL == sendHandoff || !sendHandoff->push(link) ) {
+            sendLock.writeLock();
+            // packets waiting in the handoff queue go first
+            drainSendHandoff();
+            insertSendPacket(link);
+            sendLock.unlock();
+        }
     }
+    if ( sendNotifier )
+        sendNotifier->onSendQueued();
 }
 
 void
@@ -478,9 +769,9 @@ OutgoingDataQueue::sendImmediate(uint32 stamp, const unsigned char *data, size_t
 
         OutgoingRTPPkt* packet;
         if ( sendInfo.sendCC )
-            packet = new OutgoingRTPPkt(sendInfo.sendSources,15,data + offset,step,sendInfo.paddinglen, pcc);
+            packet = new (sendPacketPool) OutgoingRTPPkt(sendInfo.sendSources,15,data + offset,step,sendInfo.paddinglen, pcc, sendBufferPool);
         else
-            packet = new OutgoingRTPPkt(data + offset,step,sendInfo.paddinglen, pcc);
+            packet = new (sendPacketPool) OutgoingRTPPkt(data + offset,step,sendInfo.paddinglen, pcc, sendBufferPool);
 
         packet->setPayloadType(getCurrentPayloadType());
         packet->setSeqNum(sendInfo.sendSeq++);
@@ -493,7 +784,13 @@ OutgoingDataQueue::sendImmediate(uint32 stamp, const unsigned char *data, size_t
         } else {
             packet->setMarker(false);
         }
-        if (pcc != NULL) {
+        if ( pcc != NULL && sendCryptoPool ) {
+            // the crypto context may be in use by the worker of
+            // this queue: protect after the packets queued to it.
+            ImmediateCryptoJob job(packet, getLocalSSRC(), pcc);
+            sendCryptoPool->submit(sendCryptoPoolKey, &job);
+            job.wait();
+        } else if (pcc != NULL) {
             packet->protect(getLocalSSRC(), pcc);
         }
         dispatchImmediate(packet);
@@ -511,6 +808,11 @@ void OutgoingDataQueue::dispatchImmediate(OutgoingRTPPkt *packet)
         setDataPeer(tmp->getNetworkAddress(), tmp->getDataTransportPort());
 
         sendData(packet->getRawPacket(), packet->getRawPacketSizeSrtp());
+    } else if ( getSendBatchSize() > 1 ) {
+        // one message per destination, all of them sent at once.
+        size_t count = addToSendBatch(packet,0);
+        if ( count )
+            sendDataBatch(sendBatchInfo,count);
     } else {
         // when no destination has been added, NULL == dest.
         for (std::list<TransportAddress*>::iterator i = destList.begin(); destList.end() != i; i++) {
@@ -531,6 +833,10 @@ void OutgoingDataQueue::dispatchImmediate(OutgoingRTPPkt *packet)
 
         sendDataIPV6(packet->getRawPacket(),
             packet->getRawPacketSizeSrtp());
+    } else if ( getSendBatchSize() > 1 ) {
+        size_t count = addToSendBatchIPV6(packet,0);
+        if ( count )
+            sendDataBatchIPV6(sendBatchInfoIPV6,count);
     } else {
         // when no destination has been added, NULL == dest.
         for (std::list<TransportAddressIPV6*>::iterator i6 = destListIPV6.begin(); destListIPV6.end() != i6; i6++) {
@@ -548,7 +854,11 @@ void OutgoingDataQueue::dispatchImmediate(OutgoingRTPPkt *packet)
 size_t
 OutgoingDataQueue::dispatchDataPacket(void)
 {
+    if ( getSendBatchSize() > 1 )
+        return dispatchDataPacketBatch();
+
     sendLock.writeLock();
+    drainSendHandoff();
     OutgoingRTPPktLink* packetLink = sendFirst;
 
     if ( !packetLink ){
@@ -572,11 +882,167 @@ OutgoingDataQueue::dispatchDataPacket(void)
     sendInfo.packetCount++;
     sendInfo.octetCount += packet->getPayloadSize();
     delete packetLink;
+    sendQueueLength--;
+    releaseSendSlots(1);
+    bool idle = ( NULL == sendFirst );
 
     sendLock.unlock();
+    if ( idle )
+        precomputeSendKeystream();
     return rtn;
 }
 
+size_t
+OutgoingDataQueue::dispatchDataPacketBatch(void)
+{
+    sendLock.writeLock();
+    drainSendHandoff();
+    OutgoingRTPPktLink* packetLink = sendFirst;
+
+    if ( !packetLink ){
+        sendLock.unlock();
+        return 0;
+    }
+
+    // The first packet is due. Packets following it with the same
+    // or an older timestamp (i.e. segments of the same frame or
+    // late packets) are due as well.
+    uint32 stamp = packetLink->getPacket()->getTimestamp();
+    size_t packets = 0, count = 0;
+    uint32 rtn = 0;
+
+    lockDestinationList();
+#ifdef  CCXX_IPV6
+    lockDestinationListIPV6();
+    size_t count6 = 0;
+#endif
+    while ( packetLink && packets < getSendBatchSize() &&
+        static_cast<int32>(packetLink->getPacket()->getTimestamp() -
+                   stamp) <= 0 ) {
+        OutgoingRTPPkt* packet = packetLink->getPacket();
+        count = addToSendBatch(packet,count);
+#ifdef  CCXX_IPV6
+        count6 = addToSendBatchIPV6(packet,count6);
+#endif
+        rtn += packet->getPayloadSize();
+        packets++;
+        packetLink = packetLink->getNext();
+    }
+    if ( count )
+        sendDataBatch(sendBatchInfo,count);
+#ifdef  CCXX_IPV6
+    if ( count6 )
+        sendDataBatchIPV6(sendBatchInfoIPV6,count6);
+    unlockDestinationListIPV6();
+#endif
+    unlockDestinationList();
+
+    // unlink the sent packets from the queue and destroy
+    // them. Also record the sending.
+    while ( sendFirst != packetLink ) {
+        OutgoingRTPPktLink* sent = sendFirst;
+        sendFirst = sendFirst->getNext();
+        // for general accounting and RTCP SR statistics
+        sendInfo.packetCount++;
+        sendInfo.octetCount += sent->getPacket()->getPayloadSize();
+        delete sent;
+        sendQueueLength--;
+    }
+    releaseSendSlots(packets);
+    if ( sendFirst ) {
+        sendFirst->setPrev(NULL);
+    } else {
+        sendLast = NULL;
+    }
+    bool idle = ( NULL == sendFirst );
+
+    sendLock.unlock();
+    if ( idle )
+        precomputeSendKeystream();
+    return rtn;
+}
+
+void
+OutgoingDataQueue::precomputeSendKeystream()
+{
+    CryptoContext* pcc = getOutQueueCryptoContext(getLocalSSRC());
+    if ( NULL == pcc || 0 == pcc->getKeystreamPrecompute() )
+        return;
+
+    // until the queue gets another packet there is time to compute
+    // the key stream of the packets following the last one sent.
+    uint64 index = ((uint64)pcc->getRoc() << 16) | sendInfo.sendSeq;
+    pcc->precomputeKeystream(index);
+}
+
+size_t
+OutgoingDataQueue::addToSendBatch(OutgoingRTPPkt* packet, size_t count)
+{
+    if ( destList.empty() )
+        return count;
+    if ( NULL == sendBatchInfo )
+        sendBatchInfo = new RTPDatagram[MaxRTPBatchSize];
+
+    for (std::list<TransportAddress*>::iterator i = destList.begin(); destList.end() != i; i++) {
+        TransportAddress* dest = *i;
+        RTPDatagram& msg = sendBatchInfo[count];
+        msg.buffer = const_cast<unsigned char*>(packet->getRawPacket());
+        msg.size = packet->getRawPacketSizeSrtp();
+        msg.host = InetHostAddress(dest->getNetworkAddress().getAddress());
+        msg.port = dest->getDataTransportPort();
+        if ( ++count == MaxRTPBatchSize ) {
+            sendDataBatch(sendBatchInfo,count);
+            count = 0;
+        }
+    }
+    return count;
+}
+
+size_t
+OutgoingDataQueue::sendDataBatch(const RTPDatagram* batch, size_t count)
+{
+    for ( size_t i = 0; i < count; i++ ) {
+        setDataPeer(batch[i].host,batch[i].port);
+        sendData(batch[i].buffer,batch[i].size);
+    }
+    return count;
+}
+
+#ifdef  CCXX_IPV6
+size_t
+OutgoingDataQueue::addToSendBatchIPV6(OutgoingRTPPkt* packet, size_t count)
+{
+    if ( destListIPV6.empty() )
+        return count;
+    if ( NULL == sendBatchInfoIPV6 )
+        sendBatchInfoIPV6 = new RTPDatagramIPV6[MaxRTPBatchSize];
+
+    for (std::list<TransportAddressIPV6*>::iterator i6 = destListIPV6.begin(); destListIPV6.end() != i6; i6++) {
+        TransportAddressIPV6* dest6 = *i6;
+        RTPDatagramIPV6& msg = sendBatchInfoIPV6[count];
+        msg.buffer = const_cast<unsigned char*>(packet->getRawPacket());
+        msg.size = packet->getRawPacketSizeSrtp();
+        msg.host = IPV6Host(dest6->getNetworkAddress().getAddress());
+        msg.port = dest6->getDataTransportPort();
+        if ( ++count == MaxRTPBatchSize ) {
+            sendDataBatchIPV6(sendBatchInfoIPV6,count);
+            count = 0;
+        }
+    }
+    return count;
+}
+
+size_t
+OutgoingDataQueue::sendDataBatchIPV6(const RTPDatagramIPV6* batch, size_t count)
+{
+    for ( size_t i = 0; i < count; i++ ) {
+        setDataPeerIPV6(batch[i].host,batch[i].port);
+        sendDataIPV6(batch[i].buffer,batch[i].size);
+    }
+    return count;
+}
+#endif
+
 size_t
 OutgoingDataQueue::setPartial(uint32 stamp, unsigned char *data,
 size_t offset, size_t max)
@@ -614,59 +1080,26 @@ size_t offset, size_t max)
 void
 OutgoingDataQueue::setOutQueueCryptoContext(CryptoContext* cc)
 {
-    std::list<CryptoContext *>::iterator i;
-
     MutexLock lock(cryptoMutex);
-        // check if a CryptoContext for a SSRC already exists. If yes
-        // remove it from list before inserting the new one.
-    for( i = cryptoContexts.begin(); i!= cryptoContexts.end(); i++ ) {
-        if( (*i)->getSsrc() == cc->getSsrc() ) {
-            CryptoContext* tmp = *i;
-            cryptoContexts.erase(i);
-            delete tmp;
-            break;
-        }
-    }
-    cryptoContexts.push_back(cc);
+    // a context for the same SSRC is replaced.
+    cryptoContexts.insert(cc);
 }
 
 void
 OutgoingDataQueue::removeOutQueueCryptoContext(CryptoContext* cc)
 {
-    std::list<CryptoContext *>::iterator i;
-
     MutexLock lock(cryptoMutex);
-    if (cc == NULL) {     // Remove any incoming crypto contexts
-        for (i = cryptoContexts.begin(); i != cryptoContexts.end(); ) {
-            CryptoContext* tmp = *i;
-            i = cryptoContexts.erase(i);
-            delete tmp;
-        }
-    }
-    else {
-        for( i = cryptoContexts.begin(); i != cryptoContexts.end(); i++ ) {
-            if( (*i)->getSsrc() == cc->getSsrc() ) {
-                CryptoContext* tmp = *i;
-                cryptoContexts.erase(i);
-                delete tmp;
-                return;
-            }
-        }
-    }
+    if (cc == NULL)      // Remove any crypto contexts
+        cryptoContexts.clear();
+    else
+        cryptoContexts.remove(cc->getSsrc());
 }
 
 CryptoContext*
 OutgoingDataQueue::getOutQueueCryptoContext(uint32 ssrc)
 {
-    std::list<CryptoContext *>::iterator i;
-
-    MutexLock lock(cryptoMutex);
-    for( i = cryptoContexts.begin(); i != cryptoContexts.end(); i++ ){
-        if( (*i)->getSsrc() == ssrc) {
-            return (*i);
-        }
-    }
-    return NULL;
+    // lookups do not need the lock, see CryptoContextTable.
+    return cryptoContexts.find(ssrc);
 }
 
 END_NAMESPACE
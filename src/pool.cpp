@@ -39,6 +39,11 @@
 #include <ccrtp/pool.h>
 
 #include <algorithm>
+#ifdef  __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sched.h>
+#endif
 
 NAMESPACE_COMMONCPP
 using std::list;
@@ -213,6 +218,564 @@ SingleRTPSessionPool::run()
 #endif // ndef WIN32
 }
 
+#ifdef  __linux__
+
+const int EpollRTPSessionPool::maxEvents;
+const microtimeout_t ThreadedRTPSessionPool::stealThreshold;
+
+// current time, in microseconds
+static inline uint64
+getMicroseconds()
+{
+    timeval now;
+    gettimeofday(&now,NULL);
+    return (static_cast<uint64>(now.tv_sec) * 1000000ul) + now.tv_usec;
+}
+
+/**
+ * Timer of a session in an EpollRTPSessionPool, also told when data
+ * packets are put in the session so that the pool services it
+ * right away.
+ **/
+class EpollRTPSessionPool::SessionTimer :
+    public OutgoingDataQueue::SendNotifier
+{
+public:
+    SessionTimer(EpollRTPSessionPool* p, SessionListElement* e) :
+        pool(p), element(e), entry(), queued(false), next(0), woken(0)
+    { }
+
+    void
+    onSendQueued();
+
+    // pool the session belongs to, changes under the wake lock of
+    // the pool it is moved from.
+    EpollRTPSessionPool* volatile pool;
+    SessionListElement* element;
+    // entry in the timer queue of the pool, when queued.
+    TimerIterator entry;
+    bool queued;
+    // microseconds until the next service, computed while the pool
+    // lock is not held.
+    microtimeout_t next;
+    // set once packets have been put since the last service.
+    volatile uint32 woken;
+};
+
+void
+EpollRTPSessionPool::SessionTimer::onSendQueued()
+{
+    // only the first packets put since the last service wake the
+    // pool up.
+    if ( 1 != rtpAtomicAdd(woken,1) )
+        return;
+    for (;;) {
+        EpollRTPSessionPool* p = pool;
+        MutexLock lock(p->wakeMutex);
+        if ( p != pool )
+            continue;      // moved meanwhile to another pool
+        bool first = p->wokenSessions.empty();
+        p->wokenSessions.push_back(this);
+        if ( first ) {
+            uint64 one = 1;
+            ssize_t rtn = ::write(p->wakeFd,&one,sizeof(one));
+            (void)rtn;
+        }
+        return;
+    }
+}
+
+EpollRTPSessionPool::EpollRTPSessionPool(int pri) :
+RTPSessionPool(), Thread(pri), socketMap(), sessionTimers(),
+timerQueue(), wakeMutex(), wokenSessions(), serviceMutex(),
+purgePending(false)
+{
+    epollFd = epoll_create(maxEvents);
+    wakeFd = eventfd(0,EFD_NONBLOCK);
+    if ( epollFd >= 0 && wakeFd >= 0 ) {
+        struct epoll_event event;
+        memset(&event,0,sizeof(event));
+        event.events = EPOLLIN;
+        event.data.fd = wakeFd;
+        epoll_ctl(epollFd,EPOLL_CTL_ADD,wakeFd,&event);
+    }
+}
+
+EpollRTPSessionPool::~EpollRTPSessionPool()
+{
+    std::map<SessionListElement*,SessionTimer*>::iterator t;
+    for ( t = sessionTimers.begin(); t != sessionTimers.end(); ++t ) {
+        if ( !t->first->isCleared() )
+            setSendNotifier(*(t->first->get()),NULL);
+        delete t->second;
+    }
+    if ( epollFd >= 0 )
+        ::close(epollFd);
+    if ( wakeFd >= 0 )
+        ::close(wakeFd);
+}
+
+bool
+EpollRTPSessionPool::addSession(RTPSessionBase& session)
+{
+    bool result = false;
+    poolLock.writeLock();
+    // insert in list.
+    PredEquals predEquals(&session);
+    if ( epollFd >= 0 &&
+         sessionList.end() == std::find_if(sessionList.begin(),sessionList.end(),predEquals) ) {
+        SessionListElement* element = new SessionListElement(&session);
+        SessionTimer* timer = new SessionTimer(this,element);
+        if ( registerSockets(timer) ) {
+            result = true;
+            sessionList.push_back(element);
+            sessionTimers[element] = timer;
+            // service the new session as soon as possible.
+            scheduleSession(timer,getMicroseconds());
+            setSendNotifier(session,timer);
+        } else {
+            delete timer;
+            delete element;
+        }
+    }
+    poolLock.unlock();
+    return result;
+}
+
+bool
+EpollRTPSessionPool::removeSession(RTPSessionBase& session)
+{
+    bool result = false;
+    // wait for the session to be out of service.
+    MutexLock service(serviceMutex);
+    poolLock.writeLock();
+    // remove from list.
+    PredEquals predEquals(&session);
+    PoolIterator i;
+    if ( sessionList.end() != (i = find_if(sessionList.begin(),sessionList.end(),predEquals)) ) {
+        unregisterSockets(session);
+        setSendNotifier(session,NULL);
+        // the element is purged by the service thread.
+        (*i)->clear();
+        purgePending = true;
+        result = true;
+    }
+    poolLock.unlock();
+    return result;
+}
+
+bool
+EpollRTPSessionPool::registerSockets(SessionTimer* timer)
+{
+    RTPSessionBase& session = *(timer->element->get());
+    SOCKET sockets[2];
+    sockets[0] = getDataRecvSocket(session);
+    sockets[1] = getControlRecvSocket(session);
+    int registered = 0;
+    for ( ; registered < 2; registered++ ) {
+        // both channels may share a single socket
+        if ( registered > 0 && sockets[registered] == sockets[0] )
+            continue;
+        struct epoll_event event;
+        memset(&event,0,sizeof(event));
+        event.events = EPOLLIN;
+        event.data.fd = sockets[registered];
+        if ( epoll_ctl(epollFd,EPOLL_CTL_ADD,sockets[registered],&event) < 0 )
+            break;
+        socketMap[sockets[registered]] = timer;
+    }
+    if ( 2 == registered )
+        return true;
+    if ( registered > 0 ) {
+        epoll_ctl(epollFd,EPOLL_CTL_DEL,sockets[0],NULL);
+        socketMap.erase(sockets[0]);
+    }
+    return false;
+}
+
+void
+EpollRTPSessionPool::unregisterSockets(RTPSessionBase& session)
+{
+    SOCKET so = getDataRecvSocket(session);
+    epoll_ctl(epollFd,EPOLL_CTL_DEL,so,NULL);
+    socketMap.erase(so);
+    so = getControlRecvSocket(session);
+    if ( socketMap.end() != socketMap.find(so) ) {
+        epoll_ctl(epollFd,EPOLL_CTL_DEL,so,NULL);
+        socketMap.erase(so);
+    }
+}
+
+void
+EpollRTPSessionPool::scheduleSession(SessionTimer* timer, uint64 when)
+{
+    if ( timer->queued )
+        timerQueue.erase(timer->entry);
+    timer->entry = timerQueue.insert(std::make_pair(when,timer));
+    timer->queued = true;
+}
+
+void
+EpollRTPSessionPool::unscheduleSession(SessionTimer* timer)
+{
+    if ( timer->queued )
+        timerQueue.erase(timer->entry);
+    timer->queued = false;
+}
+
+void
+EpollRTPSessionPool::deleteTimer(SessionTimer* timer)
+{
+    unscheduleSession(timer);
+    {
+        MutexLock lock(wakeMutex);
+        wokenSessions.remove(timer);
+    }
+    delete timer;
+}
+
+void
+EpollRTPSessionPool::takeWokenSessions(uint64 now)
+{
+    MutexLock lock(wakeMutex);
+    std::list<SessionTimer*>::iterator i;
+    for ( i = wokenSessions.begin(); i != wokenSessions.end(); ++i ) {
+        SessionTimer* timer = *i;
+        if ( timer->queued && timer->entry->first > now )
+            scheduleSession(timer,now);
+    }
+    wokenSessions.clear();
+}
+
+microtimeout_t
+EpollRTPSessionPool::getTimerBacklog(uint64 now) const
+{
+    microtimeout_t backlog = 0;
+    poolLock.readLock();
+    if ( !timerQueue.empty() ) {
+        uint64 first = timerQueue.begin()->first;
+        if ( first < now )
+            backlog = static_cast<microtimeout_t>(now - first);
+    }
+    poolLock.unlock();
+    return backlog;
+}
+
+bool
+EpollRTPSessionPool::moveOverdueSession(EpollRTPSessionPool& pool)
+{
+    // sessions being serviced are not in the timer queue, so they
+    // are never moved.
+    TimerIterator t = timerQueue.begin();
+    while ( t != timerQueue.end() && t->second->element->isCleared() )
+        ++t;
+    if ( timerQueue.end() == t || pool.epollFd < 0 )
+        return false;
+
+    SessionTimer* timer = t->second;
+    SessionListElement* element = timer->element;
+    RTPSessionBase& session = *(element->get());
+    unregisterSockets(session);
+    if ( !pool.registerSockets(timer) ) {
+        registerSockets(timer);
+        return false;
+    }
+    uint64 when = t->first;
+    unscheduleSession(timer);
+    {
+        // later wakeups go to the other pool, which services the
+        // (overdue) session right away anyway.
+        MutexLock lock(wakeMutex);
+        wokenSessions.remove(timer);
+        timer->pool = &pool;
+    }
+    pool.scheduleSession(timer,when);
+    sessionTimers.erase(element);
+    pool.sessionTimers[element] = timer;
+    pool.sessionList.push_back(element);
+    sessionList.remove(element);
+    return true;
+}
+
+microtimeout_t
+EpollRTPSessionPool::serviceSession(RTPSessionBase& session)
+{
+    controlReceptionService(session);
+    controlTransmissionService(session);
+
+    // send the packets that are due, as in SingleThreadRTPSession
+    microtimeout_t timeout = getSchedulingTimeout(session);
+    while ( timeout < 1000 && dispatchDataPacket(session) > 0 )
+        timeout = getSchedulingTimeout(session);
+
+    // make sure the scheduling timeout is <= the check interval
+    // for RTCP packets
+    microtimeout_t maxWait =
+        timeval2microtimeout(getRTCPCheckInterval(session));
+    // with nothing to send, sleep until the next RTCP check: the
+    // session is woken up when packets are put.
+    if ( !isSending(session) )
+        return maxWait;
+    return (timeout > maxWait)? maxWait : timeout;
+}
+
+void
+EpollRTPSessionPool::run()
+{
+    struct epoll_event events[maxEvents];
+    list<SessionTimer*> expired;
+
+    while ( isActive() ) {
+        // wait no longer than the first session timer.
+        int timeout;
+        poolLock.readLock();
+        if ( timerQueue.empty() ) {
+            timeout = timeval2microtimeout(getPoolTimeout()) / 1000;
+        } else {
+            uint64 first = timerQueue.begin()->first;
+            uint64 now = getMicroseconds();
+            // rounded up, not to spin in the last millisecond.
+            timeout = (first > now)?
+                static_cast<int>((first - now + 999) / 1000) : 0;
+        }
+        poolLock.unlock();
+
+        int n = epoll_wait(epollFd,events,maxEvents,timeout);
+        bool idle = (n <= 0);
+
+        // A) take in packets from the sockets that are ready.
+        poolLock.readLock();
+        for ( int k = 0; k < n; k++ ) {
+            SOCKET so = events[k].data.fd;
+            if ( so == wakeFd ) {
+                // the sessions woken up are taken below.
+                uint64 count;
+                ssize_t rtn = ::read(wakeFd,&count,sizeof(count));
+                (void)rtn;
+                continue;
+            }
+            std::map<SOCKET,SessionTimer*>::iterator m = socketMap.find(so);
+            if ( socketMap.end() == m || m->second->element->isCleared() )
+                continue;
+            RTPSessionBase* session(m->second->element->get());
+            if ( so == getDataRecvSocket(*session) ) {
+                takeInDataPacket(*session);
+            } else {
+                while ( isPendingControl(*session) )
+                    takeInControlPacket(*session);
+            }
+        }
+        poolLock.unlock();
+
+        // B) serve the sessions whose timers have expired and
+        // reschedule them. They are taken off the timer queue and
+        // serviced without the pool lock, so that other threads
+        // adding sessions or taking overdue ones are not held up.
+        serviceMutex.enterMutex();
+        poolLock.writeLock();
+        uint64 now = getMicroseconds();
+        takeWokenSessions(now);
+        while ( !timerQueue.empty() && timerQueue.begin()->first <= now ) {
+            SessionTimer* timer = timerQueue.begin()->second;
+            unscheduleSession(timer);
+            if ( !timer->element->isCleared() )
+                expired.push_back(timer);
+            idle = false;
+        }
+        poolLock.unlock();
+
+        list<SessionTimer*>::iterator i;
+        for ( i = expired.begin(); i != expired.end(); i++ ) {
+            // packets put from now on wake the session up again.
+            (*i)->woken = 0;
+            (*i)->next = serviceSession(*((*i)->element->get()));
+        }
+
+        poolLock.writeLock();
+        now = getMicroseconds();
+        for ( i = expired.begin(); i != expired.end(); i++ )
+            scheduleSession(*i,now + (*i)->next);
+        expired.clear();
+
+        // Purge elements for removed sessions.
+        if ( purgePending ) {
+            PoolIterator j = sessionList.begin();
+            while (j != sessionList.end()) {
+                if ((*j)->isCleared()) {
+                    SessionListElement* element(*j);
+                    std::map<SessionListElement*,SessionTimer*>::iterator t =
+                        sessionTimers.find(element);
+                    if ( sessionTimers.end() != t ) {
+                        deleteTimer(t->second);
+                        sessionTimers.erase(t);
+                    }
+                    j = sessionList.erase(j);
+                    delete element;
+                }
+                else {
+                    ++j;
+                }
+            }
+            purgePending = false;
+        }
+        poolLock.unlock();
+        serviceMutex.leaveMutex();
+
+        if ( idle )
+            onPoolIdle();
+    }
+}
+
+/**
+ * Shard of a ThreadedRTPSessionPool: an epoll event loop bound to a
+ * processor that takes sessions over from lagging shards when idle.
+ **/
+class ThreadedRTPSessionPool::Shard : public EpollRTPSessionPool
+{
+public:
+    Shard(ThreadedRTPSessionPool& p, unsigned int i, int cpu, int pri) :
+        EpollRTPSessionPool(pri), pool(p), index(i), processor(cpu)
+    { }
+
+    bool
+    hasSession(RTPSessionBase& session) const;
+
+protected:
+    void run();
+
+    void onPoolIdle();
+
+private:
+    ThreadedRTPSessionPool& pool;
+    unsigned int index;
+    int processor;
+};
+
+void
+ThreadedRTPSessionPool::Shard::run()
+{
+    if ( processor >= 0 ) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(processor,&set);
+        // binding is an optimization, go on unbound if not allowed.
+        sched_setaffinity(0,sizeof(set),&set);
+    }
+    EpollRTPSessionPool::run();
+}
+
+bool
+ThreadedRTPSessionPool::Shard::hasSession(RTPSessionBase& session) const
+{
+    poolLock.readLock();
+    PredEquals predEquals(&session);
+    bool result = ( sessionList.end() !=
+                    std::find_if(sessionList.begin(),sessionList.end(),predEquals) );
+    poolLock.unlock();
+    return result;
+}
+
+void
+ThreadedRTPSessionPool::Shard::onPoolIdle()
+{
+    // look for the shard that lags behind the most.
+    uint64 now = getMicroseconds();
+    microtimeout_t worst = stealThreshold;
+    Shard* victim = NULL;
+    for ( unsigned int k = 0; k < pool.shardCount; k++ ) {
+        if ( k == index )
+            continue;
+        microtimeout_t backlog = pool.shards[k]->getTimerBacklog(now);
+        if ( backlog > worst ) {
+            worst = backlog;
+            victim = pool.shards[k];
+        }
+    }
+    if ( NULL == victim )
+        return;
+
+    // lock both shards always in the same order.
+    Shard* first = (victim->index < index)? victim : this;
+    Shard* second = (victim->index < index)? this : victim;
+    pool.shardLock.readLock();
+    first->poolLock.writeLock();
+    second->poolLock.writeLock();
+    victim->moveOverdueSession(*this);
+    second->poolLock.unlock();
+    first->poolLock.unlock();
+    pool.shardLock.unlock();
+}
+
+ThreadedRTPSessionPool::ThreadedRTPSessionPool(unsigned int nthreads, int pri) :
+RTPSessionPool(), shards(NULL), shardCount(nthreads), shardLock()
+{
+    long processors = sysconf(_SC_NPROCESSORS_ONLN);
+    if ( 0 == shardCount )
+        shardCount = (processors > 0)? static_cast<unsigned int>(processors) : 1;
+    shards = new Shard*[shardCount];
+    for ( unsigned int i = 0; i < shardCount; i++ ) {
+        int cpu = (processors > 0)? static_cast<int>(i % processors) : -1;
+        shards[i] = new Shard(*this,i,cpu,pri);
+    }
+}
+
+ThreadedRTPSessionPool::~ThreadedRTPSessionPool()
+{
+    for ( unsigned int i = 0; i < shardCount; i++ )
+        delete shards[i];
+    delete [] shards;
+}
+
+bool
+ThreadedRTPSessionPool::addSession(RTPSessionBase& session)
+{
+    // a session may have been moved from the shard it was hashed
+    // onto, so look for it in every shard. No session is added or
+    // moved meanwhile.
+    bool result = true;
+    shardLock.writeLock();
+    for ( unsigned int i = 0; i < shardCount && result; i++ ) {
+        if ( shards[i]->hasSession(session) )
+            result = false;
+    }
+    if ( result ) {
+        SOCKET so = getDataRecvSocket(session);
+        result = shards[static_cast<unsigned int>(so) % shardCount]->addSession(session);
+    }
+    shardLock.unlock();
+    return result;
+}
+
+bool
+ThreadedRTPSessionPool::removeSession(RTPSessionBase& session)
+{
+    bool result = false;
+    shardLock.writeLock();
+    for ( unsigned int i = 0; i < shardCount && !result; i++ )
+        result = shards[i]->removeSession(session);
+    shardLock.unlock();
+    return result;
+}
+
+size_t
+ThreadedRTPSessionPool::getPoolLength() const
+{
+    size_t result = 0;
+    for ( unsigned int i = 0; i < shardCount; i++ )
+        result += shards[i]->getPoolLength();
+    return result;
+}
+
+void
+ThreadedRTPSessionPool::startRunning()
+{
+    setActive();
+    for ( unsigned int i = 0; i < shardCount; i++ )
+        shards[i]->startRunning();
+}
+
+#endif // __linux__
+
 #if defined(_MSC_VER) && _MSC_VER >= 1300
 SingleThreadRTPSession<DualRTPUDPIPv4Channel,DualRTPUDPIPv4Channel,AVPQueue>::SingleThreadRTPSession<DualRTPUDPIPv4Channel,DualRTPUDPIPv4Channel,AVPQueue>(
 const InetHostAddress& ia, tpport_t dataPort, tpport_t controlPort, int pri,
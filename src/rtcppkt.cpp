@@ -104,14 +104,22 @@ RTCPCompoundHandler::~RTCPCompoundHandler()
 }
 
 bool
-RTCPCompoundHandler::checkCompoundRTCPHeader(size_t len)
+RTCPCompoundHandler::checkCompoundRTCPHeader(size_t len, bool reducedSize)
 {
     // Note that the first packet in the compount --in order to
     // detect possibly misaddressed RTP packets-- is more
     // thoroughly checked than the following. This mask checks the
     // first packet's version, padding (must be zero) and type
     // (must be SR or RR).
-    if ( (*(reinterpret_cast<uint16*>(rtcpRecvBuffer))
+    if ( reducedSize ) {
+        // a reduced-size packet may start with any RTCP type,
+        // but still not with a RTP payload type.
+        RTCPPacket* pkt = reinterpret_cast<RTCPPacket*>(rtcpRecvBuffer);
+        if ( len < sizeof(RTCPFixedHeader) ||
+             CCRTP_VERSION != pkt->fh.version ||
+             pkt->fh.type < 192 || pkt->fh.type > 223 )
+            return false;
+    } else if ( (*(reinterpret_cast<uint16*>(rtcpRecvBuffer))
           & RTCP_VALID_MASK)
          != RTCP_VALID_VALUE ) {
         return false;
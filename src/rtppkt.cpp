@@ -104,9 +104,113 @@ DynamicPayloadFormat::DynamicPayloadFormat(PayloadType type, uint32 rate)
     setRTPClockRate(rate);
 }
 
+RTPBlockPool::RTPBlockPool(size_t size, size_t maxfree) :
+poolMutex(), freeList(NULL), freeCount(0), maxFree(maxfree),
+blockSize(size), references(1)
+{
+}
+
+RTPBlockPool::~RTPBlockPool()
+{
+    while ( freeList ) {
+        BlockHeader* next = freeList->link.next;
+        ::operator delete(freeList);
+        freeList = next;
+    }
+}
+
+void
+RTPBlockPool::release()
+{
+    bool last;
+    {
+        MutexLock lock(poolMutex);
+        last = ( 0 == --references );
+    }
+    if ( last )
+        delete this;
+}
+
+void
+RTPBlockPool::reserve(size_t count)
+{
+    MutexLock lock(poolMutex);
+    while ( freeCount < maxFree && count-- > 0 ) {
+        BlockHeader* header = static_cast<BlockHeader*>
+            (::operator new(sizeof(BlockHeader) + blockSize));
+        header->link.next = freeList;
+        freeList = header;
+        freeCount++;
+    }
+}
+
+void*
+RTPBlockPool::get()
+{
+    BlockHeader* header;
+    {
+        MutexLock lock(poolMutex);
+        header = freeList;
+        if ( header ) {
+            freeList = header->link.next;
+            freeCount--;
+        }
+        references++;
+    }
+    if ( NULL == header )
+        header = static_cast<BlockHeader*>
+            (::operator new(sizeof(BlockHeader) + blockSize));
+    header->link.pool = this;
+    return header + 1;
+}
+
+void
+RTPBlockPool::put(BlockHeader* header)
+{
+    bool last;
+    {
+        MutexLock lock(poolMutex);
+        if ( freeCount < maxFree ) {
+            header->link.next = freeList;
+            freeList = header;
+            freeCount++;
+            header = NULL;
+        }
+        last = ( 0 == --references );
+    }
+    if ( header )
+        ::operator delete(header);
+    if ( last )
+        delete this;
+}
+
+void*
+RTPBlockPool::allocate(size_t size, RTPBlockPool* pool)
+{
+    if ( pool && size <= pool->blockSize )
+        return pool->get();
+    BlockHeader* header = static_cast<BlockHeader*>
+        (::operator new(sizeof(BlockHeader) + size));
+    header->link.pool = NULL;
+    return header + 1;
+}
+
+void
+RTPBlockPool::deallocate(void* block)
+{
+    if ( NULL == block )
+        return;
+    BlockHeader* header = static_cast<BlockHeader*>(block) - 1;
+    if ( header->link.pool )
+        header->link.pool->put(header);
+    else
+        ::operator delete(header);
+}
+
 // constructor commonly used for incoming packets
-RTPPacket::RTPPacket(const unsigned char* const block, size_t len, bool duplicate) :
-total((uint32)len), duplicated(duplicate)
+RTPPacket::RTPPacket(const unsigned char* const block, size_t len, bool duplicate,
+             bool pooledBlock) :
+total((uint32)len), duplicated(duplicate), pooled(pooledBlock && !duplicate)
 {
     const RTPFixedHeader* const header =
         reinterpret_cast<const RTPFixedHeader*>(block);
@@ -128,9 +232,10 @@ total((uint32)len), duplicated(duplicate)
 }
 
 // constructor commonly used for outgoing packets
-RTPPacket::RTPPacket(size_t hdrlen, size_t plen, uint8 paddinglen, CryptoContext* pcc ) :
+RTPPacket::RTPPacket(size_t hdrlen, size_t plen, uint8 paddinglen, CryptoContext* pcc,
+             RTPBlockPool* pool) :
 payloadSize((uint32)plen), buffer(NULL), hdrSize((uint32)hdrlen),
-duplicated(false)
+duplicated(false), pooled(NULL != pool)
 {
     total = (uint32)(hdrlen + payloadSize);
     // compute if there must be padding
@@ -151,7 +256,11 @@ duplicated(false)
     // but take SRTP data into account. Don't change total because some RTP
     // functions rely on the fact that total is the overall size (without
     // the SRTP data)
-    buffer = new unsigned char[total + srtpLength];
+    if ( pooled )
+        buffer = static_cast<unsigned char*>
+            (RTPBlockPool::allocate(total + srtpLength,pool));
+    else
+        buffer = new unsigned char[total + srtpLength];
     *(reinterpret_cast<uint32*>(getHeader())) = 0;
     getHeader()->version = CCRTP_VERSION;
     if ( 0 != padding ) {
@@ -168,7 +277,10 @@ void RTPPacket::endPacket()
 #ifdef  CCXX_EXCEPTIONS
     try {
 #endif
-        delete [] buffer;
+        if ( pooled )
+            RTPBlockPool::deallocate(buffer);
+        else
+            delete [] buffer;
 #ifdef  CCXX_EXCEPTIONS
     } catch (...) { };
 #endif
@@ -208,8 +320,9 @@ RTPPacket((getSizeOfFixedHeader() + sizeof(uint32) * numcsrc + hdrextlen),datale
 }
 
 OutgoingRTPPkt::OutgoingRTPPkt(const uint32* const csrcs, uint16 numcsrc,
-const unsigned char* data, size_t datalen, uint8 paddinglen, CryptoContext* pcc) :
-RTPPacket((getSizeOfFixedHeader() + sizeof(uint32) *numcsrc),datalen, paddinglen, pcc)
+const unsigned char* data, size_t datalen, uint8 paddinglen, CryptoContext* pcc,
+RTPBlockPool* pool) :
+RTPPacket((getSizeOfFixedHeader() + sizeof(uint32) *numcsrc),datalen, paddinglen, pcc, pool)
 {
     uint32 pointer = (uint32)getSizeOfFixedHeader();
     // add CSCR identifiers (putting them in network order).
@@ -225,8 +338,8 @@ RTPPacket((getSizeOfFixedHeader() + sizeof(uint32) *numcsrc),datalen, paddinglen
 }
 
 OutgoingRTPPkt::OutgoingRTPPkt(const unsigned char* data, size_t datalen,
-uint8 paddinglen, CryptoContext* pcc) :
-RTPPacket(getSizeOfFixedHeader(),datalen,paddinglen, pcc)
+uint8 paddinglen, CryptoContext* pcc, RTPBlockPool* pool) :
+RTPPacket(getSizeOfFixedHeader(),datalen,paddinglen, pcc, pool)
 {
     // not needed, as the RTPPacket constructor sets by default
     // the whole fixed header to 0.
@@ -247,29 +360,64 @@ void OutgoingRTPPkt::setCSRCArray(const uint32* const csrcs, uint16 numcsrc)
 
 void OutgoingRTPPkt::protect(uint32 ssrc, CryptoContext* pcc)
 {
-    /* Encrypt the packet */
-    uint64 index = ((uint64)pcc->getRoc() << 16) | (uint64)getSeqNum();
+    OutgoingRTPPkt* pkt = this;
+    protectBatch(&pkt, 1, ssrc, pcc);
+}
 
-    pcc->srtpEncrypt(this, index, ssrc);
+void OutgoingRTPPkt::protectBatch(OutgoingRTPPkt** pkts, size_t count,
+                                  uint32 ssrc, CryptoContext* pcc)
+{
+    // ROC each packet was protected with
+    uint32 rocs[MaxRTPBatchSize];
 
     // NO MKI support yet - here we assume MKI is zero. To build in MKI
     // take MKI length into account when storing the authentication tag.
 
-    /* Compute MAC */
-    pcc->srtpAuthenticate(this, pcc->getRoc(),
-                                const_cast<uint8*>(getRawPacket()+srtpDataOffset) );
-    /* Update the ROC if necessary */
-    if (getSeqNum() == 0xFFFF ) {
-        pcc->setRoc(pcc->getRoc() + 1);
+    while ( count > 0 ) {
+        size_t n = (count > MaxRTPBatchSize) ? MaxRTPBatchSize : count;
+
+        /* Encrypt the packets */
+        for ( size_t i = 0; i < n; i++ ) {
+            OutgoingRTPPkt* pkt = pkts[i];
+            rocs[i] = pcc->getRoc();
+            uint64 index = ((uint64)rocs[i] << 16) | (uint64)pkt->getSeqNum();
+
+            if (pcc->isAead()) {
+                /* Encrypt and compute the tag in one pass */
+                pcc->srtpAeadEncrypt(pkt, index, ssrc,
+                                     const_cast<uint8*>(pkt->getRawPacket()+pkt->srtpDataOffset) );
+            }
+            else {
+                pcc->srtpEncrypt(pkt, index, ssrc);
+            }
+            /* Update the ROC if necessary */
+            if (pkt->getSeqNum() == 0xFFFF ) {
+                pcc->setRoc(rocs[i] + 1);
+            }
+        }
+
+        /* Compute MACs */
+        if (!pcc->isAead()) {
+            for ( size_t i = 0; i < n; i++ ) {
+                OutgoingRTPPkt* pkt = pkts[i];
+                pcc->srtpAuthenticate(pkt, rocs[i],
+                                      const_cast<uint8*>(pkt->getRawPacket()+pkt->srtpDataOffset) );
+            }
+        }
+        pkts += n;
+        count -= n;
     }
 }
 
 // These masks are valid regardless of endianness.
 const uint16 IncomingRTPPkt::RTP_INVALID_PT_MASK = (0x7e);
 const uint16 IncomingRTPPkt::RTP_INVALID_PT_VALUE = (0x48);
+const uint8 IncomingRTPPkt::RTCP_MUX_PT_MASK = (0xe0);
+const uint8 IncomingRTPPkt::RTCP_MUX_PT_VALUE = (0xc0);
 
-IncomingRTPPkt::IncomingRTPPkt(const unsigned char* const block, size_t len) :
-RTPPacket(block,len)
+IncomingRTPPkt::IncomingRTPPkt(const unsigned char* const block, size_t len,
+                   bool pooled) :
+RTPPacket(block,len,false,pooled)
 {
     // first, perform validity check:
     // 1) check protocol version
@@ -290,12 +438,60 @@ RTPPacket(block,len)
     cachedSSRC = ntohl(getHeader()->sources[0]);
 }
 
+bool
+IncomingRTPPkt::isControlPacket(const unsigned char* buffer, size_t len)
+{
+    // a RTCP packet is at least a fixed header plus a SSRC.
+    return len >= 8 && (buffer[0] >> 6) == CCRTP_VERSION &&
+        (buffer[1] & RTCP_MUX_PT_MASK) == RTCP_MUX_PT_VALUE;
+}
+
 int32 IncomingRTPPkt::unprotect(CryptoContext* pcc)
 {
     if (pcc == NULL) {
         return true;
     }
 
+    uint64 guessedIndex;
+    int32 ret = verify(pcc, guessedIndex);
+
+    /* Decrypt the content */
+    if (ret == 1 && !pcc->isAead()) {
+        pcc->srtpEncrypt( this, guessedIndex, cachedSSRC );
+    }
+    return ret;
+}
+
+void IncomingRTPPkt::unprotectBatch(IncomingRTPPkt** pkts, CryptoContext** pccs,
+                                    int32* results, size_t count)
+{
+    uint64 indexes[MaxRTPBatchSize];
+
+    while ( count > 0 ) {
+        size_t n = (count > MaxRTPBatchSize) ? MaxRTPBatchSize : count;
+
+        /* Check replay and authentication, in reception order */
+        for ( size_t i = 0; i < n; i++ ) {
+            if (pccs[i] == NULL)
+                results[i] = 1;
+            else
+                results[i] = pkts[i]->verify(pccs[i], indexes[i]);
+        }
+
+        /* Decrypt the content of the authentic packets */
+        for ( size_t i = 0; i < n; i++ ) {
+            if (results[i] == 1 && pccs[i] != NULL && !pccs[i]->isAead())
+                pccs[i]->srtpEncrypt(pkts[i], indexes[i], pkts[i]->cachedSSRC);
+        }
+        pkts += n;
+        pccs += n;
+        results += n;
+        count -= n;
+    }
+}
+
+int32 IncomingRTPPkt::verify(CryptoContext* pcc, uint64& guessedIndex)
+{
     /*
      * This is the setting of the packet data when we come to this
      * point:
@@ -323,28 +519,29 @@ int32 IncomingRTPPkt::unprotect(CryptoContext* pcc)
     // const uint8* mki = getRawPacket() + srtpDataIndex;
     const uint8* tag = getRawPacket() + srtpDataIndex + pcc->getMkiLength();
 
+    /* Guess the index, once for the replay control and the update */
+    guessedIndex = pcc->guessIndex(cachedSeqNum);
+
     /* Replay control */
-    if (!pcc->checkReplay(cachedSeqNum)) {
+    if (!pcc->checkReplayIndex(guessedIndex)) {
         return -2;
     }
-    /* Guess the index */
-    uint64 guessedIndex = pcc->guessIndex(cachedSeqNum);
 
-    uint32 guessedRoc = (uint32)(guessedIndex >> 16);
-    uint8* mac = new uint8[pcc->getTagLength()];
+    if (pcc->isAead()) {
+        /* Check the tag and decrypt the content in one pass */
+        if (!pcc->srtpAeadDecrypt(this, guessedIndex, cachedSSRC, tag))
+            return -1;
 
-    pcc->srtpAuthenticate(this, guessedRoc, mac);
-    if (memcmp(tag, mac, pcc->getTagLength()) != 0) {
-        delete[] mac;
-        return -1;
+        pcc->updateIndex(guessedIndex);
+        return 1;
     }
-    delete[] mac;
 
-    /* Decrypt the content */
-    pcc->srtpEncrypt( this, guessedIndex, cachedSSRC );
+    if (!pcc->srtpCheckTag(this, (uint32)(guessedIndex >> 16), tag)) {
+        return -1;
+    }
 
-    /* Update the Crypto-context */
-    pcc->update(cachedSeqNum);
+    /* Update the Crypto-context, the content is decrypted by the caller */
+    pcc->updateIndex(guessedIndex);
 
     return 1;
 }
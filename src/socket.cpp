@@ -40,9 +40,192 @@
 
 #include "private.h"
 #include <ccrtp/channel.h>
+#include <cerrno>
 
 NAMESPACE_COMMONCPP
 
+size_t
+RTPBaseUDPIPv4Socket::recvBatch(RTPDatagram* batch, size_t count)
+{
+#ifdef CCRTP_BATCHED_IO
+    struct mmsghdr msgs[MaxRTPBatchSize];
+    struct iovec iovs[MaxRTPBatchSize];
+    struct sockaddr_in peers[MaxRTPBatchSize];
+
+    if ( count > MaxRTPBatchSize )
+        count = MaxRTPBatchSize;
+    memset(msgs,0,sizeof(struct mmsghdr) * count);
+    for ( size_t i = 0; i < count; i++ ) {
+        iovs[i].iov_base = batch[i].buffer;
+        iovs[i].iov_len = batch[i].size;
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_name = &peers[i];
+        msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+    }
+
+    int n = ::recvmmsg(UDPSocket::so,msgs,(unsigned int)count,
+               MSG_DONTWAIT,NULL);
+    if ( n <= 0 )
+        return 0;
+    for ( int i = 0; i < n; i++ ) {
+        batch[i].size = msgs[i].msg_len;
+        batch[i].host = InetHostAddress(peers[i].sin_addr);
+        batch[i].port = ntohs(peers[i].sin_port);
+    }
+    return (size_t)n;
+#else
+    // no batched reception available, get just the next datagram.
+    if ( 0 == count || !isPendingRecv(0) )
+        return 0;
+    batch[0].host = getSender(batch[0].port);
+    batch[0].size = recv(batch[0].buffer,batch[0].size);
+    return 1;
+#endif
+}
+
+size_t
+RTPBaseUDPIPv4Socket::sendBatch(const RTPDatagram* batch, size_t count)
+{
+#ifdef CCRTP_BATCHED_IO
+    struct mmsghdr msgs[MaxRTPBatchSize];
+    struct iovec iovs[MaxRTPBatchSize];
+    struct sockaddr_in peers[MaxRTPBatchSize];
+    size_t sent = 0;
+    size_t pos = 0;
+
+    while ( pos < count ) {
+        size_t n = count - pos;
+        if ( n > MaxRTPBatchSize )
+            n = MaxRTPBatchSize;
+        memset(msgs,0,sizeof(struct mmsghdr) * n);
+        memset(peers,0,sizeof(struct sockaddr_in) * n);
+        for ( size_t i = 0; i < n; i++ ) {
+            const RTPDatagram& d = batch[pos + i];
+            iovs[i].iov_base = d.buffer;
+            iovs[i].iov_len = d.size;
+            peers[i].sin_family = AF_INET;
+            peers[i].sin_addr = d.host.getAddress();
+            peers[i].sin_port = htons(d.port);
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            msgs[i].msg_hdr.msg_name = &peers[i];
+            msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+        }
+        int rtn = ::sendmmsg(UDPSocket::so,msgs,(unsigned int)n,0);
+        if ( rtn <= 0 ) {
+            if ( rtn < 0 && EINTR == errno )
+                continue;
+            // sendmmsg stops at the first datagram that fails:
+            // skip it and go on with the rest of the batch.
+            pos++;
+            continue;
+        }
+        pos += rtn;
+        sent += rtn;
+    }
+    return sent;
+#else
+    // no batched transmission available, send one by one.
+    for ( size_t i = 0; i < count; i++ ) {
+        setPeer(batch[i].host,batch[i].port);
+        send(batch[i].buffer,batch[i].size);
+    }
+    return count;
+#endif
+}
+
+#ifdef  CCXX_IPV6
+size_t
+RTPBaseUDPIPv6Socket::recvBatch(RTPDatagramIPV6* batch, size_t count)
+{
+#ifdef CCRTP_BATCHED_IO
+    struct mmsghdr msgs[MaxRTPBatchSize];
+    struct iovec iovs[MaxRTPBatchSize];
+    struct sockaddr_in6 peers[MaxRTPBatchSize];
+
+    if ( count > MaxRTPBatchSize )
+        count = MaxRTPBatchSize;
+    memset(msgs,0,sizeof(struct mmsghdr) * count);
+    for ( size_t i = 0; i < count; i++ ) {
+        iovs[i].iov_base = batch[i].buffer;
+        iovs[i].iov_len = batch[i].size;
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_name = &peers[i];
+        msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in6);
+    }
+
+    int n = ::recvmmsg(UDPSocket::so,msgs,(unsigned int)count,
+               MSG_DONTWAIT,NULL);
+    if ( n <= 0 )
+        return 0;
+    for ( int i = 0; i < n; i++ ) {
+        batch[i].size = msgs[i].msg_len;
+        batch[i].host = IPV6Host(peers[i].sin6_addr);
+        batch[i].port = ntohs(peers[i].sin6_port);
+    }
+    return (size_t)n;
+#else
+    if ( 0 == count || !isPendingRecv(0) )
+        return 0;
+    batch[0].host = getSender(batch[0].port);
+    batch[0].size = recv(batch[0].buffer,batch[0].size);
+    return 1;
+#endif
+}
+
+size_t
+RTPBaseUDPIPv6Socket::sendBatch(const RTPDatagramIPV6* batch, size_t count)
+{
+#ifdef CCRTP_BATCHED_IO
+    struct mmsghdr msgs[MaxRTPBatchSize];
+    struct iovec iovs[MaxRTPBatchSize];
+    struct sockaddr_in6 peers[MaxRTPBatchSize];
+    size_t sent = 0;
+    size_t pos = 0;
+
+    while ( pos < count ) {
+        size_t n = count - pos;
+        if ( n > MaxRTPBatchSize )
+            n = MaxRTPBatchSize;
+        memset(msgs,0,sizeof(struct mmsghdr) * n);
+        memset(peers,0,sizeof(struct sockaddr_in6) * n);
+        for ( size_t i = 0; i < n; i++ ) {
+            const RTPDatagramIPV6& d = batch[pos + i];
+            iovs[i].iov_base = d.buffer;
+            iovs[i].iov_len = d.size;
+            peers[i].sin6_family = AF_INET6;
+            peers[i].sin6_addr = d.host.getAddress();
+            peers[i].sin6_port = htons(d.port);
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            msgs[i].msg_hdr.msg_name = &peers[i];
+            msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in6);
+        }
+        int rtn = ::sendmmsg(UDPSocket::so,msgs,(unsigned int)n,0);
+        if ( rtn <= 0 ) {
+            if ( rtn < 0 && EINTR == errno )
+                continue;
+            // sendmmsg stops at the first datagram that fails:
+            // skip it and go on with the rest of the batch.
+            pos++;
+            continue;
+        }
+        pos += rtn;
+        sent += rtn;
+    }
+    return sent;
+#else
+    for ( size_t i = 0; i < count; i++ ) {
+        setPeer(batch[i].host,batch[i].port);
+        send(batch[i].buffer,batch[i].size);
+    }
+    return count;
+#endif
+}
+#endif
+
 END_NAMESPACE
 
 /** EMACS **
@@ -105,8 +105,9 @@ SDESItemsHolder::getItem(SDESItemType type) const
 }
 
 SyncSource::SyncSource(uint32 ssrc) :
-state(stateUnknown), SSRC(ssrc), participant(NULL),
-networkAddress("0"), dataTransportPort(0), controlTransportPort(0)
+state(stateUnknown), SSRC(ssrc), activeSender(false), participant(NULL),
+networkAddress("0"), dataTransportPort(0), controlTransportPort(0),
+dataUnits(0)
 {}
 
 SyncSource::~SyncSource()